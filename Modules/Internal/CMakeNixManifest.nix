@@ -0,0 +1,90 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file LICENSE.rst or https://cmake.org/licensing for details.
+
+# Object derivations of the CMake Nix generator, read from the JSON build
+# manifest next to this file (CMAKE_NIX_MANIFEST).  The generator copies
+# this file into the build tree; default.nix brings the returned attribute
+# set into scope, so link derivations refer to the objects by name.
+#
+# Manifest format (version 1):
+#
+#   strings          Table of the strings many objects share, such as flag
+#                    sets, paths and package names; the fields marked
+#                    [string] below are indices into it.
+#   contentAddressed Whether objects are content-addressed derivations.
+#   objects          Object derivations by attribute name:
+#     name           Derivation name, the object file name.
+#     root           [string] Source root relative to this directory.
+#     files          [string] Files and directories of the source fileset,
+#                    relative to root; without it the whole root is used.
+#     generated      [string] Fileset members that may not exist yet.
+#     source         [string] Source file, relative to the unpacked root.
+#     compiler       [string] Attribute path of the compiler package.
+#     binary         [string] Compiler binary in the package's bin; without
+#                    it the package's pname is used.
+#     flags          [string] Compile flags.
+#     buildInputs    [string] Attribute paths of packages.
+#     localBuild     Whether to build without querying binary caches.
+#     depfile        Whether to write the compiler's depfile to a "dep"
+#                    output.
+{ pkgs, manifest ? ./cmake-nix-manifest.json, ... }:
+with pkgs;
+with lib;
+let
+  data = builtins.fromJSON (builtins.readFile manifest);
+  str = index: elemAt data.strings index;
+
+  # "pkgsi686Linux.stdenv.cc" -> pkgs.pkgsi686Linux.stdenv.cc
+  package = index:
+    attrByPath (splitString "." (str index))
+      (throw "cmake-nix-manifest: no package ${str index} in nixpkgs") pkgs;
+
+  source = object:
+    let root = ./. + "/${str object.root}";
+    in if object ? files then
+      fileset.toSource {
+        inherit root;
+        fileset = fileset.unions (
+          map (file: root + "/${str file}") object.files
+          ++ map (file: fileset.maybeMissing (root + "/${str file}"))
+            (object.generated or [ ]));
+      }
+    else root;
+
+  compile = object:
+    let
+      compiler = package object.compiler;
+      binary = if object ? binary then str object.binary
+               else compiler.pname or "cc";
+      src = source object;
+      # Keep the build directory, the source store path and the output
+      # path out of the object so that equal code yields an equal object;
+      # the compilers are matched by name as in cmakeNixCC of default.nix
+      deterministicFlags = optionalString
+        (data.contentAddressed
+         && builtins.match
+              "cc|c[+][+]|.*(gcc|g[+][+]|clang|clang[+][+]|gfortran)(-[0-9].*)?"
+              binary != null)
+        "-ffile-prefix-map=$NIX_BUILD_TOP=. -ffile-prefix-map=${src}=. -frandom-seed=${object.name}";
+    in stdenv.mkDerivation ({
+      inherit (object) name;
+      inherit src;
+      buildInputs = map package object.buildInputs;
+      dontFixup = true;
+      buildPhase = ''
+        mkdir -p "$(dirname "$out")"
+        ${compiler}/bin/${binary} -c ${optionalString (object ? flags) (str object.flags)} ${deterministicFlags} ${optionalString (object.depfile or false) "-MD -MF $dep"} "${str object.source}" -o "$out"
+      '';
+      installPhase = "true";
+    } // optionalAttrs (object.localBuild or false) {
+      allowSubstitutes = false;
+      preferLocalBuild = true;
+    } // optionalAttrs (object.depfile or false) {
+      outputs = [ "out" "dep" ];
+    } // optionalAttrs data.contentAddressed {
+      __contentAddressed = true;
+      outputHashMode = "recursive";
+      outputHashAlgo = "sha256";
+    });
+in
+mapAttrs (name: compile) data.objects
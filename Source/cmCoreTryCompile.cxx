@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <set>
 #include <sstream>
 #include <utility>
@@ -22,6 +23,7 @@
 
 #include "cmArgumentParser.h"
 #include "cmConfigureLog.h"
+#include "cmCryptoHash.h"
 #include "cmExperimental.h"
 #include "cmExportTryCompileFileGenerator.h"
 #include "cmGlobalGenerator.h"
@@ -35,6 +37,7 @@
 #include "cmStringAlgorithms.h"
 #include "cmSystemTools.h"
 #include "cmTarget.h"
+#include "cmTryCompileResultCache.h"
 #include "cmValue.h"
 #include "cmVersion.h"
 #include "cmake.h"
@@ -103,6 +106,65 @@ std::set<std::string> const ghs_platform_vars{
   "GHS_OS_ROOT",         "GHS_OS_DIR",         "GHS_BSP_NAME",
   "GHS_OS_DIR_OPTION"
 };
+
+/**
+ * Key of a source file signature try_compile in the result cache: a hash
+ * of the generated project, the probe sources, the compilers and the
+ * CMAKE_FLAGS passed to the test project.  The scratch directory and the
+ * target name are random, so they are replaced by placeholders.  Returns
+ * an empty string if a compiler cannot be hashed.
+ */
+std::string ComputeResultCacheKey(cmMakefile const* mf,
+                                  std::string const& binaryDirectory,
+                                  std::string const& targetName,
+                                  cmStateEnums::TargetType targetType,
+                                  std::vector<std::string> const& sources,
+                                  std::set<std::string> const& languages,
+                                  std::vector<std::string> const& cmakeFlags)
+{
+  auto normalize = [&](std::string text) -> std::string {
+    cmSystemTools::ReplaceString(text, binaryDirectory, "<BINARY_DIR>");
+    cmSystemTools::ReplaceString(text, targetName, "<TARGET_NAME>");
+    return text;
+  };
+  cmCryptoHash hash(cmCryptoHash::AlgoSHA256);
+  hash.Initialize();
+  auto append = [&hash](cm::string_view field) {
+    hash.Append(field);
+    hash.Append(cm::string_view("\0", 1));
+  };
+
+  append(cmVersion::GetCMakeVersion());
+  append(mf->GetGlobalGenerator()->GetName());
+  append(std::to_string(static_cast<int>(targetType)));
+  cmTryCompileResultCache& cache = cmTryCompileResultCache::Instance();
+  for (std::string const& lang : languages) {
+    std::string const compiler =
+      mf->GetSafeDefinition(cmStrCat("CMAKE_", lang, "_COMPILER"));
+    std::string const compilerHash = cache.HashCompiler(compiler);
+    if (compilerHash.empty()) {
+      return std::string();
+    }
+    append(lang);
+    append(compilerHash);
+  }
+
+  // The generated project carries the effective flags, definitions, link
+  // libraries and language properties
+  cmsys::ifstream fin(cmStrCat(binaryDirectory, "/CMakeLists.txt").c_str());
+  std::string const project{ std::istreambuf_iterator<char>(fin),
+                             std::istreambuf_iterator<char>() };
+  append(normalize(project));
+  for (std::string const& source : sources) {
+    cmCryptoHash sourceHash(cmCryptoHash::AlgoSHA256);
+    append(normalize(source));
+    append(sourceHash.HashFile(source));
+  }
+  for (std::string const& flag : cmakeFlags) {
+    append(normalize(flag));
+  }
+  return hash.FinalizeHex();
+}
 using Arguments = cmCoreTryCompile::Arguments;
 
 ArgumentParser::Continue TryCompileLangProp(Arguments& args,
@@ -501,6 +563,8 @@ cm::optional<cmTryCompileResult> cmCoreTryCompile::TryCompileCode(
   }
 
   std::map<std::string, std::string> cmakeVariables;
+  std::vector<std::string> probeSources;
+  std::set<std::string> probeLanguages;
 
   std::string outFileName = cmStrCat(this->BinaryDirectory, "/CMakeLists.txt");
   // which signature are we using? If we are using var srcfile bindir
@@ -599,6 +663,11 @@ cm::optional<cmTryCompileResult> cmCoreTryCompile::TryCompileCode(
       }
     }
 
+    for (auto const& source : sources) {
+      probeSources.push_back(source.first);
+    }
+    probeLanguages = testLangs;
+
     // when the only language is ISPC we know that the output
     // type must by a static library
     if (testLangs.size() == 1 && testLangs.count("ISPC") == 1) {
@@ -1202,6 +1271,25 @@ cm::optional<cmTryCompileResult> cmCoreTryCompile::TryCompileCode(
     this->Makefile->IssueMessage(MessageType::LOG, msg);
   }
 
+  // Probes that must leave their output behind, link to imported targets
+  // or are being debugged always build
+  std::string resultCacheDir;
+  std::string resultCacheKey;
+  if (this->UseResultCache && this->SrcFileSignature &&
+      !arguments.CopyFileTo && targets.empty() &&
+      !this->Makefile->GetCMakeInstance()->GetDebugTryCompile()) {
+    resultCacheDir = cmTryCompileResultCache::GetDirectory(this->Makefile);
+  }
+  if (!resultCacheDir.empty()) {
+    resultCacheKey = ComputeResultCacheKey(
+      this->Makefile, this->BinaryDirectory, targetName, targetType,
+      probeSources, probeLanguages, arguments.CMakeFlags);
+  }
+  cmTryCompileResultCache::Entry cachedResult;
+  bool const resultCached = !resultCacheKey.empty() &&
+    cmTryCompileResultCache::Instance().Lookup(resultCacheDir, resultCacheKey,
+                                               cachedResult);
+
   bool erroroc = cmSystemTools::GetErrorOccurredFlag();
   cmSystemTools::ResetErrorOccurredFlag();
   std::string output;
@@ -1222,7 +1310,10 @@ cm::optional<cmTryCompileResult> cmCoreTryCompile::TryCompileCode(
     checkedEnv = true;
   }
   
-  if (parallelEnabled) {
+  if (resultCached) {
+    res = cachedResult.ExitCode;
+    output = std::move(cachedResult.Output);
+  } else if (parallelEnabled) {
     // Use parallel executor
     auto& executor = cmTryCompileExecutor::Instance();
     
@@ -1272,6 +1363,12 @@ cm::optional<cmTryCompileResult> cmCoreTryCompile::TryCompileCode(
       this->SrcFileSignature, cmake::NO_BUILD_PARALLEL_LEVEL,
       &arguments.CMakeFlags, output);
   }
+  if (!resultCacheKey.empty() && !resultCached) {
+    cachedResult.ExitCode = res;
+    cachedResult.Output = output;
+    cmTryCompileResultCache::Instance().Store(resultCacheDir, resultCacheKey,
+                                              cachedResult);
+  }
     
   auto end_time = std::chrono::steady_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
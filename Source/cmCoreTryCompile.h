@@ -155,6 +155,9 @@ public:
   std::string OutputFile;
   std::string FindErrorMessage;
   bool SrcFileSignature = false;
+  // try_run needs the executable itself, which a result taken from the
+  // try_compile result cache does not provide
+  bool UseResultCache = true;
   cmMakefile* Makefile;
 
 private:
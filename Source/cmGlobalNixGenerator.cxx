@@ -6,6 +6,8 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <set>
 #include <functional>
 #include <queue>
@@ -16,10 +18,20 @@
 #include <system_error>
 #include <exception>
 #include <fstream>
+#include <thread>
+
+#include <cm3p/json/value.h>
+#include <cm3p/json/writer.h>
 
 #include "cmsys/Directory.hxx"
+#include "cmsys/FStream.hxx"
+#include "cmCryptoHash.h"
+#include "cmFileTime.h"
+#include "cmGccDepfileReader.h"
 #include "cmGeneratedFileStream.h"
+#include "cmGeneratorExpression.h"
 #include "cmGeneratorTarget.h"
+#include "cmList.h"
 #include "cmLocalNixGenerator.h"
 #include "cmMakefile.h"
 #include "cmSourceFile.h"
@@ -35,9 +47,15 @@
 #include "cmNixPathUtils.h"
 #include "cmNixHeaderDependencyResolver.h"
 #include "cmNixCacheManager.h"
+#include "cmNixDependencyCache.h"
+#include "cmNixDependencyScanner.h"
+#include "cmNixIncludeScanner.h"
+#include "cmNixModuleScanner.h"
+#include "cmRulePlaceholderExpander.h"
 #include "cmInstallGenerator.h"
 #include "cmInstallTargetGenerator.h"
 #include "cmCustomCommand.h"
+#include "cmFileSet.h"
 #include "cmListFileCache.h"
 #include "cmValue.h"
 #include "cmState.h"
@@ -48,6 +66,77 @@
 #include "cmNixDerivationWriter.h"
 #include "cmNixDependencyGraph.h"
 
+namespace {
+// The unity sources CMake writes for UNITY_BUILD targets name themselves
+// in UNITY_SOURCE_FILE; the sources they include name the unity source
+bool IsGeneratedUnitySource(cmSourceFile const* source)
+{
+  cmValue unitySource = source->GetProperty("UNITY_SOURCE_FILE");
+  return unitySource && *unitySource == source->GetFullPath();
+}
+
+cmNixCacheManager::Limits GeneratorCacheLimits()
+{
+  cmNixCacheManager::Limits limits;
+  // Derivation names are referenced throughout default.nix, so they must
+  // not change during generation: an evicted name would be recomputed with
+  // a new uniqueness suffix
+  limits.DerivationNameEntries = 0;
+  limits.DerivationNameBytes = 0;
+  return limits;
+}
+
+// The compiler binary that cmakeNixCC picks for source at build time, for
+// the manifest to name it up front; empty to use the package's pname
+std::string ManifestCompilerBinary(std::string const& package,
+                                   std::string const& source)
+{
+  bool const cxx = cmHasLiteralSuffix(source, ".cpp") ||
+    cmHasLiteralSuffix(source, ".cxx") || cmHasLiteralSuffix(source, ".cc") ||
+    cmHasLiteralSuffix(source, ".C");
+  if (package == "stdenv.cc" || package == "pkgsi686Linux.stdenv.cc" ||
+      package == "gcc" || package == "pkgsi686Linux.gcc") {
+    return cxx ? "g++" : "gcc";
+  }
+  if (package == "clang" || package == "pkgsi686Linux.clang") {
+    return cxx ? "clang++" : "clang";
+  }
+  if (package == "gfortran" || package == "pkgsi686Linux.gfortran") {
+    return "gfortran";
+  }
+  return std::string();
+}
+
+// Whether name is an attribute path such as "pkgsi686Linux.stdenv.cc"
+bool IsAttributePath(std::string const& name)
+{
+  bool start = true;
+  for (char c : name) {
+    if (c == '.' && !start) {
+      start = true;
+    } else if (isalpha(static_cast<unsigned char>(c)) || c == '_' ||
+               (!start && (isdigit(static_cast<unsigned char>(c)) ||
+                           c == '-' || c == '\''))) {
+      start = false;
+    } else {
+      return false;
+    }
+  }
+  return !start;
+}
+// Append a flag, or several separated by spaces, to a flag string
+void AppendFlag(std::string& flags, std::string const& flag)
+{
+  if (flag.empty()) {
+    return;
+  }
+  if (!flags.empty()) {
+    flags += ' ';
+  }
+  flags += flag;
+}
+}
+
 // String constants for performance optimization
 const std::string cmGlobalNixGenerator::DefaultConfig = "Release";
 const std::string cmGlobalNixGenerator::CLanguage = "C";
@@ -57,7 +146,8 @@ cmGlobalNixGenerator::cmGlobalNixGenerator(cmake* cm)
   : cmGlobalCommonGenerator(cm)
   , CompilerResolver(std::make_unique<cmNixCompilerResolver>(cm))
   , DerivationWriter(std::make_unique<cmNixDerivationWriter>())
-  , CacheManager(std::make_unique<cmNixCacheManager>())
+  , CacheManager(std::make_unique<cmNixCacheManager>(GeneratorCacheLimits()))
+  , IncludeScanner(std::make_unique<cmNixIncludeScanner>())
   , FileSystemHelper(std::make_unique<cmNixFileSystemHelper>(cm))
   , CustomCommandHandler(std::make_unique<cmNixCustomCommandHandler>())
   , InstallRuleGenerator(std::make_unique<cmNixInstallRuleGenerator>())
@@ -129,6 +219,12 @@ void cmGlobalNixGenerator::Generate()
   
   this->LogDebug("Parent Generate() completed");
   
+  // Do not write derivations that cannot link
+  if (!this->CheckThinLTOLinker()) {
+    return;
+  }
+  this->CheckContentAddressedCompilers();
+  
   // Build dependency graph for transitive dependency resolution
   {
     ProfileTimer graphTimer(this, "BuildDependencyGraph");
@@ -140,17 +236,87 @@ void cmGlobalNixGenerator::Generate()
     ProfileTimer writeTimer(this, "WriteNixFile");
     this->WriteNixFile();
   }
+  if (this->UseStructuredBuildLog()) {
+    this->WriteDerivationRoles();
+  }
+  
+  cmNixCacheManager::CacheStats const stats = this->CacheManager->GetStats();
+  auto addCacheCounter =
+    [this](std::string const& name,
+           cmNixCacheManager::CacheStats::Counters const& counters) {
+      this->AddProfileCounter(name,
+                              { { "entries", counters.Entries },
+                                { "bytes", counters.Bytes },
+                                { "hits", counters.Hits },
+                                { "misses", counters.Misses },
+                                { "evictions", counters.Evictions } });
+      this->LogDebug(cmStrCat(name, ": ", counters.Entries, " entries, ",
+                              counters.Bytes, " bytes, ", counters.Hits,
+                              " hits, ", counters.Misses, " misses, ",
+                              counters.Evictions, " evictions"));
+    };
+  addCacheCounter("NixCache derivation names", stats.DerivationNames);
+  addCacheCounter("NixCache library dependencies", stats.LibraryDependencies);
+  addCacheCounter("NixCache transitive dependencies",
+                  stats.TransitiveDependencies);
+  this->AddProfileCounter(
+    "NixDerivations",
+    { { "objects", this->ObjectDerivations.size() },
+      { "objectAliases", this->ObjectAliases.size() },
+      { "sharedSources", this->SharedSources.size() } });
   
   this->LogDebug("Generate() completed");
 }
 
+std::string cmGlobalNixGenerator::GetDefaultBuildConfig() const
+{
+  cmValue buildType =
+    this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+      "CMAKE_BUILD_TYPE");
+  return buildType ? *buildType : std::string();
+}
+
+void cmGlobalNixGenerator::WarnUnsupportedBuildOptions(
+  std::string const& config, cmBuildOptions const& buildOptions) const
+{
+  cmake* cm = this->GetCMakeInstance();
+  if (buildOptions.Clean) {
+    cm->IssueMessage(
+      MessageType::WARNING,
+      "--clean-first only removes the result out-links of the build tree. "
+      "The Nix store keeps the outputs of the derivations, so nothing is "
+      "rebuilt; pass --check to nix-build after -- to rebuild the targets "
+      "instead.");
+  }
+  if (!config.empty()) {
+    cmValue buildType =
+      cm->GetState()->GetCacheEntryValue("CMAKE_BUILD_TYPE");
+    std::string const generated = buildType ? *buildType : std::string();
+    if (cmSystemTools::UpperCase(config) !=
+        cmSystemTools::UpperCase(generated)) {
+      cm->IssueMessage(
+        MessageType::WARNING,
+        cmStrCat("The Nix generator builds the configuration selected when "
+                 "generating (CMAKE_BUILD_TYPE=\"", generated,
+                 "\"), so --config ", config,
+                 " is ignored. Regenerate with -DCMAKE_BUILD_TYPE=", config,
+                 " to build it."));
+    }
+  }
+  if (buildOptions.ResolveMode != PackageResolveMode::Default) {
+    cm->IssueMessage(MessageType::WARNING,
+                     "--resolve-package-references has no effect with the "
+                     "Nix generator.");
+  }
+}
+
 std::vector<cmGlobalGenerator::GeneratedMakeCommand>
 cmGlobalNixGenerator::GenerateBuildCommand(
   std::string const& makeProgram, std::string const& /*projectName*/,
   std::string const& projectDir,
-  std::vector<std::string> const& targetNames, std::string const& /*config*/,
-  int /*jobs*/, bool /*verbose*/, cmBuildOptions const& /*buildOptions*/,
-  std::vector<std::string> const& /*makeOptions*/)
+  std::vector<std::string> const& targetNames, std::string const& config,
+  int jobs, bool verbose, cmBuildOptions const& buildOptions,
+  std::vector<std::string> const& makeOptions)
 {
   // Check if this is a try-compile (look for CMakeScratch in path)
   bool isTryCompile = projectDir.find("CMakeScratch") != std::string::npos;
@@ -167,7 +333,35 @@ cmGlobalNixGenerator::GenerateBuildCommand(
   }
   
   GeneratedMakeCommand makeCommand;
-  
+
+  // Store paths cannot be cleaned; the out-links are all the build leaves
+  // in the build tree
+  if (!isTryCompile && targetNames.size() == 1 &&
+      targetNames.front() == "clean") {
+    makeCommand.Add("sh", "-c", "rm -f result result-*");
+    return { std::move(makeCommand) };
+  }
+
+  // cmGlobalGenerator::Build runs the clean target above first for Clean.
+  // Nix always checks the inputs of every derivation, so there is no
+  // dependency scan for Fast to skip.  The other options cannot be honored
+  // and are reported instead of dropped.
+  if (!isTryCompile) {
+    this->WarnUnsupportedBuildOptions(config, buildOptions);
+  }
+
+  // The structured log is followed by "cmake -E cmake_nix_build_log", which
+  // runs nix-build itself
+  bool const structuredLog = !isTryCompile && this->UseStructuredBuildLog();
+  if (structuredLog) {
+    makeCommand.Add(cmSystemTools::GetCMakeCommand(), "-E",
+                    cmNix::CMake::NIX_BUILD_LOG);
+    if (verbose) {
+      makeCommand.Add("--verbose");
+    }
+    makeCommand.Add("--");
+  }
+
   // For Nix generator, we use nix-build as the build program
   makeCommand.Add(this->SelectMakeProgram(makeProgram, cmNix::Commands::NIX_BUILD));
   
@@ -177,6 +371,24 @@ cmGlobalNixGenerator::GenerateBuildCommand(
   } else {
     // Add default.nix file  
     makeCommand.Add(cmNix::Generator::DEFAULT_NIX);
+    if (this->UseContentAddressed()) {
+      makeCommand.Add("--option", "extra-experimental-features",
+                      "ca-derivations");
+    }
+
+    // Every object derivation runs a single compiler, so -j N builds N
+    // derivations at once with one core each
+    if (jobs == cmake::DEFAULT_BUILD_PARALLEL_LEVEL) {
+      makeCommand.Add("--max-jobs", "auto");
+    } else if (jobs != cmake::NO_BUILD_PARALLEL_LEVEL) {
+      makeCommand.Add("--max-jobs", std::to_string(jobs), "--cores", "1");
+    }
+
+    if (structuredLog) {
+      makeCommand.Add("--log-format", "internal-json");
+    } else if (verbose) {
+      makeCommand.Add("--print-build-logs");
+    }
   }
   
   // Add target names as attribute paths  
@@ -185,6 +397,7 @@ cmGlobalNixGenerator::GenerateBuildCommand(
       makeCommand.Add("-A", tname);
     }
   }
+  makeCommand.Add(makeOptions.begin(), makeOptions.end());
   
   // For try-compile, add post-build copy commands to move binaries from Nix store
   if (isTryCompile && !targetNames.empty()) {
@@ -241,7 +454,49 @@ cmGlobalNixGenerator::GenerateBuildCommand(
     return { std::move(makeCommand), std::move(copyCommand) };
   }
   
-  return { std::move(makeCommand) };
+  if (isTryCompile || !this->UseDepfiles()) {
+    return { std::move(makeCommand) };
+  }
+  
+  // Link the depfiles of the built objects for the next generation.  The
+  // stamp is taken before the build and only kept when it succeeds, so a
+  // source edited during the build is newer than the stamp of its depfile.
+  std::vector<std::string> targets;
+  for (auto const& tname : targetNames) {
+    if (!tname.empty()) {
+      targets.push_back(tname);
+    }
+  }
+  std::string collection = targets.empty() ? "all" : cmJoin(targets, "+");
+  std::replace_if(
+    collection.begin(), collection.end(),
+    [](char c) { return !std::isalnum(static_cast<unsigned char>(c)) &&
+                   c != '+' && c != '-' && c != '_' && c != '.'; },
+    '_');
+  collection =
+    cmStrCat(cmNix::Generator::DEPFILE_DIRECTORY, '/', collection);
+  
+  GeneratedMakeCommand startCommand;
+  startCommand.Add(cmSystemTools::GetCMakeCommand(), "-E", "touch",
+                   collection + ".pending");
+  GeneratedMakeCommand collectCommand;
+  collectCommand.Add(
+    this->SelectMakeProgram(makeProgram, cmNix::Commands::NIX_BUILD),
+    cmNix::Generator::DEFAULT_NIX);
+  if (this->UseContentAddressed()) {
+    collectCommand.Add("--option", "extra-experimental-features",
+                       "ca-derivations");
+  }
+  collectCommand.Add("-A", cmNix::Generator::DEPFILE_ATTRIBUTE);
+  if (!targets.empty()) {
+    collectCommand.Add("--argstr", "targets", cmJoin(targets, ";"));
+  }
+  collectCommand.Add("-o", collection);
+  GeneratedMakeCommand stampCommand;
+  stampCommand.Add(cmSystemTools::GetCMakeCommand(), "-E", "rename",
+                   collection + ".pending", collection + ".stamp");
+  return { std::move(startCommand), std::move(makeCommand),
+           std::move(collectCommand), std::move(stampCommand) };
 }
 
 void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
@@ -262,6 +517,31 @@ void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
   writer.WriteComment("Helper functions for DRY derivations");
   writer.WriteLine();
   
+  // In content-addressed mode the store path of an object or archive
+  // depends on its bytes, so dependents are not rebuilt when a change
+  // leaves them identical (needs the ca-derivations Nix feature)
+  bool const contentAddressed = this->UseContentAddressed();
+  auto writeContentAddressedAttributes = [&writer](std::string const& indent) {
+    writer.WriteLine(indent + "__contentAddressed = true;");
+    writer.WriteLine(indent + "outputHashMode = \"recursive\";");
+    writer.WriteLine(indent + "outputHashAlgo = \"sha256\";");
+  };
+
+  // Objects are cheap to build and rarely found in a binary cache, so
+  // derivations passed localBuild = true skip the substituter queries;
+  // the attributes are only added when set to keep other hashes stable
+  bool const localBuilds = this->HasLocalObjectBuilds();
+  auto writeLocalBuildAttributes = [&writer]() {
+    writer.WriteLine("  } // optionalAttrs localBuild {");
+    writer.WriteLine("    allowSubstitutes = false;");
+    writer.WriteLine("    preferLocalBuild = true;");
+    writer.WriteLine("  });");
+  };
+
+  // Derivations passed depfile = true also have a "dep" output with the
+  // headers the compiler read; batches compile their units without it
+  bool const depfiles = this->UseDepfiles();
+
   // Compilation helper function
   writer.WriteLine("  cmakeNixCC = {");
   writer.WriteLine("    name,");
@@ -269,12 +549,49 @@ void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
   writer.WriteLine("    compiler ? gcc,");
   writer.WriteLine("    flags ? \"\",");
   writer.WriteLine("    source,  # Source file path relative to src");
-  writer.WriteLine("    buildInputs ? []");
-  writer.WriteLine("  }: stdenv.mkDerivation {");
+  std::vector<std::string> optionalParameters{ "buildInputs ? []" };
+  if (localBuilds) {
+    optionalParameters.emplace_back("localBuild ? false");
+  }
+  if (depfiles) {
+    optionalParameters.emplace_back("depfile ? false");
+  }
+  // Precompiled headers by the path the compiler looks for them at
+  bool const pchs = this->HasPrecompiledHeaderTargets();
+  if (pchs) {
+    optionalParameters.emplace_back("pch ? {}");
+  }
+  // Module interfaces have a "bmi" output; imports maps the modules a
+  // source imports to the BMIs of their interfaces
+  std::string const moduleMapFormat = this->GetCxxModuleMapFormat();
+  bool const modules = !moduleMapFormat.empty();
+  if (modules) {
+    optionalParameters.emplace_back("module ? null");
+    optionalParameters.emplace_back("imports ? {}");
+  }
+  for (size_t i = 0; i < optionalParameters.size(); ++i) {
+    writer.WriteLine(cmStrCat("    ", optionalParameters[i],
+                              i + 1 < optionalParameters.size() ? "," : ""));
+  }
+  bool const extraAttributes = localBuilds || depfiles || modules;
+  if (extraAttributes) {
+    writer.WriteLine("  }: stdenv.mkDerivation ({");
+  } else {
+    writer.WriteLine("  }: stdenv.mkDerivation {");
+  }
   writer.WriteLine("    inherit name src buildInputs;");
   writer.WriteLine("    dontFixup = true;");
+  if (contentAddressed) {
+    writeContentAddressedAttributes("    ");
+  }
   writer.WriteLine("    buildPhase = ''");
   writer.WriteLine("      mkdir -p \"$(dirname \"$out\")\"");
+  if (pchs) {
+    writer.WriteLine("      ${concatStrings (mapAttrsToList (path: file: ''");
+    writer.WriteLine("        mkdir -p \"$(dirname \"${path}\")\"");
+    writer.WriteLine("        cp ${file} \"${path}\"");
+    writer.WriteLine("      '') pch)}");
+  }
   writer.WriteLine("      # Store source in a variable to handle paths with spaces");
   writer.WriteLine("      sourceFile=\"${source}\"");
   writer.WriteLine("      # Determine how to invoke the compiler based on the compiler derivation");
@@ -324,12 +641,127 @@ void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
   writer.WriteLine("        echo \"  This may happen if the source file path is incorrect or the file was moved.\"");
   writer.WriteLine("        exit 1");
   writer.WriteLine("      fi");
-  writer.WriteLine("      $compilerCmd -c ${flags} \"$srcFile\" -o \"$out\"");
+  if (contentAddressed) {
+    // Keep the build directory, the source store path and the output path
+    // out of the object so that equal code yields an equal object
+    // The Nix compiler wrappers install cc and c++ for GCC and Clang alike;
+    // target prefixes and version suffixes name the same compilers
+    writer.WriteLine("      case \"$(basename \"$compilerCmd\")\" in");
+    writer.WriteLine("        cc|c++|*gcc|*gcc-[0-9]*|*g++|*g++-[0-9]*|*clang|*clang-[0-9]*|*clang++|*clang++-[0-9]*|*gfortran|*gfortran-[0-9]*)");
+    writer.WriteLine("          deterministicFlags=\"-ffile-prefix-map=$NIX_BUILD_TOP=. -ffile-prefix-map=${src}=. -frandom-seed=${name}\" ;;");
+    writer.WriteLine("        *) deterministicFlags=\"\" ;;");
+    writer.WriteLine("      esac");
+  }
+  std::string depfileFlags;
+  if (depfiles) {
+    writer.WriteLine("      depfileFlags=\"\"");
+    writer.WriteLine("      if [ -n \"''${dep:-}\" ]; then");
+    writer.WriteLine("        depfileFlags=\"-MD -MF $dep\"");
+    writer.WriteLine("      fi");
+    depfileFlags = " $depfileFlags";
+  }
+  std::string moduleFlags;
+  if (modules) {
+    // The compiler finds the BMIs of the imported modules, and writes the
+    // one of the module the source provides, through a module map
+    bool const clangMap = moduleMapFormat == "clang";
+    writer.WriteLine("      moduleFlags=\"\"");
+    writer.WriteLine("      ${optionalString (module != null || imports != {}) ''");
+    writer.WriteLine("        moduleMap=\"$NIX_BUILD_TOP/module.map\"");
+    writer.WriteLine("        : > \"$moduleMap\"");
+    writer.WriteLine("        ${concatStrings (mapAttrsToList (name: bmi: ''");
+    writer.WriteLine(clangMap
+                       ? "          echo \"-fmodule-file=${name}=${bmi}\" >> \"$moduleMap\""
+                       : "          echo \"${name} ${bmi}\" >> \"$moduleMap\"");
+    writer.WriteLine("        '') imports)}${optionalString (module != null) ''");
+    writer.WriteLine(clangMap
+                       ? "          echo \"-x c++-module -fmodule-output=$bmi\" >> \"$moduleMap\""
+                       : "          echo \"${module} $bmi\" >> \"$moduleMap\"");
+    writer.WriteLine("        ''}");
+    writer.WriteLine(clangMap
+                       ? "        moduleFlags=\"@$moduleMap\""
+                       : "        moduleFlags=\"-fmodules-ts -fmodule-mapper=$moduleMap -x c++\"");
+    writer.WriteLine("      ''}");
+    moduleFlags = " $moduleFlags";
+  }
+  if (contentAddressed) {
+    writer.WriteLine(cmStrCat("      $compilerCmd -c ${flags} $deterministicFlags",
+                              depfileFlags, moduleFlags,
+                              " \"$srcFile\" -o \"$out\""));
+  } else {
+    writer.WriteLine(cmStrCat("      $compilerCmd -c ${flags}", depfileFlags,
+                              moduleFlags, " \"$srcFile\" -o \"$out\""));
+  }
   writer.WriteLine("    '';");
   writer.WriteLine("    installPhase = \"true\";");
-  writer.WriteLine("  };");
+  if (localBuilds) {
+    writer.WriteLine("  } // optionalAttrs localBuild {");
+    writer.WriteLine("    allowSubstitutes = false;");
+    writer.WriteLine("    preferLocalBuild = true;");
+  }
+  if (depfiles && modules) {
+    writer.WriteLine("  } // optionalAttrs (depfile || module != null) {");
+    writer.WriteLine("    outputs = [ \"out\" ] ++ optional depfile \"dep\" ++ optional (module != null) \"bmi\";");
+  } else if (depfiles) {
+    writer.WriteLine("  } // optionalAttrs depfile {");
+    writer.WriteLine("    outputs = [ \"out\" \"dep\" ];");
+  } else if (modules) {
+    writer.WriteLine("  } // optionalAttrs (module != null) {");
+    writer.WriteLine("    outputs = [ \"out\" \"bmi\" ];");
+  }
+  writer.WriteLine(extraAttributes ? "  });" : "  };");
   writer.WriteLine();
   
+  if (depfiles) {
+    // Source of an object whose fileset was narrowed to the headers of the
+    // last build: the narrow fileset while the files it was learned from
+    // are unchanged, the conservative one otherwise
+    writer.WriteLine("  cmakeNixLearnedSrc = hash: files: learned: conservative:");
+    writer.WriteLine("    let fileHash = file: if builtins.pathExists file then builtins.hashFile \"sha256\" file else \"-\";");
+    writer.WriteLine("    in if builtins.hashString \"sha256\" (concatMapStrings fileHash files) == hash");
+    writer.WriteLine("    then learned else conservative;");
+    writer.WriteLine();
+  }
+  
+  if (this->HasUnityBuildTargets()) {
+    // Unity batch helper: builds the cmakeNixCC derivations given as units
+    // in one derivation, each in a fresh copy of its source tree, with the
+    // object of each unit written to $out/<attribute name>
+    if (localBuilds) {
+      writer.WriteLine("  cmakeNixBatchCC = { name, units, localBuild ? false }: stdenv.mkDerivation ({");
+    } else {
+      writer.WriteLine("  cmakeNixBatchCC = { name, units }: stdenv.mkDerivation {");
+    }
+    writer.WriteLine("    inherit name;");
+    writer.WriteLine("    dontUnpack = true;");
+    writer.WriteLine("    dontFixup = true;");
+    if (contentAddressed) {
+      writeContentAddressedAttributes("    ");
+    }
+    writer.WriteLine("    buildInputs = unique (concatMap (unit: unit.buildInputs) (attrValues units));");
+    writer.WriteLine("    buildPhase = ''");
+    writer.WriteLine("      mkdir -p $out");
+    writer.WriteLine("      batchOut=$out");
+    writer.WriteLine("    '' + concatStrings (mapAttrsToList (object: unit: ''");
+    writer.WriteLine("      (");
+    writer.WriteLine("        rm -rf \"$NIX_BUILD_TOP/unit\" && mkdir \"$NIX_BUILD_TOP/unit\" && cd \"$NIX_BUILD_TOP/unit\"");
+    writer.WriteLine("        src=${unit.src}");
+    writer.WriteLine("        cp -r \"$src\" \"$(stripHash \"$src\")\"");
+    writer.WriteLine("        chmod -R u+w \"$(stripHash \"$src\")\"");
+    writer.WriteLine("        cd \"$(stripHash \"$src\")\"");
+    writer.WriteLine("        out=\"$batchOut/${object}\"");
+    writer.WriteLine("        ${unit.buildPhase}");
+    writer.WriteLine("      )");
+    writer.WriteLine("    '') units);");
+    writer.WriteLine("    installPhase = \"true\";");
+    if (localBuilds) {
+      writeLocalBuildAttributes();
+    } else {
+      writer.WriteLine("  };");
+    }
+    writer.WriteLine();
+  }
+  
   // Linking helper function
   // NOTE: This uses Unix-style library naming conventions (lib*.a, lib*.so)
   // This is appropriate since Nix only runs on Unix-like systems (Linux, macOS)
@@ -347,15 +779,19 @@ void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
   writer.WriteLine("    buildInputs ? [],");
   writer.WriteLine("    version ? null,");
   writer.WriteLine("    soversion ? null,");
+  writer.WriteLine("    archiver ? \"ar\",  # gcc-ar or llvm-ar for static libraries of IPO objects");
   writer.WriteLine("    postBuildPhase ? \"\"");
-  writer.WriteLine("  }: stdenv.mkDerivation {");
+  writer.WriteLine(contentAddressed ? "  }: stdenv.mkDerivation ({"
+                                    : "  }: stdenv.mkDerivation {");
   writer.WriteLine("    inherit name objects buildInputs;");
   writer.WriteLine("    dontUnpack = true;");
   writer.WriteLine("    buildPhase =");
   writer.WriteLine("      if type == \"static\" then ''");
   writer.WriteLine("        # Unix static library: uses 'ar' to create lib*.a files");
   writer.WriteLine("        mkdir -p \"$(dirname \"$out\")\"");
-  writer.WriteLine("        ar rcs \"$out\" $objects");
+  // D: zero timestamps, uids and modes in the archive members
+  writer.WriteLine(contentAddressed ? "        ${archiver} rcsD \"$out\" $objects"
+                                    : "        ${archiver} rcs \"$out\" $objects");
   writer.WriteLine("      '' else if type == \"shared\" || type == \"module\" then ''");
   writer.WriteLine("        mkdir -p $out");
   writer.WriteLine("        # Determine compiler command - use stdenv.cc's wrapped compiler when available");
@@ -415,8 +851,98 @@ void cmGlobalNixGenerator::WriteNixHelperFunctions(cmNixWriter& writer)
   writer.WriteLine("      '';");
   writer.WriteLine("    inherit postBuildPhase;");
   writer.WriteLine("    installPhase = \"true\";");
-  writer.WriteLine("  };");
+  if (contentAddressed) {
+    // Only archives: executables and shared libraries are what the build
+    // delivers, so their rebuilds are not cut short by anything downstream
+    writer.WriteLine("  } // lib.optionalAttrs (type == \"static\") {");
+    writeContentAddressedAttributes("    ");
+    writer.WriteLine("  });");
+  } else {
+    writer.WriteLine("  };");
+  }
   writer.WriteLine();
+  
+  if (this->HasDistributedThinLTOTargets()) {
+    // Distributed ThinLTO: the thin link writes the index of every bitcode
+    // object to $out/<store path of the object>.thinlto.bc without
+    // linking, and each backend compiles one object to native code with
+    // its index.  The index names the bitcode objects the backend imports
+    // from, so the backend takes the bitcode objects of the link as
+    // imports.  In content-addressed mode each backend reads its index
+    // through a copy of its own that links the objects listed in the
+    // .imports file of the object instead, so that an edit only reruns the
+    // backends whose index or imported objects changed.
+    writer.WriteLine("  cmakeNixThinLink = {");
+    writer.WriteLine("    name,");
+    writer.WriteLine("    type ? \"executable\",");
+    writer.WriteLine("    objects,");
+    writer.WriteLine("    compiler ? clang,");
+    writer.WriteLine("    compilerCommand ? \"clang\",");
+    writer.WriteLine("    flags ? \"\",");
+    writer.WriteLine("    libraries ? [],");
+    writer.WriteLine("    buildInputs ? []");
+    writer.WriteLine("  }: stdenv.mkDerivation {");
+    writer.WriteLine("    inherit name objects;");
+    writer.WriteLine("    buildInputs = buildInputs ++ [ lld ];");
+    writer.WriteLine("    dontUnpack = true;");
+    writer.WriteLine("    dontFixup = true;");
+    writer.WriteLine("    buildPhase = ''");
+    writer.WriteLine("      for object in $objects; do");
+    writer.WriteLine("        mkdir -p \"$out/$(dirname \"''${object#$NIX_STORE/}\")\"");
+    writer.WriteLine("      done");
+    writer.WriteLine("      ${compiler}/bin/${compilerCommand} ${optionalString (type != \"executable\") \"-shared\"} \\");
+    writer.WriteLine("        -fuse-ld=lld -flto=thin -Wl,--thinlto-index-only \\");
+    writer.WriteLine("        -Wl,--thinlto-emit-imports-files \\");
+    writer.WriteLine("        -Wl,--thinlto-prefix-replace=\"$NIX_STORE/;$out/\" \\");
+    writer.WriteLine("        $objects ${flags} ${concatStringsSep \" \" libraries} -o \"$NIX_BUILD_TOP/thinlink\"");
+    writer.WriteLine("    '';");
+    writer.WriteLine("    installPhase = \"true\";");
+    writer.WriteLine("  };");
+    writer.WriteLine();
+    writer.WriteLine("  cmakeNixThinBackend = {");
+    writer.WriteLine("    name,");
+    writer.WriteLine("    object,");
+    writer.WriteLine("    index,");
+    writer.WriteLine("    imports ? [],");
+    writer.WriteLine("    compiler ? clang,");
+    writer.WriteLine("    compilerCommand ? \"clang\",");
+    writer.WriteLine("    flags ? \"\"");
+    writer.WriteLine("  }:");
+    writer.WriteLine("    let");
+    std::string const summary =
+      "${index}/${removePrefix \"${builtins.storeDir}/\" \"${object}\"}";
+    if (contentAddressed) {
+      writer.WriteLine("      moduleImports = runCommand \"${name}.thinlto\" {");
+      writeContentAddressedAttributes("        ");
+      writer.WriteLine("        inherit imports;");
+      writer.WriteLine("      } ''");
+      writer.WriteLine("        mkdir -p $out");
+      writer.WriteLine(
+        cmStrCat("        cp ", summary, ".thinlto.bc $out/index.thinlto.bc"));
+      writer.WriteLine("        while read -r module; do");
+      writer.WriteLine("          ln -s \"$module\" \"$out/$(basename \"$module\")\"");
+      writer.WriteLine(cmStrCat("        done < ", summary, ".imports"));
+      writer.WriteLine("      '';");
+      writer.WriteLine("      moduleIndex = \"${moduleImports}/index.thinlto.bc\";");
+    } else {
+      writer.WriteLine(
+        cmStrCat("      moduleIndex = \"", summary, ".thinlto.bc\";"));
+    }
+    writer.WriteLine("    in stdenv.mkDerivation {");
+    writer.WriteLine(contentAddressed ? "      inherit name;"
+                                      : "      inherit name imports;");
+    writer.WriteLine("      dontUnpack = true;");
+    writer.WriteLine("      dontFixup = true;");
+    if (contentAddressed) {
+      writeContentAddressedAttributes("      ");
+    }
+    writer.WriteLine("      buildPhase = ''");
+    writer.WriteLine("        ${compiler}/bin/${compilerCommand} -c -x ir ${object} -fthinlto-index=${moduleIndex} ${flags} -o \"$out\"");
+    writer.WriteLine("      '';");
+    writer.WriteLine("      installPhase = \"true\";");
+    writer.WriteLine("    };");
+    writer.WriteLine();
+  }
 }
 
 void cmGlobalNixGenerator::WriteNixFile()
@@ -453,13 +979,50 @@ void cmGlobalNixGenerator::WriteNixFile()
   writer.WriteLine(cmNix::Commands::NIXPKGS_IMPORT);
   writer.WriteLine("with pkgs;");
   writer.WriteLine("with lib;");  // Import lib for fileset functions
+  // Object derivations from the build manifest; with fragments, the
+  // library is merged into their scope instead
+  bool const manifest = this->UseManifest();
+  if (manifest && !this->UseFragments()) {
+    writer.WriteLine(cmStrCat("with import ./", cmNix::Generator::MANIFEST_LIBRARY,
+                              " { inherit pkgs; };"));
+  }
   writer.WriteLine();
   writer.StartLetBinding();
   
+  // With fragments, the shared bindings go to the common fragment and each
+  // target's object and link derivations to a fragment of its own
+  this->WritingFragments = this->UseFragments();
+  this->TargetFragments.clear();
+  std::unique_ptr<cmGeneratedFileStream> commonFragment;
+  if (this->WritingFragments) {
+    commonFragment = cm::make_unique<cmGeneratedFileStream>(
+      cmStrCat(homeOutputDir, '/', cmNix::Generator::COMMON_FRAGMENT));
+    commonFragment->SetCopyIfDifferent(true);
+    if (!*commonFragment) {
+      this->GetCMakeInstance()->IssueMessage(
+        MessageType::FATAL_ERROR,
+        cmStrCat("Failed to open Nix file for writing: ", homeOutputDir, '/',
+                 cmNix::Generator::COMMON_FRAGMENT));
+      this->WritingFragments = false;
+      return;
+    }
+  }
+  cmGeneratedFileStream& bindingStream =
+    commonFragment ? *commonFragment : nixFileStream;
+  cmNixWriter bindingWriter(bindingStream);
+  if (commonFragment) {
+    bindingWriter.WriteComment("Generated by CMake Nix Generator");
+    bindingWriter.WriteLine("{ pkgs, self }:");
+    bindingWriter.WriteLine("with pkgs;");
+    bindingWriter.WriteLine("with lib;");
+    bindingWriter.WriteLine("with self;");
+    bindingWriter.StartAttributeSet();
+  }
+  
   // Write helper functions for DRY code generation
   {
     ProfileTimer helperTimer(this, "WriteNixHelperFunctions");
-    this->WriteNixHelperFunctions(writer);
+    this->WriteNixHelperFunctions(bindingWriter);
   }
 
   // Collect all custom commands using the handler
@@ -481,37 +1044,75 @@ void cmGlobalNixGenerator::WriteNixFile()
   // Write external header derivations first (before object derivations that depend on them)
   {
     ProfileTimer headerTimer(this, "WriteExternalHeaderDerivations");
-    this->HeaderDependencyResolver->WriteExternalHeaderDerivations(nixFileStream);
+    this->HeaderDependencyResolver->WriteExternalHeaderDerivations(bindingStream);
   }
   
   // Write per-translation-unit derivations BEFORE custom commands
   // so that ObjectFileOutputs is populated when custom commands need it
   {
     ProfileTimer unitTimer(this, "WritePerTranslationUnitDerivations");
-    this->WritePerTranslationUnitDerivations(nixFileStream);
+    this->WritePerTranslationUnitDerivations(bindingStream);
   }
   
   // Write custom command derivations AFTER object derivations
   // so that object file dependencies are available
   {
     ProfileTimer customTimer(this, "WriteCustomCommandDerivations");
-    this->WriteCustomCommandDerivations(nixFileStream);
+    this->WriteCustomCommandDerivations(bindingStream);
   }
 
   // Write linking derivations
   {
     ProfileTimer linkTimer(this, "WriteLinkingDerivations");
-    this->WriteLinkingDerivations(nixFileStream);
+    this->WriteLinkingDerivations(bindingStream);
   }
   
   // Write install derivations in the let block  
   {
     ProfileTimer installTimer(this, "WriteInstallRules");
-    this->WriteInstallRules(nixFileStream);
+    this->WriteInstallRules(bindingStream);
+  }
+  
+  if (commonFragment) {
+    bindingWriter.EndAttributeSet();
+    commonFragment->Close();
+    
+    std::vector<std::string> fragments;
+    fragments.emplace_back(cmNix::Generator::COMMON_FRAGMENT);
+    if (manifest) {
+      fragments.emplace_back(cmNix::Generator::MANIFEST_LIBRARY);
+    }
+    {
+      ProfileTimer fragmentTimer(this, "WriteTargetFragments");
+      std::vector<std::string> targetFragments = this->WriteTargetFragments();
+      fragments.insert(fragments.end(), targetFragments.begin(),
+                       targetFragments.end());
+    }
+    this->WritingFragments = false;
+    
+    // Merge all fragments into one scope so that derivations can keep
+    // referring to each other by name across fragments
+    writer.WriteIndented(1, "# Per-target fragments merged into a single scope");
+    writer.WriteIndented(1, "cmakeNixFragments = [");
+    for (std::string const& fragment : fragments) {
+      writer.WriteIndented(2, "./" + fragment);
+    }
+    writer.WriteIndented(1, "];");
+    writer.WriteIndented(1, "cmakeNixScope = fix (self: builtins.listToAttrs (builtins.concatMap (fragment:");
+    writer.WriteIndented(2, "let attrs = import fragment { inherit pkgs self; };");
+    writer.WriteIndented(2, "in map (name: { inherit name; value = attrs.${name}; }) (builtins.attrNames attrs))");
+    writer.WriteIndented(2, "cmakeNixFragments));");
+  } else {
+    // Fragments of an earlier generation with CMAKE_NIX_FRAGMENTS are no
+    // longer read by default.nix
+    this->RemoveStaleFragments({});
   }
   
   // End let binding and start attribute set for outputs
   writer.EndLetBinding();
+  if (commonFragment) {
+    writer.WriteLine("with cmakeNixScope;");
+  }
   writer.StartAttributeSet();
   
   // Write final target outputs
@@ -529,6 +1130,8 @@ void cmGlobalNixGenerator::WriteNixFile()
     }
   }
 
+  this->WriteDepfileCollection(writer);
+
   // Write install outputs
   this->WriteInstallOutputs(nixFileStream);
   
@@ -541,6 +1144,10 @@ void cmGlobalNixGenerator::WritePerTranslationUnitDerivations(
   cmNixWriter writer(nixFileStream);
   writer.WriteComment("Per-translation-unit derivations");
   
+  // Target generators must outlive the jobs that reference them
+  std::vector<std::unique_ptr<cmNixTargetGenerator>> targetGenerators;
+  std::vector<ObjectDerivationJob> jobs;
+  
   for (auto const& lg : this->LocalGenerators) {
     auto const& targets = lg->GetGeneratorTargets();
     for (auto const& target : targets) {
@@ -550,15 +1157,12 @@ void cmGlobalNixGenerator::WritePerTranslationUnitDerivations(
           target->GetType() == cmStateEnums::MODULE_LIBRARY ||
           target->GetType() == cmStateEnums::OBJECT_LIBRARY) {
         
-        // Check for Unity Build and warn if enabled
-        if (target->GetPropertyAsBool("UNITY_BUILD")) {
-          this->GetCMakeInstance()->IssueMessage(
-            MessageType::WARNING,
-            cmStrCat("Unity builds are not supported by the Nix generator and will be ignored for target '",
-                     target->GetName(), 
-                     "'. The Nix backend achieves better performance through fine-grained parallelism."),
-            target->GetBacktrace());
-        }
+        // Unity builds batch sources into shared compile derivations
+        // instead of compiling the generated unity sources, so that every
+        // source keeps its own flags
+        bool const unityBuild = target->GetPropertyAsBool("UNITY_BUILD");
+        cmValue const unityMode = target->GetProperty("UNITY_BUILD_MODE");
+        bool const unityGroups = unityMode && *unityMode == "GROUP";
         
         // Get source files for this target
         std::vector<cmSourceFile*> sources;
@@ -573,21 +1177,27 @@ void cmGlobalNixGenerator::WritePerTranslationUnitDerivations(
         }
         
         // Pre-create target generator and cache configuration for efficiency
-        auto targetGen = cmNixTargetGenerator::New(target.get());
+        targetGenerators.push_back(cmNixTargetGenerator::New(target.get()));
+        cmNixTargetGenerator* targetGen = targetGenerators.back().get();
         std::string config = this->GetBuildConfiguration(target.get());
         
+        // Report module sources the compiler cannot scan.  Compile
+        // features are computed for CMAKE_BUILD_TYPE as given, not for the
+        // configuration the generator falls back to.
+        target->CheckCxxModuleStatus(
+          target->GetLocalGenerator()->GetMakefile()->GetDefaultConfiguration());
+        
         // Pre-compute and cache library dependencies for this target
         this->CacheManager->GetLibraryDependencies(target.get(), config,
-          [&targetGen, &config]() {
+          [targetGen, &config]() {
             return targetGen->GetTargetLibraryDependencies(config);
           });
         
         for (const cmSourceFile* source : sources) {
-          // Skip Unity-generated batch files (unity_X_cxx.cxx) as we don't support Unity builds
-          // But still process the original source files
+          // Skip the generated unity sources; the original sources are
+          // compiled instead
           std::string sourcePath = source->GetFullPath();
-          if (sourcePath.find("/Unity/unity_") != std::string::npos && 
-              sourcePath.find("_cxx.cxx") != std::string::npos) {
+          if (IsGeneratedUnitySource(source)) {
             this->LogDebug("Skipping Unity batch file: " + sourcePath);
             continue;
           }
@@ -600,137 +1210,860 @@ void cmGlobalNixGenerator::WritePerTranslationUnitDerivations(
             if (cmSystemTools::FileIsSymlink(resolvedSourcePath)) {
               resolvedSourcePath = cmSystemTools::GetRealPath(resolvedSourcePath);
             }
-            std::vector<std::string> dependencies = targetGen->GetSourceDependencies(source);
-            this->AddObjectDerivation(target->GetName(), this->GetDerivationName(target->GetName(), resolvedSourcePath), resolvedSourcePath, targetGen->GetObjectFileName(source), lang, dependencies);
-            this->WriteObjectDerivation(nixFileStream, target.get(), source);
+            // Derivation names are uniquified in order of first use, so
+            // assign them here, before the scans and batches look them up
+            std::string const derivationName =
+              this->GetDerivationName(target->GetName(), resolvedSourcePath);
+            
+            // A precompiled header source compiles the header that the
+            // other sources of the target, and of the targets reusing it,
+            // take as an input, so it is never batched
+            bool pchSource = false;
+            for (std::string const& arch : target->GetPchArchs(config, lang)) {
+              if (target->GetPchSource(config, lang, arch) == sourcePath) {
+                this->PchDerivations[sourcePath] = derivationName;
+                pchSource = true;
+              }
+            }
+            
+            std::string batchKey;
+            if (unityBuild && !pchSource &&
+                (lang == "C" || lang == "CXX" || lang == "CUDA") &&
+                !source->GetPropertyAsBool("SKIP_UNITY_BUILD_INCLUSION")) {
+              if (!unityGroups) {
+                batchKey = lang;
+              } else if (cmValue group = source->GetProperty("UNITY_GROUP")) {
+                batchKey = cmStrCat(lang, '|', *group);
+              }
+            }
+            jobs.push_back(ObjectDerivationJob{ target.get(), source, targetGen,
+                                                resolvedSourcePath, std::string(),
+                                                std::move(batchKey),
+                                                ManifestObject() });
           }
         }
       }
     }
   }
-}
-
-void cmGlobalNixGenerator::WriteLinkingDerivations(
-  cmGeneratedFileStream& nixFileStream)
-{
-  nixFileStream << "\n  # Linking derivations\n";
   
-  for (auto const& lg : this->LocalGenerators) {
-    auto const& targets = lg->GetGeneratorTargets();
-    for (auto const& target : targets) {
-      if (target->GetType() == cmStateEnums::EXECUTABLE ||
-          target->GetType() == cmStateEnums::STATIC_LIBRARY ||
-          target->GetType() == cmStateEnums::SHARED_LIBRARY ||
-          target->GetType() == cmStateEnums::MODULE_LIBRARY) {
-        this->WriteLinkDerivation(nixFileStream, target.get());
-      }
+  this->ScanSourceDependencies(jobs);
+  this->ScanModuleDependencies(jobs);
+  if (this->UseDepfiles()) {
+    this->LoadLearnedDependencies();
+  }
+  for (ObjectDerivationJob& job : jobs) {
+    this->RenderObjectDerivationJob(job);
+  }
+  this->DeduplicateObjectDerivations(jobs);
+  this->WriteSharedSources(nixFileStream);
+  
+  // Objects shared by several targets belong to none of their fragments
+  std::set<std::string> sharedObjects;
+  if (this->WritingFragments) {
+    for (auto const& alias : this->ObjectAliases) {
+      sharedObjects.insert(alias.second);
     }
   }
-}
-
-std::string cmGlobalNixGenerator::GetDerivationName(
-  std::string const& targetName, std::string const& sourceFile) const
-{
-  // Use cache manager to get or compute the derivation name
-  return this->CacheManager->GetDerivationName(targetName, sourceFile,
-    [this, &targetName, &sourceFile]() {
-      std::string result;
-  if (sourceFile.empty()) {
-    result = "link_" + targetName;
-  } else {
-    // Use filename with parent directory to make it unique
-    std::string filename = cmSystemTools::GetFilenameName(sourceFile);
-    std::string parentDir = cmSystemTools::GetFilenameName(
-      cmSystemTools::GetFilenamePath(sourceFile));
-    
-    // Create unique identifier including parent directory
-    std::string uniqueName;
-    if (!parentDir.empty() && parentDir != ".") {
-      uniqueName = parentDir + "_" + filename;
+  
+  // Emit in enumeration order so that batches and aliases do not reorder
+  // the object derivations
+  for (ObjectDerivationJob const& job : jobs) {
+    if (job.Manifest.Valid) {
+      continue;
+    }
+    if (this->WritingFragments &&
+        !sharedObjects.count(this->GetDerivationName(
+          job.Target->GetName(), job.ResolvedSourcePath))) {
+      TargetFragment& fragment = this->TargetFragments[job.Target->GetName()];
+      fragment.Bindings += job.Output;
     } else {
-      uniqueName = filename;
+      nixFileStream << job.Output;
     }
-    
-    // Convert to valid Nix identifier
-    std::replace(uniqueName.begin(), uniqueName.end(), '.', '_');
-    std::replace(uniqueName.begin(), uniqueName.end(), '-', '_');
-    result = targetName + "_" + uniqueName + "_o";
   }
   
-  // Use the proper function to make a valid Nix identifier
-  result = cmNixWriter::MakeValidNixIdentifier(result);
+  for (ObjectBatch const& batch : this->GroupObjectBatches(jobs)) {
+    if (this->WritingFragments) {
+      std::ostringstream batchDerivation;
+      this->WriteObjectBatch(batchDerivation, batch);
+      TargetFragment& fragment = this->TargetFragments[batch.Target->GetName()];
+      fragment.Bindings += batchDerivation.str();
+    } else {
+      this->WriteObjectBatch(nixFileStream, batch);
+    }
+  }
   
-  // Ensure uniqueness by checking UsedDerivationNames
-  std::string finalResult = result;
-  int suffix = 2;
-  while (this->CacheManager->IsDerivationNameUsed(finalResult)) {
-    finalResult = result + "_" + std::to_string(suffix);
-    suffix++;
+  if (this->UseManifest()) {
+    this->WriteBuildManifest(jobs);
   }
-  this->CacheManager->MarkDerivationNameUsed(finalResult);
   
-      return finalResult;
-    });
+  // Batched sources are compiled without a depfile; aliases share the one
+  // of their canonical derivation
+  for (ObjectDerivationJob const& job : jobs) {
+    std::string const name =
+      this->GetDerivationName(job.Target->GetName(), job.ResolvedSourcePath);
+    auto key = this->DepfileKeys.find(name);
+    if (key == this->DepfileKeys.end() || job.Output.empty() ||
+        this->BatchedObjects.count(name)) {
+      continue;
+    }
+    auto alias = this->ObjectAliases.find(name);
+    this->TargetDepfiles[job.Target->GetName()][key->second] =
+      alias != this->ObjectAliases.end() ? alias->second : name;
+  }
 }
 
-void cmGlobalNixGenerator::AddObjectDerivation(std::string const& targetName, std::string const& derivationName, std::string const& sourceFile, std::string const& objectFileName, std::string const& language, std::vector<std::string> const& dependencies)
+std::vector<cmGlobalNixGenerator::ObjectBatch>
+cmGlobalNixGenerator::GroupObjectBatches(
+  std::vector<ObjectDerivationJob> const& jobs)
 {
-  ObjectDerivation od;
-  od.TargetName = targetName;
-  od.DerivationName = derivationName;
-  od.SourceFile = sourceFile;
-  od.ObjectFileName = objectFileName;
-  od.Language = language;
-  od.Dependencies = dependencies;
-  this->ObjectDerivations[derivationName] = od;
+  // Sources per target and batch key, in source order
+  std::vector<std::pair<cmGeneratorTarget*, std::string>> keys;
+  std::map<std::pair<cmGeneratorTarget*, std::string>,
+           std::vector<ObjectDerivationJob const*>> units;
+  for (ObjectDerivationJob const& job : jobs) {
+    // Sources that failed validation have no derivation to batch
+    if (job.BatchKey.empty() || job.Output.empty()) {
+      continue;
+    }
+    auto key = std::make_pair(job.Target, job.BatchKey);
+    auto& list = units[key];
+    if (list.empty()) {
+      keys.push_back(key);
+    }
+    list.push_back(&job);
+  }
   
-  // Also track object file path to derivation mapping
-  // The object file path might be relative, so we need to handle it properly
-  std::string objPath = objectFileName;
-  if (!cmSystemTools::FileIsFullPath(objPath)) {
-    // Make it relative to the top build directory for consistency
-    const std::string& homeOutputDir = this->GetCMakeInstance()->GetHomeOutputDirectory();
-    objPath = homeOutputDir + "/" + objPath;
+  std::vector<ObjectBatch> batches;
+  std::map<cmGeneratorTarget*, size_t> batchCounts;
+  std::set<cmGeneratorTarget*> invalidBatchSizes;
+  for (auto const& key : keys) {
+    cmGeneratorTarget* target = key.first;
+    std::vector<ObjectDerivationJob const*> const& list = units[key];
+    
+    // As for the unity sources CMake generates, GROUP mode puts a whole
+    // group into one batch and BATCH mode splits by UNITY_BUILD_BATCH_SIZE,
+    // where 0 means no limit
+    size_t batchSize = list.size();
+    cmValue mode = target->GetProperty("UNITY_BUILD_MODE");
+    if (!mode || *mode != "GROUP") {
+      cmValue batchSizeString = target->GetProperty("UNITY_BUILD_BATCH_SIZE");
+      unsigned long size = 0;
+      if (batchSizeString && !batchSizeString->empty() &&
+          !cmStrToULong(*batchSizeString, &size)) {
+        if (invalidBatchSizes.insert(target).second) {
+          this->GetCMakeInstance()->IssueMessage(
+            MessageType::WARNING,
+            cmStrCat("Ignoring invalid UNITY_BUILD_BATCH_SIZE value '",
+                     *batchSizeString, "' of target \"", target->GetName(),
+                     "\". Expected a non-negative integer."),
+            target->GetBacktrace());
+        }
+        size = 0;
+      }
+      if (size > 0) {
+        batchSize = static_cast<size_t>(size);
+      }
+    }
+    
+    std::string const lang =
+      cmSystemTools::LowerCase(key.second.substr(0, key.second.find('|')));
+    for (size_t begin = 0; begin < list.size(); begin += batchSize) {
+      size_t const end = std::min(list.size(), begin + batchSize);
+      // A batch of one only adds indirection
+      if (end - begin < 2) {
+        continue;
+      }
+      ObjectBatch batch;
+      batch.Target = target;
+      batch.DerivationName = this->GetDerivationName(
+        target->GetName(),
+        cmStrCat("unity_", lang, '_', batchCounts[target]++));
+      batch.Units.assign(list.begin() + begin, list.begin() + end);
+      for (ObjectDerivationJob const* unit : batch.Units) {
+        std::string const unitName = this->GetDerivationName(
+          target->GetName(), unit->ResolvedSourcePath);
+        this->BatchedObjects[unitName] =
+          cmStrCat("\"${", batch.DerivationName, "}/", unitName,
+                   this->GetObjectFileExtension(), '"');
+      }
+      batches.push_back(std::move(batch));
+    }
   }
-  this->ObjectFileOutputs[objPath] = derivationName;
+  return batches;
 }
 
-void cmGlobalNixGenerator::WriteObjectDerivation(
-  cmGeneratedFileStream& nixFileStream, cmGeneratorTarget* target, 
-  const cmSourceFile* source)
+void cmGlobalNixGenerator::WriteObjectBatch(std::ostream& os,
+                                            ObjectBatch const& batch)
 {
-  // Profile only if CMAKE_NIX_PROFILE_DETAILED=1 to avoid too much output
-  const char* detailedProfile = std::getenv("CMAKE_NIX_PROFILE_DETAILED");
-  std::unique_ptr<ProfileTimer> timer;
-  if (detailedProfile && std::string(detailedProfile) == "1") {
-    timer = std::make_unique<ProfileTimer>(this, "WriteObjectDerivation");
+  this->DerivationRoles[batch.DerivationName] = "compile";
+  os << "  " << batch.DerivationName << " = cmakeNixBatchCC {\n";
+  os << "    name = \"" << batch.DerivationName << "\";\n";
+  os << "    units = {\n";
+  for (ObjectDerivationJob const* unit : batch.Units) {
+    std::string const unitName = this->GetDerivationName(
+      batch.Target->GetName(), unit->ResolvedSourcePath);
+    os << "      \"" << unitName << this->GetObjectFileExtension()
+       << "\" = " << unitName << ";\n";
   }
-  
-  // Step 1: Prepare compilation context
-  SourceCompilationContext ctx = PrepareSourceCompilationContext(target, source);
-  
-  this->LogDebug("WriteObjectDerivation for source: " + ctx.sourceFile + 
-                " (generated: " + std::to_string(source->GetIsGenerated()) + ")");
-  
-  // Step 2: Validate source file
-  std::string errorMessage;
-  if (!this->ValidateSourceFile(source, target, errorMessage)) {
-    this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, errorMessage);
-    return;
+  os << "    };\n";
+  if (this->UseLocalObjectBuilds(batch.Target)) {
+    os << "    localBuild = true;\n";
   }
-  
-  // Emit warning if validation passed but there was a warning message
-  if (!errorMessage.empty()) {
-    // Only show external source warnings in debug mode or for non-CMake files
-    if (this->GetCMakeInstance()->GetDebugOutput() ||
-        (errorMessage.find("CMakeC") == std::string::npos &&
-         errorMessage.find("CMakeCXX") == std::string::npos)) {
-      this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, errorMessage);
-    }
+  os << "  };\n\n";
+}
+
+void cmGlobalNixGenerator::WriteDerivationRoles() const
+{
+  // Precompiled headers and module interfaces are object derivations too
+  std::map<std::string, std::string> roles = this->DerivationRoles;
+  for (auto const& object : this->ObjectDerivations) {
+    roles.emplace(object.second.ObjectFileName, "compile");
+  }
+  for (auto const& output : this->CustomCommandOutputs) {
+    roles.emplace(output.second, "custom");
   }
   
-  // Step 3: Get compile flags
-  std::string allCompileFlags = this->GetCompileFlags(target, source, ctx.lang, ctx.config, ctx.objectName);
+  cmGeneratedFileStream fout(
+    cmStrCat(this->GetCMakeInstance()->GetHomeOutputDirectory(), '/',
+             cmNix::Generator::DERIVATION_ROLES));
+  fout.SetCopyIfDifferent(true);
+  for (auto const& role : roles) {
+    fout << role.second << ' ' << role.first << '\n';
+  }
+}
+
+bool cmGlobalNixGenerator::UseLocalObjectBuilds(
+  cmGeneratorTarget const* target) const
+{
+  if (cmValue local = target->GetProperty("NIX_LOCAL_OBJECTS")) {
+    return cmIsOn(*local);
+  }
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_LOCAL_OBJECTS");
+  if (!value) {
+    return false;
+  }
+  if (cmIsOn(*value)) {
+    return true;
+  }
+  cmList const types{ *value };
+  return std::find(types.begin(), types.end(),
+                   cmState::GetTargetTypeName(target->GetType())) !=
+    types.end();
+}
+
+bool cmGlobalNixGenerator::HasLocalObjectBuilds() const
+{
+  for (auto const& lg : this->LocalGenerators) {
+    for (auto const& target : lg->GetGeneratorTargets()) {
+      if (this->UseLocalObjectBuilds(target.get())) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool cmGlobalNixGenerator::HasUnityBuildTargets() const
+{
+  for (auto const& lg : this->LocalGenerators) {
+    for (auto const& target : lg->GetGeneratorTargets()) {
+      if (target->GetPropertyAsBool("UNITY_BUILD")) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool cmGlobalNixGenerator::HasPrecompiledHeaderTargets() const
+{
+  for (auto const& lg : this->LocalGenerators) {
+    for (auto const& target : lg->GetGeneratorTargets()) {
+      if (!target->GetPropertyAsBool("DISABLE_PRECOMPILE_HEADERS") &&
+          (target->GetProperty("PRECOMPILE_HEADERS") ||
+           target->GetProperty("PRECOMPILE_HEADERS_REUSE_FROM"))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool cmGlobalNixGenerator::CheckCxxModuleSupport(
+  CxxModuleSupportQuery /*query*/)
+{
+  return true;
+}
+
+std::string cmGlobalNixGenerator::GetCxxModuleMapFormat() const
+{
+  for (auto const& lg : this->LocalGenerators) {
+    for (auto const& target : lg->GetGeneratorTargets()) {
+      cmMakefile const* mf = target->GetLocalGenerator()->GetMakefile();
+      if (target->CanCompileSources() &&
+          target->HaveCxxModuleSupport(mf->GetDefaultConfiguration()) ==
+            cmGeneratorTarget::Cxx20SupportLevel::Supported) {
+        return mf->GetSafeDefinition("CMAKE_CXX_MODULE_MAP_FORMAT");
+      }
+    }
+  }
+  return std::string();
+}
+
+void cmGlobalNixGenerator::ScanModuleDependencies(
+  std::vector<ObjectDerivationJob>& jobs)
+{
+  std::string const scanDirectory =
+    cmStrCat(this->GetCMakeInstance()->GetHomeOutputDirectory(), '/',
+             cmNix::Generator::MODULE_SCAN_DIRECTORY);
+  std::vector<cmNixModuleScanner::Request> requests;
+  std::vector<ObjectDerivationJob*> scannedJobs;
+  std::map<cmLocalGenerator*, std::unique_ptr<cmRulePlaceholderExpander>>
+    expanders;
+  for (ObjectDerivationJob& job : jobs) {
+    std::string const config = this->GetBuildConfiguration(job.Target);
+    cmMakefile const* mf = job.Target->GetLocalGenerator()->GetMakefile();
+    cmValue const rule = mf->GetDefinition("CMAKE_CXX_SCANDEP_SOURCE");
+    // Without a rule, CheckCxxModuleStatus has already reported the
+    // module sources
+    if (job.Source->GetLanguage() != "CXX" || !rule ||
+        !job.Target->NeedDyndepForSource("CXX", mf->GetDefaultConfiguration(),
+                                         job.Source)) {
+      continue;
+    }
+    
+    // Scan files are named by derivation, which is unique per target and
+    // source
+    std::string const name =
+      this->GetDerivationName(job.Target->GetName(), job.ResolvedSourcePath);
+    cmNixModuleScanner::Request request;
+    request.Source = job.Source->GetFullPath();
+    request.WorkingDirectory =
+      this->GetCMakeInstance()->GetHomeOutputDirectory();
+    request.DynDepFile = cmStrCat(scanDirectory, '/', name, ".ddi");
+    request.DepFile = cmStrCat(scanDirectory, '/', name, ".d");
+    
+    // Scans see the flags the dependency scanner uses, with absolute
+    // include directories
+    cmLocalGenerator* lg = job.Target->GetLocalGenerator();
+    std::string flags;
+    std::vector<std::string> arguments =
+      job.TargetGenerator->GetCompileFlags("CXX", config);
+    for (std::string const& flag :
+         job.TargetGenerator->GetIncludeFlags("CXX", config)) {
+      arguments.push_back(flag);
+    }
+    for (std::string const& argument : arguments) {
+      flags = cmStrCat(flags, flags.empty() ? "" : " ",
+                       lg->EscapeForShell(argument));
+    }
+    std::string const source =
+      lg->ConvertToOutputFormat(request.Source, cmOutputConverter::SHELL);
+    std::string const object = lg->ConvertToOutputFormat(
+      cmStrCat(scanDirectory, '/', name, ".o"), cmOutputConverter::SHELL);
+    std::string const preprocessed = lg->ConvertToOutputFormat(
+      cmStrCat(scanDirectory, '/', name, ".i"), cmOutputConverter::SHELL);
+    std::string const dynDepFile =
+      lg->ConvertToOutputFormat(request.DynDepFile, cmOutputConverter::SHELL);
+    std::string const depFile =
+      lg->ConvertToOutputFormat(request.DepFile, cmOutputConverter::SHELL);
+    cmRulePlaceholderExpander::RuleVariables vars;
+    vars.CMTargetName = job.Target->GetName().c_str();
+    vars.Language = "CXX";
+    vars.Config = config.c_str();
+    vars.Source = source.c_str();
+    vars.Object = object.c_str();
+    vars.PreprocessedSource = preprocessed.c_str();
+    vars.DynDepFile = dynDepFile.c_str();
+    vars.DependencyFile = depFile.c_str();
+    vars.DependencyTarget = dynDepFile.c_str();
+    vars.Defines = "";
+    vars.Includes = "";
+    vars.Flags = flags.c_str();
+    std::unique_ptr<cmRulePlaceholderExpander>& expander = expanders[lg];
+    if (!expander) {
+      expander = lg->CreateRulePlaceholderExpander();
+    }
+    request.Command = *rule;
+    expander->ExpandRuleVariables(lg, request.Command, vars);
+    
+    requests.push_back(std::move(request));
+    scannedJobs.push_back(&job);
+  }
+  if (requests.empty()) {
+    return;
+  }
+  
+  ProfileTimer timer(this, "ScanModuleDependencies");
+  timer.SetItemCount(requests.size());
+  cmNixModuleScanner scanner(this->GetScanJobs());
+  std::vector<cmNixModuleScanner::Result> results = scanner.Scan(requests);
+  for (size_t i = 0; i < results.size(); ++i) {
+    ObjectDerivationJob& job = *scannedJobs[i];
+    if (!results[i].Success) {
+      // Module sources cannot be built without their scan; other sources
+      // may only fail because their generated headers do not exist yet
+      cmFileSet const* fileSet = job.Target->GetFileSetForSource(
+        job.Target->GetLocalGenerator()->GetMakefile()->GetDefaultConfiguration(),
+        job.Source);
+      bool const moduleSource =
+        fileSet && fileSet->GetType() == "CXX_MODULES";
+      this->GetCMakeInstance()->IssueMessage(
+        moduleSource ? MessageType::FATAL_ERROR : MessageType::WARNING,
+        cmStrCat("C++ module scan failed for ", requests[i].Source, ": ",
+                 results[i].Error));
+      continue;
+    }
+    
+    std::vector<std::string> errors;
+    cmNixModuleScanner::ModuleUsage scan = cmNixModuleScanner::GetModuleUsage(
+      requests[i].Source, results[i].Info, errors);
+    for (std::string const& error : errors) {
+      this->GetCMakeInstance()->IssueMessage(MessageType::FATAL_ERROR, error);
+    }
+    if (scan.Provides.empty() && scan.Requires.empty()) {
+      continue;
+    }
+    
+    // Units compiled in a batch cannot take their BMIs as inputs
+    job.BatchKey.clear();
+    std::string name =
+      this->GetDerivationName(job.Target->GetName(), job.ResolvedSourcePath);
+    if (!scan.Provides.empty()) {
+      this->ModuleProviders[scan.Provides].emplace_back(
+        job.Target->GetName(), name);
+    }
+    this->ModuleScans[name] = std::move(scan);
+  }
+  
+  cmNixModuleScanner::Statistics const& stats = scanner.GetStatistics();
+  this->AddProfileCounter("NixModuleScan",
+                          { { "scanned", stats.Scanned },
+                            { "reused", stats.Reused },
+                            { "failed", stats.Failed } });
+  this->LogDebug(cmStrCat("Module scan: scanned ", stats.Scanned,
+                          " sources, reused ", stats.Reused, ", failed ",
+                          stats.Failed));
+}
+
+void cmGlobalNixGenerator::WriteModuleAttributes(
+  std::ostream& os, cmGeneratorTarget* target,
+  std::string const& derivationName)
+{
+  auto scan = this->ModuleScans.find(derivationName);
+  if (scan == this->ModuleScans.end()) {
+    return;
+  }
+  if (!scan->second.Provides.empty()) {
+    os << "    module = \""
+       << cmNixWriter::EscapeNixString(scan->second.Provides) << "\";\n";
+  }
+  
+  std::vector<std::string> errors;
+  std::map<std::string, std::string> const imports =
+    cmNixModuleScanner::ResolveImports(target->GetName(), derivationName,
+                                       this->ModuleScans,
+                                       this->ModuleProviders, errors);
+  for (std::string const& error : errors) {
+    this->GetCMakeInstance()->IssueMessage(MessageType::FATAL_ERROR, error);
+  }
+  if (!imports.empty()) {
+    os << "    imports = {\n";
+    for (auto const& module : imports) {
+      os << "      \"" << cmNixWriter::EscapeNixString(module.first)
+         << "\" = " << module.second << ".bmi;\n";
+    }
+    os << "    };\n";
+  }
+}
+
+std::string cmGlobalNixGenerator::GetObjectReference(
+  std::string const& derivationName) const
+{
+  // Aliased objects are never batched, their canonical ones neither
+  auto alias = this->ObjectAliases.find(derivationName);
+  if (alias != this->ObjectAliases.end()) {
+    return alias->second;
+  }
+  auto it = this->BatchedObjects.find(derivationName);
+  return it != this->BatchedObjects.end() ? it->second : derivationName;
+}
+
+void cmGlobalNixGenerator::DeduplicateObjectDerivations(
+  std::vector<ObjectDerivationJob>& jobs)
+{
+  // The rendered derivation covers everything the object depends on: the
+  // source, its include closure in src, the flags and the build inputs.
+  // Two jobs whose derivations differ only in the binding name compile
+  // the same object.
+  std::unordered_map<std::string, std::string> canonicalNames;
+  for (ObjectDerivationJob& job : jobs) {
+    // Batched units are compiled inside their batch derivation
+    if (!job.BatchKey.empty() || job.Output.empty()) {
+      continue;
+    }
+    std::string const name =
+      this->GetDerivationName(job.Target->GetName(), job.ResolvedSourcePath);
+    std::string const prefix = cmStrCat("  ", name, " = ");
+    if (!cmHasPrefix(job.Output, prefix)) {
+      continue;
+    }
+    auto inserted =
+      canonicalNames.emplace(job.Output.substr(prefix.size()), name);
+    if (inserted.second) {
+      continue;
+    }
+    // Keep the alias bound so that references by name still resolve
+    this->ObjectAliases[name] = inserted.first->second;
+    job.Output = cmStrCat(prefix, inserted.first->second, ";\n\n");
+    job.Manifest.Valid = false;
+  }
+}
+
+void cmGlobalNixGenerator::RenderObjectDerivationJob(ObjectDerivationJob& job)
+{
+  std::vector<std::string> dependencies =
+    job.TargetGenerator->GetSourceDependencies(job.Source);
+  this->AddObjectDerivation(
+    job.Target->GetName(),
+    this->GetDerivationName(job.Target->GetName(), job.ResolvedSourcePath),
+    job.ResolvedSourcePath, job.TargetGenerator->GetObjectFileName(job.Source),
+    job.Source->GetLanguage(), dependencies);
+  
+  std::ostringstream output;
+  this->WriteObjectDerivation(output, job.Target, job.Source,
+                              this->UseManifest() ? &job.Manifest : nullptr);
+  job.Output = output.str();
+}
+
+void cmGlobalNixGenerator::ScanSourceDependencies(
+  std::vector<ObjectDerivationJob> const& jobs)
+{
+  std::vector<cmNixDependencyScanner::Request> requests;
+  std::vector<std::string> keys;
+  std::set<std::string> seen;
+  for (ObjectDerivationJob const& job : jobs) {
+    std::string key =
+      cmStrCat(job.Target->GetName(), '|', job.Source->GetFullPath());
+    cmNixDependencyScanner::Request request;
+    if (!seen.insert(key).second ||
+        !job.TargetGenerator->GetDependencyScanCommand(job.Source,
+                                                       request.Command)) {
+      continue;
+    }
+    request.Source = job.Source->GetFullPath();
+    requests.push_back(std::move(request));
+    keys.push_back(std::move(key));
+  }
+  if (requests.empty()) {
+    return;
+  }
+  
+  // Reuse the results of the previous run for sources whose files did not
+  // change, and only hand the rest to the compiler
+  cmNixDependencyCache cache(cmStrCat(
+    this->GetCMakeInstance()->GetHomeOutputDirectory(),
+    "/CMakeFiles/NixDependencyCache.txt"));
+  cache.Load();
+  std::vector<cmNixDependencyScanner::Request> misses;
+  std::vector<std::string> missKeys;
+  std::vector<std::string> missFingerprints;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    std::string fingerprint =
+      cmNixDependencyCache::ComputeFingerprint(requests[i].Command);
+    std::vector<std::string> headers;
+    if (cache.Lookup(requests[i].Source, fingerprint, headers)) {
+      this->ScannedDependencies[keys[i]] = std::move(headers);
+    } else {
+      misses.push_back(std::move(requests[i]));
+      missKeys.push_back(keys[i]);
+      missFingerprints.push_back(std::move(fingerprint));
+    }
+  }
+  
+  unsigned int const scanJobs = this->GetScanJobs();
+  {
+    ProfileTimer timer(this, "ScanSourceDependencies (" +
+                       std::to_string(scanJobs) + " jobs)");
+    timer.SetItemCount(misses.size());
+    
+    cmNixDependencyScanner scanner(this->GetDependencyScanDirectory(),
+                                   scanJobs);
+    std::vector<cmNixDependencyScanner::Result> results = scanner.Scan(misses);
+    cmake* cm = this->GetCMakeInstance();
+    for (size_t i = 0; i < results.size(); ++i) {
+      if (cm->IsProfilingEnabled() &&
+          results[i].End > results[i].Start) {
+        Json::Value args(Json::objectValue);
+        args["source"] = misses[i].Source;
+        args["success"] = results[i].Success;
+        cm->GetProfilingOutput().AddCompleteEntry(
+          cmNix::Profiling::CATEGORY, "ScanWithCompiler", results[i].Start,
+          results[i].End, std::move(args),
+          cmNix::Profiling::SCAN_THREAD_ID_BASE +
+            static_cast<int>(results[i].Slot));
+      }
+      if (results[i].Success) {
+        cache.Store(misses[i].Source, missFingerprints[i],
+                    results[i].Headers);
+      } else {
+        this->ReportDependencyScanFailure(misses[i].Source, results[i].Error);
+      }
+      // Failed scans are recorded as empty so that the sources fall back to
+      // the regex scanner instead of being scanned again
+      this->ScannedDependencies[missKeys[i]] = std::move(results[i].Headers);
+    }
+    if (!misses.empty()) {
+      cmSystemTools::RemoveADirectory(this->GetDependencyScanDirectory());
+    }
+  }
+  
+  if (!cache.Save()) {
+    this->LogDebug("Could not write the dependency cache");
+  }
+  cmNixDependencyCache::Statistics const& stats = cache.GetStatistics();
+  this->AddProfileCounter("NixDependencyCache",
+                          { { "hits", stats.Hits },
+                            { "misses", stats.Misses },
+                            { "scanned", misses.size() } });
+  this->LogDebug(cmStrCat("Dependency cache: ", stats.Hits, " hits, ",
+                          stats.Misses, " misses; scanned ", misses.size(),
+                          " sources with ", scanJobs,
+                          " concurrent compiler jobs"));
+}
+
+bool cmGlobalNixGenerator::GetScannedDependencies(
+  std::string const& targetName, std::string const& sourcePath,
+  std::vector<std::string>& headers) const
+{
+  auto it = this->ScannedDependencies.find(
+    cmStrCat(targetName, '|', sourcePath));
+  if (it == this->ScannedDependencies.end()) {
+    return false;
+  }
+  headers = it->second;
+  return true;
+}
+
+cmNixIncludeScanner* cmGlobalNixGenerator::GetIncludeScanner() const
+{
+  return this->IncludeScanner.get();
+}
+
+bool cmGlobalNixGenerator::UseIncludeScanner() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_DEPENDENCY_SCANNER");
+  return value && cmSystemTools::LowerCase(*value) == "include";
+}
+
+std::vector<std::string> cmGlobalNixGenerator::GetSourceIncludeDirectories(
+  cmGeneratorTarget* target, cmSourceFile const* source,
+  std::string const& lang, std::string const& config)
+{
+  std::vector<std::string> dirs;
+  cmValue const sourceIncludes = source->GetProperty("INCLUDE_DIRECTORIES");
+  if (sourceIncludes) {
+    cmLocalGenerator* lg = target->GetLocalGenerator();
+    cmGeneratorExpressionInterpreter genexInterpreter(lg, config, target,
+                                                      lang);
+    lg->AppendIncludeDirectories(
+      dirs, genexInterpreter.Evaluate(*sourceIncludes, "INCLUDE_DIRECTORIES"),
+      *source);
+  }
+  return dirs;
+}
+
+std::string cmGlobalNixGenerator::GetDependencyScanDirectory() const
+{
+  return cmStrCat(this->GetCMakeInstance()->GetHomeOutputDirectory(),
+                  "/CMakeFiles/NixDepScan");
+}
+
+void cmGlobalNixGenerator::ReportDependencyScanFailure(
+  std::string const& sourcePath, std::string const& error) const
+{
+  std::string msg =
+    cmStrCat("Compiler dependency scan failed for ", sourcePath);
+  if (!error.empty()) {
+    msg = cmStrCat(msg, ": ", error);
+  }
+  this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, msg);
+}
+
+unsigned int cmGlobalNixGenerator::GetJobsSetting(
+  std::string const& name, unsigned int defaultJobs) const
+{
+  // The cache entry takes precedence over the environment variable
+  std::string jobsValue;
+  cmValue cacheValue =
+    this->GetCMakeInstance()->GetState()->GetCacheEntryValue(name);
+  if (cacheValue) {
+    jobsValue = *cacheValue;
+  } else if (const char* jobsEnv = cmSystemTools::GetEnv(name)) {
+    jobsValue = jobsEnv;
+  }
+  
+  unsigned long jobs = defaultJobs;
+  if (!jobsValue.empty() && !cmStrToULong(jobsValue, &jobs)) {
+    this->GetCMakeInstance()->IssueMessage(
+      MessageType::WARNING,
+      cmStrCat("Ignoring invalid ", name, " value '", jobsValue,
+               "'. Expected a non-negative integer."));
+    jobs = defaultJobs;
+  }
+  if (jobs == 0) {
+    // 0 selects one job per hardware thread
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return static_cast<unsigned int>(
+    std::min<unsigned long>(jobs, cmNix::Limits::MAX_SCAN_JOBS));
+}
+
+unsigned int cmGlobalNixGenerator::GetScanJobs() const
+{
+  return this->GetJobsSetting("CMAKE_NIX_SCAN_JOBS", 0);
+}
+
+void cmGlobalNixGenerator::WriteLinkingDerivations(
+  cmGeneratedFileStream& nixFileStream)
+{
+  nixFileStream << "\n  # Linking derivations\n";
+  
+  for (auto const& lg : this->LocalGenerators) {
+    auto const& targets = lg->GetGeneratorTargets();
+    for (auto const& target : targets) {
+      if (target->GetType() == cmStateEnums::EXECUTABLE ||
+          target->GetType() == cmStateEnums::STATIC_LIBRARY ||
+          target->GetType() == cmStateEnums::SHARED_LIBRARY ||
+          target->GetType() == cmStateEnums::MODULE_LIBRARY) {
+        if (this->WritingFragments) {
+          std::ostringstream linkDerivation;
+          this->WriteLinkDerivation(linkDerivation, target.get());
+          this->TargetFragments[target->GetName()].Bindings +=
+            linkDerivation.str();
+        } else {
+          this->WriteLinkDerivation(nixFileStream, target.get());
+        }
+      }
+    }
+  }
+}
+
+std::string cmGlobalNixGenerator::GetDerivationName(
+  std::string const& targetName, std::string const& sourceFile) const
+{
+  // Use cache manager to get or compute the derivation name
+  return this->CacheManager->GetDerivationName(targetName, sourceFile,
+    [this, &targetName, &sourceFile]() {
+      std::string result;
+  if (sourceFile.empty()) {
+    result = "link_" + targetName;
+  } else {
+    // Use filename with parent directory to make it unique
+    std::string filename = cmSystemTools::GetFilenameName(sourceFile);
+    std::string parentDir = cmSystemTools::GetFilenameName(
+      cmSystemTools::GetFilenamePath(sourceFile));
+    
+    // Create unique identifier including parent directory
+    std::string uniqueName;
+    if (!parentDir.empty() && parentDir != ".") {
+      uniqueName = parentDir + "_" + filename;
+    } else {
+      uniqueName = filename;
+    }
+    
+    // Convert to valid Nix identifier
+    std::replace(uniqueName.begin(), uniqueName.end(), '.', '_');
+    std::replace(uniqueName.begin(), uniqueName.end(), '-', '_');
+    result = targetName + "_" + uniqueName + "_o";
+  }
+  
+  // Use the proper function to make a valid Nix identifier
+  result = cmNixWriter::MakeValidNixIdentifier(result);
+  
+  // Ensure uniqueness by checking UsedDerivationNames
+  std::string finalResult = result;
+  int suffix = 2;
+  while (this->CacheManager->IsDerivationNameUsed(finalResult)) {
+    finalResult = result + "_" + std::to_string(suffix);
+    suffix++;
+  }
+  this->CacheManager->MarkDerivationNameUsed(finalResult);
+  
+      return finalResult;
+    });
+}
+
+void cmGlobalNixGenerator::AddObjectDerivation(std::string const& targetName, std::string const& derivationName, std::string const& sourceFile, std::string const& objectFileName, std::string const& language, std::vector<std::string> const& dependencies)
+{
+  ObjectDerivation od;
+  od.TargetName = targetName;
+  od.DerivationName = derivationName;
+  od.SourceFile = sourceFile;
+  od.ObjectFileName = objectFileName;
+  od.Language = language;
+  od.Dependencies = dependencies;
+  this->ObjectDerivations[derivationName] = od;
+  
+  // Also track object file path to derivation mapping
+  // The object file path might be relative, so we need to handle it properly
+  std::string objPath = objectFileName;
+  if (!cmSystemTools::FileIsFullPath(objPath)) {
+    // Make it relative to the top build directory for consistency
+    const std::string& homeOutputDir = this->GetCMakeInstance()->GetHomeOutputDirectory();
+    objPath = homeOutputDir + "/" + objPath;
+  }
+  this->ObjectFileOutputs[objPath] = derivationName;
+}
+
+void cmGlobalNixGenerator::WriteObjectDerivation(
+  std::ostream& nixFileStream, cmGeneratorTarget* target,
+  const cmSourceFile* source, ManifestObject* manifest)
+{
+  // Report on stderr only if CMAKE_NIX_PROFILE_DETAILED=1 to avoid too much
+  // output; the trace always gets a span per source
+  const char* detailedProfile = std::getenv("CMAKE_NIX_PROFILE_DETAILED");
+  bool const detailed = detailedProfile && std::string(detailedProfile) == "1";
+  std::unique_ptr<ProfileTimer> timer;
+  if (detailed || this->GetCMakeInstance()->IsProfilingEnabled()) {
+    timer = std::make_unique<ProfileTimer>(this, "WriteObjectDerivation",
+                                          detailed);
+    timer->SetArg("target", target->GetName());
+    timer->SetArg("source", source->GetFullPath());
+  }
+  
+  // Step 1: Prepare compilation context
+  SourceCompilationContext ctx = PrepareSourceCompilationContext(target, source);
+  
+  this->LogDebug("WriteObjectDerivation for source: " + ctx.sourceFile + 
+                " (generated: " + std::to_string(source->GetIsGenerated()) + ")");
+  
+  // Step 2: Validate source file
+  std::string errorMessage;
+  if (!this->ValidateSourceFile(source, target, errorMessage)) {
+    this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, errorMessage);
+    return;
+  }
+  
+  // Emit warning if validation passed but there was a warning message
+  if (!errorMessage.empty()) {
+    // Only show external source warnings in debug mode or for non-CMake files
+    if (this->GetCMakeInstance()->GetDebugOutput() ||
+        (errorMessage.find("CMakeC") == std::string::npos &&
+         errorMessage.find("CMakeCXX") == std::string::npos)) {
+      this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, errorMessage);
+    }
+  }
+  
+  // Step 3: Get compile flags
+  bool sourceSpecificFlags = true;
+  std::string allCompileFlags = this->GetCompileFlags(target, source, ctx.lang, ctx.config, ctx.objectName, &sourceSpecificFlags);
+  if (this->UseDepfiles() && (ctx.lang == "C" || ctx.lang == "CXX")) {
+    ctx.depfileKey = this->GetDepfileKey(ctx.sourceFile, ctx.lang, allCompileFlags);
+    this->DepfileKeys[ctx.derivName] = ctx.depfileKey;
+  }
   
   // Step 4: Process config-time generated files
   ProcessConfigTimeGeneratedFiles(allCompileFlags, ctx.buildDir, ctx.configTimeGeneratedFiles);
@@ -769,7 +2102,7 @@ void cmGlobalNixGenerator::WriteObjectDerivation(
   nixFileStream << "    name = \"" << ctx.objectName << "\";\n";
   
   // Step 9: Write the src attribute
-  WriteSourceAttribute(nixFileStream, ctx, target, source);
+  WriteSourceAttribute(nixFileStream, ctx, target, source, manifest);
   
   // Step 10: Build buildInputs list and write it
   std::string compilerPackage = this->GetCompilerPackage(ctx.lang);
@@ -815,19 +2148,90 @@ void cmGlobalNixGenerator::WriteObjectDerivation(
   
   WriteCompilerAttribute(nixFileStream, buildInputs, compilerPackage);
   
-  if (!allFlags.empty()) {
+  if (!allFlags.empty() && !sourceSpecificFlags) {
+    // The flags a target shares are bound once and referenced by name, and
+    // targets with equal flags share the binding
+    std::string const expression =
+      cmStrCat('"', cmNixWriter::EscapeNixString(allFlags), '"');
+    std::string const name = cmStrCat(
+      "compile_flags_",
+      cmCryptoHash(cmCryptoHash::AlgoSHA256).HashString(expression).substr(0, 16));
+    SharedSource& shared = this->SharedSources[name];
+    if (shared.Expression.empty()) {
+      shared.Expression = expression;
+    }
+    shared.Targets.insert(target->GetName());
+    nixFileStream << "    flags = " << name << ";\n";
+  } else if (!allFlags.empty()) {
     nixFileStream << "    flags = \"" << cmNixWriter::EscapeNixString(allFlags) << "\";\n";
   }
+
+  // Every source of the target compiles against its precompiled headers,
+  // except the ones that create them or skip them
+  TargetCompileFlags const& targetFlags =
+    this->GetTargetCompileFlags(target, ctx.lang, ctx.config);
+  bool const usesPch = !targetFlags.PchFiles.empty() &&
+    !targetFlags.PchSources.count(source->GetFullPath()) &&
+    !source->GetPropertyAsBool("SKIP_PRECOMPILE_HEADERS");
+  if (usesPch) {
+    nixFileStream << "    pch = {\n";
+    for (auto const& pch : targetFlags.PchFiles) {
+      nixFileStream << "      \"" << cmNixWriter::EscapeNixString(pch.first)
+                    << "\" = " << pch.second << ";\n";
+    }
+    nixFileStream << "    };\n";
+  }
+
+  this->WriteModuleAttributes(nixFileStream, target, ctx.derivName);
+
+  if (this->UseLocalObjectBuilds(target)) {
+    nixFileStream << "    localBuild = true;\n";
+  }
+  if (!ctx.depfileKey.empty()) {
+    nixFileStream << "    depfile = true;\n";
+  }
   
   // Close the derivation
   nixFileStream << "  };\n\n";
+  
+  // The manifest library resolves packages in nixpkgs only, so sources
+  // from custom commands and inputs bound in default.nix stay out of it
+  if (manifest && manifest->Valid) {
+    std::string const headerDerivation =
+      this->HeaderDependencyResolver->GetSourceHeaderDerivation(ctx.sourceFile);
+    for (std::string const& input : buildInputs) {
+      if (!IsAttributePath(input) || input == headerDerivation ||
+          std::any_of(this->CustomCommandOutputs.begin(),
+                      this->CustomCommandOutputs.end(),
+                      [&input](std::pair<std::string const, std::string> const& output) {
+                        return output.second == input;
+                      })) {
+        manifest->Valid = false;
+      }
+    }
+    std::string const compiler =
+      !buildInputs.empty() ? buildInputs[0] : compilerPackage;
+    if (sourcePath.find("${") != std::string::npos || !IsAttributePath(compiler) ||
+        usesPch || this->ModuleScans.count(ctx.derivName)) {
+      manifest->Valid = false;
+    }
+    manifest->Name = ctx.objectName;
+    manifest->Source = sourcePath;
+    manifest->CompilerPackage = compiler;
+    manifest->CompilerBinary = ManifestCompilerBinary(compiler, sourcePath);
+    manifest->Flags = allFlags;
+    manifest->BuildInputs = buildInputs;
+    manifest->LocalBuild = this->UseLocalObjectBuilds(target);
+    manifest->Depfile = !ctx.depfileKey.empty();
+  }
 }
 
 void cmGlobalNixGenerator::WriteSourceAttribute(
-  cmGeneratedFileStream& nixFileStream,
+  std::ostream& nixFileStream,
   const SourceCompilationContext& ctx,
   cmGeneratorTarget* target,
-  const cmSourceFile* source)
+  const cmSourceFile* source,
+  ManifestObject* manifest)
 {
   if (ctx.isExternalSource) {
     WriteExternalSourceComposite(nixFileStream, ctx, target, source);
@@ -836,6 +2240,24 @@ void cmGlobalNixGenerator::WriteSourceAttribute(
     auto targetGen = cmNixTargetGenerator::New(target);
     std::vector<std::string> dependencies = targetGen->GetSourceDependencies(source);
     
+    // Without explicit sources, the headers the compiler read in the last
+    // build narrow the fileset; sources not built since fall back to the
+    // conservative one below
+    bool learned = false;
+    if (!this->UseExplicitSources() && !ctx.depfileKey.empty()) {
+      auto it = this->LearnedDependencies.find(ctx.depfileKey);
+      if (it != this->LearnedDependencies.end()) {
+        std::string const relativeSource = cmSystemTools::RelativePath(
+          this->GetCMakeInstance()->GetHomeDirectory(), ctx.sourceFile);
+        for (std::string const& header : it->second) {
+          if (header != relativeSource) {
+            dependencies.push_back(header);
+          }
+        }
+        learned = true;
+      }
+    }
+    
     if (this->GetCMakeInstance()->GetDebugOutput()) {
       this->LogDebug("Source dependencies for " + ctx.sourceFile + ": " + std::to_string(dependencies.size()));
       for (const auto& dep : dependencies) {
@@ -867,6 +2289,12 @@ void cmGlobalNixGenerator::WriteSourceAttribute(
     bool hasExternalIncludes = false;
     cmLocalGenerator* lg = target->GetLocalGenerator();
     std::vector<BT<std::string>> includes = lg->GetIncludeDirectories(target, ctx.lang, ctx.config);
+    // The source's own include directories are searched by its compiler
+    // too, so their headers belong in the fileset as well
+    for (std::string const& dir : GetSourceIncludeDirectories(
+           target, source, ctx.lang, ctx.config)) {
+      includes.emplace_back(dir);
+    }
     for (const auto& inc : includes) {
       if (!inc.Value.empty()) {
         std::string incPath = inc.Value;
@@ -886,7 +2314,20 @@ void cmGlobalNixGenerator::WriteSourceAttribute(
     } else if (existingFiles.empty() && generatedFiles.empty()) {
       // No files detected, use whole directory
       nixFileStream << "    src = " << ctx.projectSourceRelPath << ";\n";
+      if (manifest) {
+        manifest->Valid = true;
+        manifest->Root = ctx.projectSourceRelPath;
+      }
     } else {
+      // A learned fileset only holds until the source or one of its headers
+      // changes, so the conservative one is written as well
+      std::vector<std::string> learnedFiles;
+      std::vector<std::string> learnedGeneratedFiles;
+      if (learned) {
+        learnedFiles = existingFiles;
+        learnedGeneratedFiles = generatedFiles;
+      }
+      
       // Always use fileset union for minimal source sets to avoid unnecessary rebuilds
       if (!this->UseExplicitSources() && existingFiles.size() + generatedFiles.size() > 0) {
         // When not using explicit sources, only include the source file itself
@@ -973,18 +2414,44 @@ void cmGlobalNixGenerator::WriteSourceAttribute(
       }
       
       // Always use fileset union for better caching
-      if (existingFiles.size() + generatedFiles.size() > 0) {
+      if (learned && existingFiles.size() + generatedFiles.size() > 0) {
+        // Nix compares the files of the learned fileset with their content
+        // at generate time, so that an edit, such as a new #include, falls
+        // back to the conservative fileset without regenerating
+        nixFileStream << "    src = cmakeNixLearnedSrc \""
+                      << this->GetLearnedFilesHash(learnedFiles) << "\" [";
+        for (std::string const& file : learnedFiles) {
+          nixFileStream << ' '
+                        << GetFilesetPath(ctx.projectSourceRelPath, file);
+        }
+        nixFileStream << " ]\n      ("
+                      << GetFilesetExpression(learnedFiles,
+                                              learnedGeneratedFiles,
+                                              ctx.projectSourceRelPath,
+                                              "        ")
+                      << ")\n      ("
+                      << GetFilesetExpression(existingFiles, generatedFiles,
+                                              ctx.projectSourceRelPath,
+                                              "        ")
+                      << ");\n";
+      } else if (existingFiles.size() + generatedFiles.size() > 0) {
         this->WriteFilesetUnion(nixFileStream, existingFiles, generatedFiles, ctx.projectSourceRelPath);
       } else {
         // Fallback to whole directory if no files were collected
         nixFileStream << "    src = " << ctx.projectSourceRelPath << ";\n";
       }
+      if (manifest) {
+        manifest->Valid = true;
+        manifest->Root = ctx.projectSourceRelPath;
+        manifest->Files = existingFiles;
+        manifest->GeneratedFiles = generatedFiles;
+      }
     }
   }
 }
 
 void cmGlobalNixGenerator::WriteCompilerAttribute(
-  cmGeneratedFileStream& nixFileStream,
+  std::ostream& nixFileStream,
   const std::vector<std::string>& buildInputs,
   const std::string& compilerPackage)
 {
@@ -993,7 +2460,7 @@ void cmGlobalNixGenerator::WriteCompilerAttribute(
 }
 
 void cmGlobalNixGenerator::WriteExternalSourceComposite(
-  cmGeneratedFileStream& nixFileStream,
+  std::ostream& nixFileStream,
   const SourceCompilationContext& ctx,
   cmGeneratorTarget* target,
   const cmSourceFile* source)
@@ -1033,41 +2500,15 @@ void cmGlobalNixGenerator::WriteExternalSourceComposite(
       std::string relPath = cmSystemTools::RelativePath(ctx.buildDir, genFile);
       std::string destDir = cmSystemTools::GetFilenamePath(relPath);
       
-      // Read the file content and embed it directly
-      cmsys::ifstream inFile(genFile.c_str(), std::ios::in | std::ios::binary);
-      if (inFile) {
-        std::ostringstream contents;
-        contents << inFile.rdbuf();
-        
-        // Create parent directory if needed
-        if (!destDir.empty()) {
-          nixFileStream << "      mkdir -p $out/" << destDir << "\n";
-        }
-        
-        // Write the file content directly using a here-doc with a unique delimiter
-        std::string delimiter = "NIXEOF_" + std::to_string(std::hash<std::string>{}(genFile)) + "_END";
-        nixFileStream << "      cat > $out/" << relPath << " <<'" << delimiter << "'\n";
-        
-        // Escape '' sequences in content since we're inside a Nix multiline string
-        std::string contentStr = contents.str();
-        for (size_t i = 0; i < contentStr.length(); ++i) {
-          if (i + 1 < contentStr.length() && contentStr[i] == '\'' && contentStr[i + 1] == '\'') {
-            nixFileStream << "''\\''";
-            i++; // Skip the next quote
-          } else {
-            nixFileStream << contentStr[i];
-          }
-        }
-        
-        // Ensure we end with a newline before the delimiter
-        if (!contentStr.empty() && contentStr.back() != '\n') {
-          nixFileStream << "\n";
-        }
-        nixFileStream << delimiter << "\n";
-      } else {
-        // If we can't read the file, issue a warning but continue
+      std::string const fileSource = this->GetGeneratedFileSource(genFile, target);
+      if (fileSource.empty()) {
         nixFileStream << "      # Warning: Could not read " << genFile << "\n";
+        continue;
+      }
+      if (!destDir.empty()) {
+        nixFileStream << "      mkdir -p $out/" << destDir << "\n";
       }
+      nixFileStream << "      cp --no-preserve=mode ${" << fileSource << "} $out/" << relPath << "\n";
     }
   }
   
@@ -1248,28 +2689,95 @@ bool cmGlobalNixGenerator::ValidateSourceFile(const cmSourceFile* source,
 std::string cmGlobalNixGenerator::DetermineCompilerPackage(cmGeneratorTarget* target,
                                                            const cmSourceFile* source) const
 {
-  return this->CompilerResolver->DetermineCompilerPackage(target, source);
+  return this->CompilerResolver->DetermineCompilerPackage(target, source);
+}
+
+std::string cmGlobalNixGenerator::GetIncludeFlag(std::string const& dir) const
+{
+  // Skip system include directories that would be provided by Nix
+  if (dir.empty() || this->IsSystemPath(dir)) {
+    return std::string();
+  }
+  
+  const std::string& sourceDir = this->GetCMakeInstance()->GetHomeDirectory();
+  const std::string& buildDir = this->GetCMakeInstance()->GetHomeOutputDirectory();
+  std::string incPath = dir;
+  
+  // Make include path relative if possible
+  std::string relativeInclude;
+  if (cmSystemTools::FileIsFullPath(incPath)) {
+    // Normalize the path first to resolve any .. segments
+    incPath = cmSystemTools::CollapseFullPath(incPath);
+    
+    // Check if the path is in the build directory
+    if (cmSystemTools::IsSubDirectory(incPath, buildDir)) {
+      // For paths in the build directory, make them relative to the build directory
+      relativeInclude = cmSystemTools::RelativePath(buildDir, incPath);
+    } else {
+      // For paths in the source directory, make them relative to the source directory
+      relativeInclude = cmSystemTools::RelativePath(sourceDir, incPath);
+      // If the relative path goes outside the source tree, keep absolute
+      if (cmNixPathUtils::IsPathOutsideTree(relativeInclude)) {
+        relativeInclude = "";
+      }
+    }
+  } else {
+    relativeInclude = incPath;
+  }
+  
+  std::string finalIncPath = !relativeInclude.empty() ? relativeInclude : incPath;
+  // Quote the path if it contains spaces
+  if (finalIncPath.find(' ') != std::string::npos) {
+    return "-I\"" + finalIncPath + "\"";
+  }
+  return "-I" + finalIncPath;
+}
+
+std::string cmGlobalNixGenerator::GetPchCompileOptions(std::string options) const
+{
+  // The PCH header and file live in the build tree.  Config-time generated
+  // files are unpacked at their build-relative paths, so paths in the build
+  // tree are made relative to it first, even when it is nested in the
+  // source tree, and the remaining ones relative to the source tree
+  std::string const& sourceDir = this->GetCMakeInstance()->GetHomeDirectory();
+  std::string const& buildDir =
+    this->GetCMakeInstance()->GetHomeOutputDirectory();
+  std::string result;
+  for (std::string const& option : cmList{ options }) {
+    std::string arg = option;
+    if (cmSystemTools::FileIsFullPath(arg)) {
+      if (cmSystemTools::IsSubDirectory(arg, buildDir)) {
+        arg = cmSystemTools::RelativePath(buildDir, arg);
+      } else if (cmSystemTools::IsSubDirectory(arg, sourceDir)) {
+        arg = cmSystemTools::RelativePath(sourceDir, arg);
+      }
+    }
+    AppendFlag(result, arg);
+  }
+  return result;
 }
 
-std::string cmGlobalNixGenerator::GetCompileFlags(cmGeneratorTarget* target,
-                                                   const cmSourceFile* source,
-                                                   const std::string& lang,
-                                                   const std::string& config,
-                                                   const std::string& objectName)
+cmGlobalNixGenerator::TargetCompileFlags const&
+cmGlobalNixGenerator::GetTargetCompileFlags(cmGeneratorTarget* target,
+                                            std::string const& lang,
+                                            std::string const& config)
 {
-  cmLocalGenerator* lg = target->GetLocalGenerator();
+  auto key = std::make_tuple(static_cast<cmGeneratorTarget const*>(target),
+                             lang, config);
+  auto cached = this->TargetCompileFlagsCache.find(key);
+  if (cached != this->TargetCompileFlagsCache.end()) {
+    return cached->second;
+  }
+  TargetCompileFlags& flags = this->TargetCompileFlagsCache[key];
   
-  // Get source and build directories upfront (needed for path processing)
+  cmLocalGenerator* lg = target->GetLocalGenerator();
   const std::string& sourceDir = this->GetCMakeInstance()->GetHomeDirectory();
   const std::string& buildDir = this->GetCMakeInstance()->GetHomeOutputDirectory();
   
   // Get configuration-specific compile flags
   std::vector<BT<std::string>> compileFlagsVec = lg->GetTargetCompileFlags(target, config, lang, "");
-  std::ostringstream compileFlagsStream;
-  bool firstFlag = true;
-  
-  this->LogDebug("GetCompileFlags called for " + objectName);
-  this->LogDebug("Number of compile flags: " + std::to_string(compileFlagsVec.size()));
+  this->LogDebug("Number of compile flags for " + target->GetName() + " (" +
+                 lang + "): " + std::to_string(compileFlagsVec.size()));
   
   for (const auto& flag : compileFlagsVec) {
     if (!flag.Value.empty()) {
@@ -1293,26 +2801,15 @@ std::string cmGlobalNixGenerator::GetCompileFlags(cmGeneratorTarget* target,
         
         // Check if this is a flag that takes a file argument
         if ((pFlag == "-imacros" || pFlag == "-include") && i + 1 < parsedFlags.size()) {
-          // Handle the flag and its file argument
-          if (!firstFlag) {
-            compileFlagsStream << " ";
-          }
-          compileFlagsStream << pFlag;
-          firstFlag = false;
-          
           // Process the file path argument
           std::string filePath = parsedFlags[++i];
           
           this->LogDebug("Processing " + pFlag + " flag with file: " + filePath);
-          this->LogDebug("buildDir: " + buildDir);
-          this->LogDebug("sourceDir: " + sourceDir);
           
           // Check if it's an absolute path that needs to be made relative
           if (cmSystemTools::FileIsFullPath(filePath)) {
             // Check if it's in the build directory (configuration-time generated)
             std::string relToBuild = cmSystemTools::RelativePath(buildDir, filePath);
-            this->LogDebug("relToBuild: " + relToBuild);
-            this->LogDebug("IsPathOutsideTree: " + std::to_string(cmNixPathUtils::IsPathOutsideTree(relToBuild)));
             if (!cmNixPathUtils::IsPathOutsideTree(relToBuild)) {
               // This is a build directory file - for configuration-time generated files
               // that will be embedded, just use the relative path from build dir
@@ -1330,76 +2827,21 @@ std::string cmGlobalNixGenerator::GetCompileFlags(cmGeneratorTarget* target,
             }
           }
           
-          compileFlagsStream << " " << filePath;
+          AppendFlag(flags.Options, pFlag + " " + filePath);
         } else {
           // Regular flag - just add it
-          if (!firstFlag) {
-            compileFlagsStream << " ";
-          }
-          compileFlagsStream << pFlag;
-          firstFlag = false;
+          AppendFlag(flags.Options, pFlag);
         }
       }
     }
   }
   
-  // Get preprocessor definitions
-  std::set<BT<std::string>> definesSet = lg->GetTargetDefines(target, config, lang);
-  for (const auto& define : definesSet) {
-    if (!define.Value.empty()) {
-      if (!firstFlag) {
-        compileFlagsStream << " ";
-      }
-      compileFlagsStream << "-D" << define.Value;
-      firstFlag = false;
-    }
-  }
-  
-  // Get include directories
-  std::vector<BT<std::string>> includes = lg->GetIncludeDirectories(target, lang, config);
+  flags.Defines = lg->GetTargetDefines(target, config, lang);
   
-  for (const auto& inc : includes) {
-    if (!inc.Value.empty()) {
-      std::string incPath = inc.Value;
-      
-      // Skip system include directories that would be provided by Nix
-      if (this->IsSystemPath(incPath)) {
-        continue;
-      }
-      
-      // Make include path relative if possible
-      std::string relativeInclude;
-      if (cmSystemTools::FileIsFullPath(incPath)) {
-        // Normalize the path first to resolve any .. segments
-        incPath = cmSystemTools::CollapseFullPath(incPath);
-        
-        // Check if the path is in the build directory
-        if (cmSystemTools::IsSubDirectory(incPath, buildDir)) {
-          // For paths in the build directory, make them relative to the build directory
-          relativeInclude = cmSystemTools::RelativePath(buildDir, incPath);
-        } else {
-          // For paths in the source directory, make them relative to the source directory
-          relativeInclude = cmSystemTools::RelativePath(sourceDir, incPath);
-          // If the relative path goes outside the source tree, keep absolute
-          if (cmNixPathUtils::IsPathOutsideTree(relativeInclude)) {
-            relativeInclude = "";
-          }
-        }
-      } else {
-        relativeInclude = incPath;
-      }
-      
-      if (!firstFlag) {
-        compileFlagsStream << " ";
-      }
-      std::string finalIncPath = !relativeInclude.empty() ? relativeInclude : incPath;
-      // Quote the path if it contains spaces
-      if (finalIncPath.find(' ') != std::string::npos) {
-        compileFlagsStream << "-I\"" << finalIncPath << "\"";
-      } else {
-        compileFlagsStream << "-I" << finalIncPath;
-      }
-      firstFlag = false;
+  for (const auto& inc : lg->GetIncludeDirectories(target, lang, config)) {
+    std::string includeFlag = this->GetIncludeFlag(inc.Value);
+    if (!includeFlag.empty()) {
+      flags.Includes.push_back(std::move(includeFlag));
     }
   }
   
@@ -1407,98 +2849,160 @@ std::string cmGlobalNixGenerator::GetCompileFlags(cmGeneratorTarget* target,
   if (lang == "CXX") {
     std::string cxxStandard = target->GetFeature("CXX_STANDARD", config);
     if (!cxxStandard.empty()) {
-      if (!firstFlag) {
-        compileFlagsStream << " ";
-      }
-      compileFlagsStream << "-std=c++" << cxxStandard;
-      firstFlag = false;
+      flags.Standard = "-std=c++" + cxxStandard;
     }
   } else if (lang == "C") {
     std::string cStandard = target->GetFeature("C_STANDARD", config);
     if (!cStandard.empty()) {
-      if (!firstFlag) {
-        compileFlagsStream << " ";
-      }
-      compileFlagsStream << "-std=c" << cStandard;
-      firstFlag = false;
+      flags.Standard = "-std=c" + cStandard;
     }
   }
   
-  // Add PCH compile options if applicable
-  std::vector<std::string> pchArchs = target->GetPchArchs(config, lang);
-  std::unordered_set<std::string> pchSources;
-  for (const std::string& arch : pchArchs) {
+  // Sources that create a precompiled header get their own options; the
+  // others find the header where the use options name it.  The PCH file is
+  // keyed by the same build-relative path, so that it is copied beside the
+  // header in the root of the unpacked sources
+  std::string pchOptions;
+  for (const std::string& arch : target->GetPchArchs(config, lang)) {
     std::string pchSource = target->GetPchSource(config, lang, arch);
-    if (!pchSource.empty()) {
-      pchSources.insert(pchSource);
+    if (pchSource.empty()) {
+      continue;
+    }
+    flags.PchSources.insert(pchSource);
+    if (pchOptions.empty()) {
+      pchOptions = target->GetPchUseCompileOptions(config, lang);
     }
+    auto derivation = this->PchDerivations.find(pchSource);
+    if (derivation != this->PchDerivations.end()) {
+      std::string const pchFile = target->GetPchFile(config, lang, arch);
+      flags.PchFiles[cmSystemTools::RelativePath(buildDir, pchFile)] =
+        derivation->second;
+    }
+  }
+  if (!pchOptions.empty()) {
+    flags.PchUseOptions = this->GetPchCompileOptions(pchOptions);
   }
   
-  // Check if source file has SKIP_PRECOMPILE_HEADERS property
-  std::string sourceFile = source->GetFullPath();
-  cmSourceFile* sf = target->Target->GetMakefile()->GetOrCreateSource(sourceFile);
-  bool skipPch = sf && sf->GetPropertyAsBool("SKIP_PRECOMPILE_HEADERS");
+  AppendFlag(flags.Shared, flags.Options);
+  for (const auto& define : flags.Defines) {
+    if (!define.Value.empty()) {
+      AppendFlag(flags.Shared, "-D" + define.Value);
+    }
+  }
+  for (const std::string& includeFlag : flags.Includes) {
+    AppendFlag(flags.Shared, includeFlag);
+  }
+  AppendFlag(flags.Shared, flags.Standard);
+  AppendFlag(flags.Shared, flags.PchUseOptions);
+  return flags;
+}
+
+std::string cmGlobalNixGenerator::GetCompileFlags(cmGeneratorTarget* target,
+                                                   const cmSourceFile* source,
+                                                   const std::string& lang,
+                                                   const std::string& config,
+                                                   const std::string& objectName,
+                                                   bool* sourceSpecific)
+{
+  this->LogDebug("GetCompileFlags called for " + objectName);
   
-  if (!pchSources.empty() && !skipPch) {
-    std::string pchOptions;
-    if (pchSources.find(sourceFile) != pchSources.end()) {
-      // This is a PCH source file - add create options
-      for (const std::string& arch : pchArchs) {
-        if (target->GetPchSource(config, lang, arch) == sourceFile) {
-          pchOptions = target->GetPchCreateCompileOptions(config, lang, arch);
-          break;
-        }
-      }
-    } else {
-      // This is a regular source file - add use options
-      pchOptions = target->GetPchUseCompileOptions(config, lang);
+  TargetCompileFlags const& targetFlags =
+    this->GetTargetCompileFlags(target, lang, config);
+  
+  std::string const sourceFile = source->GetFullPath();
+  bool const pchSource = targetFlags.PchSources.count(sourceFile) != 0;
+  bool const skipPch = !targetFlags.PchSources.empty() &&
+    source->GetPropertyAsBool("SKIP_PRECOMPILE_HEADERS");
+  bool const asmSource = lang == "ASM" || lang == "ASM-ATT" ||
+    lang == "ASM_NASM" || lang == "ASM_MASM";
+  cmValue const cflags = source->GetProperty("COMPILE_FLAGS");
+  cmValue const coptions = source->GetProperty("COMPILE_OPTIONS");
+  cmValue const defs = source->GetProperty("COMPILE_DEFINITIONS");
+  cmValue const configDefs = source->GetProperty(
+    cmStrCat("COMPILE_DEFINITIONS_", cmSystemTools::UpperCase(config)));
+  cmValue const sourceIncludes = source->GetProperty("INCLUDE_DIRECTORIES");
+  
+  // Most sources have no flags of their own and share the target's set
+  if (!pchSource && !skipPch && !asmSource && !cflags && !coptions &&
+      !defs && !configDefs && !sourceIncludes) {
+    if (sourceSpecific) {
+      *sourceSpecific = false;
     }
-    
-    if (!pchOptions.empty()) {
-      // PCH options may be semicolon-separated, convert to space-separated
-      std::string processedOptions = pchOptions;
-      std::replace(processedOptions.begin(), processedOptions.end(), ';', ' ');
-      
-      // Convert absolute paths in PCH options to relative paths
-      std::string pchProjectDir = this->GetCMakeInstance()->GetHomeDirectory();
-      size_t pos = 0;
-      while ((pos = processedOptions.find(pchProjectDir, pos)) != std::string::npos) {
-        // Find the end of the path (space or end of string)
-        size_t endPos = processedOptions.find(' ', pos);
-        if (endPos == std::string::npos) {
-          endPos = processedOptions.length();
+    return targetFlags.Shared;
+  }
+  
+  cmLocalGenerator* lg = target->GetLocalGenerator();
+  std::string compileFlags = targetFlags.Options;
+  
+  // Source file specific flags; each source keeps them even when it is
+  // compiled in a unity batch
+  cmGeneratorExpressionInterpreter genexInterpreter(lg, config, target, lang);
+  std::string sourceFlags;
+  if (cflags) {
+    lg->AppendFlags(sourceFlags,
+                    genexInterpreter.Evaluate(*cflags, "COMPILE_FLAGS"));
+  }
+  if (coptions) {
+    lg->AppendCompileOptions(
+      sourceFlags, genexInterpreter.Evaluate(*coptions, "COMPILE_OPTIONS"));
+  }
+  AppendFlag(compileFlags, sourceFlags);
+  
+  // Preprocessor definitions, merged with the source file specific ones
+  std::set<BT<std::string>> definesSet = targetFlags.Defines;
+  if (defs) {
+    lg->AppendDefines(definesSet,
+                      genexInterpreter.Evaluate(*defs, "COMPILE_DEFINITIONS"));
+  }
+  if (configDefs) {
+    lg->AppendDefines(definesSet,
+                      genexInterpreter.Evaluate(*configDefs, "COMPILE_DEFINITIONS"));
+  }
+  for (const auto& define : definesSet) {
+    if (!define.Value.empty()) {
+      AppendFlag(compileFlags, "-D" + define.Value);
+    }
+  }
+  
+  // Include directories, the source file specific ones first
+  if (sourceIncludes) {
+    for (const std::string& dir :
+         GetSourceIncludeDirectories(target, source, lang, config)) {
+      AppendFlag(compileFlags, this->GetIncludeFlag(dir));
+    }
+  }
+  for (const std::string& includeFlag : targetFlags.Includes) {
+    AppendFlag(compileFlags, includeFlag);
+  }
+  
+  AppendFlag(compileFlags, targetFlags.Standard);
+  
+  // Add PCH compile options if applicable
+  if (pchSource && !skipPch) {
+    // This is a PCH source file - add create options
+    for (const std::string& arch : target->GetPchArchs(config, lang)) {
+      if (target->GetPchSource(config, lang, arch) == sourceFile) {
+        std::string pchOptions =
+          target->GetPchCreateCompileOptions(config, lang, arch);
+        if (!pchOptions.empty()) {
+          AppendFlag(compileFlags, this->GetPchCompileOptions(pchOptions));
         }
-        
-        // Extract the full path
-        std::string fullPath = processedOptions.substr(pos, endPos - pos);
-        
-        // Convert to relative path
-        std::string relPath = cmSystemTools::RelativePath(pchProjectDir, fullPath);
-        
-        // Replace in the string
-        processedOptions.replace(pos, fullPath.length(), relPath);
-        
-        // Move past this replacement
-        pos += relPath.length();
-      }
-      
-      if (!firstFlag) {
-        compileFlagsStream << " ";
+        break;
       }
-      compileFlagsStream << processedOptions;
-      firstFlag = false;
     }
+  } else if (!skipPch) {
+    AppendFlag(compileFlags, targetFlags.PchUseOptions);
   }
   
   // Add output file flag for ASM
-  if (lang == "ASM" || lang == "ASM-ATT" || lang == "ASM_NASM" || lang == "ASM_MASM") {
-    if (!firstFlag) {
-      compileFlagsStream << " ";
-    }
-    compileFlagsStream << "-o " << objectName;
+  if (asmSource) {
+    AppendFlag(compileFlags, "-o " + objectName);
   }
   
-  return compileFlagsStream.str();
+  if (sourceSpecific) {
+    *sourceSpecific = compileFlags != targetFlags.Shared;
+  }
+  return compileFlags;
 }
 
 void cmGlobalNixGenerator::WriteExternalSourceDerivation(cmGeneratedFileStream& /*nixFileStream*/,
@@ -1527,9 +3031,10 @@ void cmGlobalNixGenerator::WriteRegularSourceDerivation(cmGeneratedFileStream& /
 
 
 void cmGlobalNixGenerator::WriteLinkDerivation(
-  cmGeneratedFileStream& nixFileStream, cmGeneratorTarget* target)
+  std::ostream& nixFileStream, cmGeneratorTarget* target)
 {
   ProfileTimer timer(this, "WriteLinkDerivation");
+  timer.SetArg("target", target->GetName());
   
   // Step 1: Prepare link context with all necessary information
   LinkContext ctx = PrepareLinkContext(target);
@@ -1552,6 +3057,32 @@ void cmGlobalNixGenerator::WriteLinkDerivation(
   // Step 5: Process library dependencies
   ProcessLibraryDependencies(ctx, target);
   
+  // Step 5b: Add the link time optimization flags that the link rules of
+  // the other generators get, and split distributed ThinLTO links
+  if ((target->GetType() == cmStateEnums::EXECUTABLE ||
+       target->GetType() == cmStateEnums::SHARED_LIBRARY ||
+       target->GetType() == cmStateEnums::MODULE_LIBRARY) &&
+      target->IsIPOEnabled(ctx.primaryLang, ctx.config)) {
+    cmLocalGenerator* lg = target->GetLocalGenerator();
+    std::string ipoFlags;
+    lg->AppendFeatureOptions(ipoFlags, ctx.primaryLang, "IPO");
+    lg->AppendIPOLinkerFlags(ipoFlags, target, ctx.config, ctx.primaryLang);
+    ipoFlags = cmTrimWhitespace(ipoFlags);
+    if (!ipoFlags.empty()) {
+      ctx.linkFlagsStr = ctx.linkFlagsStr.empty()
+        ? ipoFlags
+        : cmStrCat(ctx.linkFlagsStr, ' ', ipoFlags);
+    }
+    if (!ctx.thinLTOObjects.empty() &&
+        this->UseDistributedThinLTO(target, ctx.primaryLang, ctx.config) &&
+        !this->LinksBitcodeArchives(target, ctx.config)) {
+      this->WriteThinLTODerivations(nixFileStream, ctx, target);
+    }
+  } else if (target->GetType() == cmStateEnums::STATIC_LIBRARY &&
+             target->IsIPOEnabled(ctx.primaryLang, ctx.config)) {
+    ctx.archiver = this->GetIPOArchiver(target, ctx);
+  }
+  
   // Step 6: Prepare try_compile post-build phase if needed
   if (ctx.isTryCompile) {
     this->LogDebug("Adding try_compile output file handling for: " + ctx.targetName);
@@ -1567,6 +3098,7 @@ void cmGlobalNixGenerator::WriteLinkDerivation(
   }
   
   // Step 9: Delegate to DerivationWriter
+  this->DerivationRoles[ctx.targetName] = "link";
   this->DerivationWriter->WriteLinkDerivationWithHelper(
     nixFileStream,
     ctx.derivName,
@@ -1580,10 +3112,39 @@ void cmGlobalNixGenerator::WriteLinkDerivation(
     ctx.libraries,
     ctx.versionStr,
     ctx.soversionStr,
-    ctx.postBuildPhase
+    ctx.postBuildPhase,
+    ctx.archiver
   );
 }
 
+std::string cmGlobalNixGenerator::GetIPOArchiver(cmGeneratorTarget* target,
+                                                 LinkContext const& ctx) const
+{
+  // Plain ar does not index the symbols of bitcode objects, so static
+  // libraries of IPO objects use the archiver of the
+  // CMAKE_<LANG>_ARCHIVE_CREATE_IPO rule.  Its host path is replaced by
+  // the same tool of the compiler's toolchain in the store.
+  cmValue const rule = target->Makefile->GetDefinition(
+    cmStrCat("CMAKE_", ctx.primaryLang, "_ARCHIVE_CREATE_IPO"));
+  if (!rule) {
+    return std::string();
+  }
+  std::vector<std::string> args;
+  cmSystemTools::ParseUnixCommandLine(rule->c_str(), args);
+  if (args.empty()) {
+    return std::string();
+  }
+  std::string const tool = cmSystemTools::GetFilenameName(args.front());
+  if (tool.find("gcc-ar") != std::string::npos) {
+    return cmStrCat("\"${", ctx.compilerPkg, ".cc}/bin/gcc-ar\"");
+  }
+  if (tool.find("llvm-ar") != std::string::npos) {
+    return "\"${llvm}/bin/llvm-ar\"";
+  }
+  // Other toolchains archive IPO objects with the plain archiver
+  return std::string();
+}
+
 std::vector<std::string> cmGlobalNixGenerator::GetSourceDependencies(
   std::string const& /*sourceFile*/) const
 {
@@ -1730,72 +3291,673 @@ void cmGlobalNixGenerator::ProcessLibraryDependenciesForBuildInputs(
 }
 
 
-
-void cmGlobalNixGenerator::WriteInstallOutputs(cmGeneratedFileStream& nixFileStream)
+
+void cmGlobalNixGenerator::WriteInstallOutputs(cmGeneratedFileStream& nixFileStream)
+{
+  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
+  this->InstallRuleGenerator->WriteInstallOutputs(
+    this->InstallTargets, 
+    nixFileStream,
+    [this](const std::string& targetName) { return this->GetDerivationName(targetName); });
+}
+
+
+
+void cmGlobalNixGenerator::CollectInstallTargets()
+{
+  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
+  this->InstallTargets = this->InstallRuleGenerator->CollectInstallTargets(this->LocalGenerators);
+}
+
+void cmGlobalNixGenerator::WriteInstallRules(cmGeneratedFileStream& nixFileStream)
+{
+  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
+  std::string config = this->GetBuildConfiguration(nullptr);
+  this->InstallRuleGenerator->WriteInstallRules(
+    this->InstallTargets, 
+    nixFileStream, 
+    config,
+    [this](const std::string& targetName) { return this->GetDerivationName(targetName); });
+}
+
+// Dependency graph implementation
+void cmGlobalNixGenerator::BuildDependencyGraph() {
+  ProfileTimer timer(this, "BuildDependencyGraph");
+  
+  // Clear any existing graph
+  this->DependencyGraph->Clear();
+  this->TargetIndex.clear();
+  this->ObjectLibrarySourceIndex.clear();
+  
+  // Add all targets to the graph
+  for (const auto& lg : this->LocalGenerators) {
+    for (const auto& target : lg->GetGeneratorTargets()) {
+      this->DependencyGraph->AddTarget(target->GetName(), target.get());
+      // The first target with a given name wins, as with a linear search
+      this->TargetIndex.emplace(target->GetName(), target.get());
+    }
+  }
+  
+  // Add dependencies
+  std::string config = "Release"; // Default config for dependency analysis
+  for (const auto& lg : this->LocalGenerators) {
+    for (const auto& target : lg->GetGeneratorTargets()) {
+      auto linkImpl = target->GetLinkImplementation(config, cmGeneratorTarget::UseTo::Compile);
+      if (linkImpl) {
+        for (const cmLinkItem& item : linkImpl->Libraries) {
+          if (item.Target && !item.Target->IsImported()) {
+            // Add dependency from target to item.Target
+            this->DependencyGraph->AddDependency(target->GetName(), item.Target->GetName());
+          }
+        }
+      }
+    }
+  }
+}
+
+cmGeneratorTarget* cmGlobalNixGenerator::FindTargetByName(
+  std::string const& name) const
+{
+  auto it = this->TargetIndex.find(name);
+  return it != this->TargetIndex.end() ? it->second : nullptr;
+}
+
+cmGeneratorTarget* cmGlobalNixGenerator::FindObjectLibraryForSource(
+  std::string const& sourcePath, std::string const& config)
+{
+  auto inserted = this->ObjectLibrarySourceIndex.emplace(
+    config, std::unordered_map<std::string, cmGeneratorTarget*>());
+  auto& index = inserted.first->second;
+  if (inserted.second) {
+    for (auto const& lg : this->LocalGenerators) {
+      for (auto const& target : lg->GetGeneratorTargets()) {
+        if (target->GetType() == cmStateEnums::OBJECT_LIBRARY) {
+          std::vector<cmSourceFile*> sources;
+          target->GetSourceFiles(sources, config);
+          for (cmSourceFile* source : sources) {
+            index.emplace(source->GetFullPath(), target.get());
+          }
+        }
+      }
+    }
+  }
+  
+  auto it = index.find(sourcePath);
+  return it != index.end() ? it->second : nullptr;
+}
+
+bool cmGlobalNixGenerator::UseExplicitSources() const
+{
+  // Check if CMAKE_NIX_EXPLICIT_SOURCES is set in cache
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_EXPLICIT_SOURCES");
+  return value && cmIsOn(*value);
+}
+
+bool cmGlobalNixGenerator::UseFragments() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_FRAGMENTS");
+  return value && cmIsOn(*value);
+}
+
+bool cmGlobalNixGenerator::UseContentAddressed() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_CONTENT_ADDRESSED");
+  return value && cmIsOn(*value);
+}
+
+bool cmGlobalNixGenerator::UseStructuredBuildLog() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_STRUCTURED_BUILD");
+  return value && cmIsOn(*value);
+}
+
+bool cmGlobalNixGenerator::UseManifest() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_MANIFEST");
+  return value && cmIsOn(*value);
+}
+
+bool cmGlobalNixGenerator::UseDepfiles() const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_DEPFILES");
+  // Explicit sources are scanned precisely already
+  return value && cmIsOn(*value) && !this->UseExplicitSources();
+}
+
+bool cmGlobalNixGenerator::UseDistributedThinLTO(
+  cmGeneratorTarget const* target, std::string const& lang,
+  std::string const& config) const
+{
+  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+    "CMAKE_NIX_THINLTO");
+  if (!value || !cmIsOn(*value) || (lang != "C" && lang != "CXX") ||
+      this->GetCMakeInstance()->GetIsInTryCompile() ||
+      !target->IsIPOEnabled(lang, config)) {
+    return false;
+  }
+  cmList const options{
+    target->GetLocalGenerator()->GetMakefile()->GetSafeDefinition(
+      cmStrCat("CMAKE_", lang, "_COMPILE_OPTIONS_IPO"))
+  };
+  return std::find(options.begin(), options.end(), "-flto=thin") !=
+    options.end();
+}
+
+bool cmGlobalNixGenerator::LinksBitcodeArchives(
+  cmGeneratorTarget const* target, std::string const& config) const
+{
+  // Static libraries pass their own dependencies on to the link
+  std::vector<cmGeneratorTarget const*> pending{ target };
+  std::set<cmGeneratorTarget const*> visited;
+  while (!pending.empty()) {
+    cmGeneratorTarget const* current = pending.back();
+    pending.pop_back();
+    cmLinkImplementation const* impl =
+      current->GetLinkImplementation(config, cmGeneratorTarget::UseTo::Link);
+    if (!impl) {
+      continue;
+    }
+    for (cmLinkItem const& item : impl->Libraries) {
+      cmGeneratorTarget const* library = item.Target;
+      if (!library || library->IsImported() ||
+          library->GetType() != cmStateEnums::STATIC_LIBRARY ||
+          !visited.insert(library).second) {
+        continue;
+      }
+      if (library->IsIPOEnabled("C", config) ||
+          library->IsIPOEnabled("CXX", config)) {
+        return true;
+      }
+      pending.push_back(library);
+    }
+  }
+  return false;
+}
+
+bool cmGlobalNixGenerator::HasDistributedThinLTOTargets() const
+{
+  for (auto const& lg : this->LocalGenerators) {
+    for (auto const& target : lg->GetGeneratorTargets()) {
+      if (target->GetType() != cmStateEnums::EXECUTABLE &&
+          target->GetType() != cmStateEnums::SHARED_LIBRARY &&
+          target->GetType() != cmStateEnums::MODULE_LIBRARY) {
+        continue;
+      }
+      std::string const config = this->GetBuildConfiguration(target.get());
+      if ((this->UseDistributedThinLTO(target.get(), "CXX", config) ||
+           this->UseDistributedThinLTO(target.get(), "C", config)) &&
+          !this->LinksBitcodeArchives(target.get(), config)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool cmGlobalNixGenerator::CheckThinLTOLinker() const
+{
+  if (!this->HasDistributedThinLTOTargets()) {
+    return true;
+  }
+  
+  // LLVM toolchains install ld.lld beside clang
+  std::vector<std::string> hints;
+  for (char const* lang : { "CXX", "C" }) {
+    cmValue compiler = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
+      cmStrCat("CMAKE_", lang, "_COMPILER"));
+    if (compiler && !compiler->empty()) {
+      hints.push_back(cmSystemTools::GetFilenamePath(
+        cmSystemTools::GetRealPath(*compiler)));
+    }
+  }
+  if (!cmSystemTools::FindProgram("ld.lld", hints).empty()) {
+    return true;
+  }
+  
+  this->GetCMakeInstance()->IssueMessage(
+    MessageType::FATAL_ERROR,
+    "CMAKE_NIX_THINLTO links with lld (-fuse-ld=lld), but ld.lld was not "
+    "found next to the C or C++ compiler or in the PATH. Install lld, or "
+    "set CMAKE_NIX_THINLTO to OFF to optimize IPO targets within their "
+    "link derivation.");
+  return false;
+}
+
+void cmGlobalNixGenerator::CheckContentAddressedCompilers() const
+{
+  if (!this->UseContentAddressed() || this->LocalGenerators.empty()) {
+    return;
+  }
+  
+  cmMakefile* mf = this->LocalGenerators[0]->GetMakefile();
+  std::vector<std::string> unsupported;
+  for (char const* lang : { "C", "CXX", "Fortran", "ASM" }) {
+    if (!this->GetLanguageEnabled(lang)) {
+      continue;
+    }
+    std::string const id =
+      mf->GetSafeDefinition(cmStrCat("CMAKE_", lang, "_COMPILER_ID"));
+    if (id != "GNU" && id != "Clang" && id != "AppleClang" &&
+        id != "IntelLLVM") {
+      unsupported.push_back(cmStrCat(
+        lang, " (", id.empty() ? std::string("unknown") : id, ')'));
+    }
+  }
+  if (unsupported.empty()) {
+    return;
+  }
+  
+  this->GetCMakeInstance()->IssueMessage(
+    MessageType::WARNING,
+    cmStrCat("CMAKE_NIX_CONTENT_ADDRESSED is ON, but the compilers of ",
+             cmJoin(unsupported, ", "),
+             " are neither GCC nor Clang. Their objects are built without "
+             "-ffile-prefix-map and -frandom-seed, so they may embed the "
+             "build directory or random symbol names and change on every "
+             "build instead of being reused."));
+}
+
+std::vector<std::string> cmGlobalNixGenerator::GetThinLTOBackendFlags(
+  std::vector<std::string> const& compileFlags)
+{
+  static std::set<std::string> const backendFlags = {
+    "-O",
+    "-O0",
+    "-O1",
+    "-O2",
+    "-O3",
+    "-Os",
+    "-Oz",
+    "-Og",
+    "-Ofast",
+    "-g",
+    "-g0",
+    "-g1",
+    "-g2",
+    "-g3",
+    "-ggdb",
+    "-gline-tables-only",
+    "-gsplit-dwarf",
+    "-m32",
+    "-m64",
+    "-mx32",
+    "-fPIC",
+    "-fpic",
+    "-fPIE",
+    "-fpie",
+    "-fno-PIC",
+    "-fno-pic",
+    "-fno-PIE",
+    "-fno-pie",
+    "-fno-plt",
+    "-ffunction-sections",
+    "-fno-function-sections",
+    "-fdata-sections",
+    "-fno-data-sections",
+    "-fomit-frame-pointer",
+    "-fno-omit-frame-pointer",
+  };
+  // Flags that carry a value, such as -march=native or -gdwarf-4
+  static char const* const backendFlagPrefixes[] = {
+    "-gdwarf",
+    "-march=",
+    "-mtune=",
+    "-mcpu=",
+    "-mfpu=",
+    "-mabi=",
+    "-mfloat-abi=",
+    "-mcmodel=",
+    "--target=",
+  };
+  
+  std::vector<std::string> flags;
+  for (std::string const& flag : compileFlags) {
+    bool keep = backendFlags.count(flag) != 0;
+    for (char const* prefix : backendFlagPrefixes) {
+      keep = keep || cmHasPrefix(flag, prefix);
+    }
+    if (keep) {
+      flags.push_back(flag);
+    }
+  }
+  return flags;
+}
+
+std::string cmGlobalNixGenerator::GetDepfileKey(
+  std::string const& sourceFile, std::string const& lang,
+  std::string const& flags) const
 {
-  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
-  this->InstallRuleGenerator->WriteInstallOutputs(
-    this->InstallTargets, 
-    nixFileStream,
-    [this](const std::string& targetName) { return this->GetDerivationName(targetName); });
+  return cmCryptoHash(cmCryptoHash::AlgoSHA256)
+    .HashString(cmStrCat(sourceFile, '\n', lang, '\n', flags))
+    .substr(0, 16);
 }
 
+void cmGlobalNixGenerator::LoadLearnedDependencies()
+{
+  ProfileTimer timer(this, "LoadLearnedDependencies");
+  std::string const& homeDir = this->GetCMakeInstance()->GetHomeDirectory();
+  std::string const directory =
+    cmStrCat(this->GetCMakeInstance()->GetHomeOutputDirectory(), '/',
+             cmNix::Generator::DEPFILE_DIRECTORY);
+  cmSystemTools::MakeDirectory(directory);
+  cmsys::Directory stamps;
+  if (!stamps.Load(directory)) {
+    return;
+  }
+
+  // Each build leaves its collection, named like its stamp; a key found in
+  // several is taken from the most recent build
+  std::unordered_map<std::string, std::pair<bool, cmFileTime>> fileTimes;
+  std::unordered_map<std::string, std::pair<cmFileTime, std::string>>
+    keyStamps;
+  std::map<std::string, std::vector<std::string>> collectionKeys;
+  for (unsigned long i = 0; i < stamps.GetNumberOfFiles(); ++i) {
+    std::string const stampName = stamps.GetFile(i);
+    if (!cmHasLiteralSuffix(stampName, ".stamp")) {
+      continue;
+    }
+    std::string const collection = cmStrCat(
+      directory, '/', stampName.substr(0, stampName.size() - 6));
+    cmFileTime stamp;
+    cmsys::Directory depfiles;
+    if (!stamp.Load(cmStrCat(directory, '/', stampName)) ||
+        !depfiles.Load(collection)) {
+      continue;
+    }
+    std::vector<std::string>& keys = collectionKeys[collection];
+    for (unsigned long j = 0; j < depfiles.GetNumberOfFiles(); ++j) {
+      std::string const depfileName = depfiles.GetFile(j);
+      if (!cmHasLiteralSuffix(depfileName, ".d")) {
+        continue;
+      }
+      std::string const key = depfileName.substr(0, depfileName.size() - 2);
+      keys.push_back(key);
+      auto known = keyStamps.find(key);
+      if (known != keyStamps.end() && !known->second.first.Older(stamp)) {
+        continue;
+      }
+      keyStamps[key] = std::make_pair(stamp, collection);
+      this->LearnedDependencies.erase(key);
 
+      // Relative paths in the depfile are relative to the unpacked source
+      // tree, whose root is the top-level source directory
+      cm::optional<std::vector<cmGccStyleDependency>> const content =
+        cmReadGccDepfile(cmStrCat(collection, '/', depfileName).c_str(),
+                         homeDir);
+      if (!content) {
+        continue;
+      }
+      // A file that changed since the build started may include other
+      // headers now, and a path outside of the source tree and the store
+      // cannot be part of a fileset; both leave the source on the
+      // conservative fileset
+      std::vector<std::string> headers;
+      bool current = true;
+      for (cmGccStyleDependency const& dependency : *content) {
+        for (std::string const& path : dependency.paths) {
+          if (cmHasPrefix(path, cmNix::SystemPaths::NIX_STORE)) {
+            continue;
+          }
+          auto fileTime = fileTimes.find(path);
+          if (fileTime == fileTimes.end()) {
+            cmFileTime time;
+            bool const exists = time.Load(path);
+            fileTime =
+              fileTimes.emplace(path, std::make_pair(exists, time)).first;
+          }
+          if (!cmSystemTools::IsSubDirectory(path, homeDir) ||
+              !fileTime->second.first ||
+              !fileTime->second.second.Older(stamp)) {
+            current = false;
+            break;
+          }
+          headers.push_back(cmSystemTools::RelativePath(homeDir, path));
+        }
+        if (!current) {
+          break;
+        }
+      }
+      if (current) {
+        this->LearnedDependencies[key] = std::move(headers);
+      }
+    }
+  }
+  
+  // Every target set built leaves a collection, and each out-link is a GC
+  // root.  Drop the collections whose keys all come from newer builds, such
+  // as that of one target after a build of all.
+  for (auto const& collection : collectionKeys) {
+    bool const superseded = std::all_of(
+      collection.second.begin(), collection.second.end(),
+      [&keyStamps, &collection](std::string const& key) {
+        return keyStamps[key].second != collection.first;
+      });
+    if (superseded) {
+      cmSystemTools::RemoveFile(collection.first);
+      cmSystemTools::RemoveFile(cmStrCat(collection.first, ".stamp"));
+    }
+  }
+  timer.SetItemCount(this->LearnedDependencies.size());
+}
 
-void cmGlobalNixGenerator::CollectInstallTargets()
+std::string cmGlobalNixGenerator::GetLearnedFilesHash(
+  std::vector<std::string> const& files)
 {
-  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
-  this->InstallTargets = this->InstallRuleGenerator->CollectInstallTargets(this->LocalGenerators);
+  // The same as cmakeNixLearnedSrc computes: the SHA-256 of the
+  // concatenated SHA-256 of each file, in base 16
+  std::string const& homeDir = this->GetCMakeInstance()->GetHomeDirectory();
+  std::string hashes;
+  for (std::string const& file : files) {
+    auto it = this->LearnedFileHashes.find(file);
+    if (it == this->LearnedFileHashes.end()) {
+      it = this->LearnedFileHashes
+             .emplace(file,
+                      cmCryptoHash(cmCryptoHash::AlgoSHA256)
+                        .HashFile(cmStrCat(homeDir, '/', file)))
+             .first;
+    }
+    hashes += it->second;
+  }
+  return cmCryptoHash(cmCryptoHash::AlgoSHA256).HashString(hashes);
 }
 
-void cmGlobalNixGenerator::WriteInstallRules(cmGeneratedFileStream& nixFileStream)
+void cmGlobalNixGenerator::WriteDepfileCollection(cmNixWriter& writer)
 {
-  std::lock_guard<std::mutex> lock(this->InstallTargetsMutex);
-  std::string config = this->GetBuildConfiguration(nullptr);
-  this->InstallRuleGenerator->WriteInstallRules(
-    this->InstallTargets, 
-    nixFileStream, 
-    config,
-    [this](const std::string& targetName) { return this->GetDerivationName(targetName); });
+  if (!this->UseDepfiles()) {
+    return;
+  }
+  // A function, so that building the default outputs skips it; sources
+  // in several targets with equal flags have one depfile
+  writer.WriteIndented(
+    1, cmStrCat(cmNix::Generator::DEPFILE_ATTRIBUTE, " = { targets ? \"\" }:"));
+  writer.WriteIndented(2, "let");
+  writer.WriteIndented(3, "depfiles = {");
+  for (auto const& target : this->TargetDepfiles) {
+    writer.WriteIndented(4, cmStrCat('"', target.first, "\" = {"));
+    for (auto const& depfile : target.second) {
+      writer.WriteIndented(5, cmStrCat('"', depfile.first, ".d\" = ",
+                                       depfile.second, ".dep;"));
+    }
+    writer.WriteIndented(4, "};");
+  }
+  writer.WriteIndented(3, "};");
+  writer.WriteIndented(3, "selected = if targets == \"\" then attrNames depfiles else splitString \";\" targets;");
+  writer.WriteIndented(2, "in linkFarm \"cmake-nix-depfiles\" (foldl' (all: target: all // depfiles.${target} or { }) { } selected);");
 }
 
-// Dependency graph implementation
-void cmGlobalNixGenerator::BuildDependencyGraph() {
-  ProfileTimer timer(this, "BuildDependencyGraph");
-  
-  // Clear any existing graph
-  this->DependencyGraph->Clear();
+void cmGlobalNixGenerator::WriteBuildManifest(
+  std::vector<ObjectDerivationJob> const& jobs)
+{
+  ProfileTimer timer(this, "WriteBuildManifest");
+  std::string const& homeOutputDir =
+    this->GetCMakeInstance()->GetHomeOutputDirectory();
+  
+  // Flag sets, paths and package names repeat across most objects, so
+  // they are stored once and referred to by index
+  Json::Value strings(Json::arrayValue);
+  std::unordered_map<std::string, Json::UInt> stringIndices;
+  auto intern = [&strings, &stringIndices](std::string const& str) {
+    auto inserted = stringIndices.emplace(str, strings.size());
+    if (inserted.second) {
+      strings.append(str);
+    }
+    return Json::Value(inserted.first->second);
+  };
+  auto internList = [&intern](std::vector<std::string> const& list) {
+    Json::Value indices(Json::arrayValue);
+    for (std::string const& str : list) {
+      indices.append(intern(str));
+    }
+    return indices;
+  };
   
-  // Add all targets to the graph
-  for (const auto& lg : this->LocalGenerators) {
-    for (const auto& target : lg->GetGeneratorTargets()) {
-      this->DependencyGraph->AddTarget(target->GetName(), target.get());
+  Json::Value objects(Json::objectValue);
+  for (ObjectDerivationJob const& job : jobs) {
+    ManifestObject const& object = job.Manifest;
+    if (!object.Valid) {
+      continue;
     }
+    Json::Value entry(Json::objectValue);
+    entry["name"] = object.Name;
+    // Roots are path literals relative to default.nix, "./../src"
+    entry["root"] = intern(cmHasLiteralPrefix(object.Root, "./")
+                             ? object.Root.substr(2)
+                             : object.Root);
+    if (!object.Files.empty() || !object.GeneratedFiles.empty()) {
+      entry["files"] = internList(object.Files);
+      if (!object.GeneratedFiles.empty()) {
+        entry["generated"] = internList(object.GeneratedFiles);
+      }
+    }
+    entry["source"] = intern(object.Source);
+    entry["compiler"] = intern(object.CompilerPackage);
+    if (!object.CompilerBinary.empty()) {
+      entry["binary"] = intern(object.CompilerBinary);
+    }
+    if (!object.Flags.empty()) {
+      entry["flags"] = intern(object.Flags);
+    }
+    entry["buildInputs"] = internList(object.BuildInputs);
+    if (object.LocalBuild) {
+      entry["localBuild"] = true;
+    }
+    if (object.Depfile) {
+      entry["depfile"] = true;
+    }
+    objects[this->GetDerivationName(job.Target->GetName(),
+                                    job.ResolvedSourcePath)] = entry;
   }
   
-  // Add dependencies
-  std::string config = "Release"; // Default config for dependency analysis
-  for (const auto& lg : this->LocalGenerators) {
-    for (const auto& target : lg->GetGeneratorTargets()) {
-      auto linkImpl = target->GetLinkImplementation(config, cmGeneratorTarget::UseTo::Compile);
-      if (linkImpl) {
-        for (const cmLinkItem& item : linkImpl->Libraries) {
-          if (item.Target && !item.Target->IsImported()) {
-            // Add dependency from target to item.Target
-            this->DependencyGraph->AddDependency(target->GetName(), item.Target->GetName());
-          }
-        }
+  Json::Value root(Json::objectValue);
+  root["version"] = 1;
+  root["contentAddressed"] = this->UseContentAddressed();
+  root["strings"] = std::move(strings);
+  root["objects"] = std::move(objects);
+  
+  cmGeneratedFileStream manifest(
+    cmStrCat(homeOutputDir, '/', cmNix::Generator::MANIFEST));
+  manifest.SetCopyIfDifferent(true);
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+  writer->write(root, &manifest);
+  manifest << '\n';
+  
+  std::string const library =
+    cmStrCat(cmSystemTools::GetCMakeRoot(),
+             cmNix::Generator::MANIFEST_LIBRARY_SOURCE);
+  if (!cmSystemTools::CopyFileIfDifferent(
+        library,
+        cmStrCat(homeOutputDir, '/', cmNix::Generator::MANIFEST_LIBRARY))) {
+    this->GetCMakeInstance()->IssueMessage(
+      MessageType::FATAL_ERROR,
+      cmStrCat("Failed to copy the Nix build manifest library ", library,
+               " to ", homeOutputDir));
+  }
+}
+
+std::vector<std::string> cmGlobalNixGenerator::WriteTargetFragments()
+{
+  std::string const& homeOutputDir =
+    this->GetCMakeInstance()->GetHomeOutputDirectory();
+  std::vector<std::string> fragments;
+  std::set<std::string> written;
+  written.insert(cmNix::Generator::COMMON_FRAGMENT);
+  
+  for (auto const& fragment : this->TargetFragments) {
+    std::string fileName = cmStrCat(cmNix::Generator::TARGET_FRAGMENT_PREFIX,
+                                    fragment.first, ".nix");
+    std::string filePath = cmStrCat(homeOutputDir, '/', fileName);
+    fragments.push_back(fileName);
+    written.insert(fileName);
+    
+    // Skip targets whose bindings did not change since the last run.  The
+    // bindings name the shared sources and flags they use, whose names hash
+    // their contents, so a change in the common fragment changes them too.
+    std::string hashLine = cmStrCat(
+      cmNix::Generator::FRAGMENT_HASH_PREFIX,
+      cmCryptoHash(cmCryptoHash::AlgoSHA256)
+        .HashString(fragment.second.Bindings));
+    {
+      cmsys::ifstream existing(filePath.c_str());
+      std::string line;
+      if (existing && std::getline(existing, line) &&
+          std::getline(existing, line) && line == hashLine) {
+        this->LogDebug("Fragment unchanged: " + fileName);
+        continue;
       }
     }
+    
+    cmGeneratedFileStream fragmentStream(filePath);
+    fragmentStream.SetCopyIfDifferent(true);
+    if (!fragmentStream) {
+      this->GetCMakeInstance()->IssueMessage(
+        MessageType::FATAL_ERROR,
+        cmStrCat("Failed to open Nix file for writing: ", filePath));
+      continue;
+    }
+    cmNixWriter writer(fragmentStream);
+    writer.WriteComment("Generated by CMake Nix Generator");
+    writer.WriteLine(hashLine);
+    writer.WriteLine("{ pkgs, self }:");
+    writer.WriteLine("with pkgs;");
+    writer.WriteLine("with lib;");
+    writer.WriteLine("with self;");
+    writer.StartAttributeSet();
+    fragmentStream << fragment.second.Bindings;
+    writer.EndAttributeSet();
   }
+  
+  // Drop fragments of targets that no longer exist
+  this->RemoveStaleFragments(written);
+  
+  return fragments;
 }
 
-bool cmGlobalNixGenerator::UseExplicitSources() const
+void cmGlobalNixGenerator::RemoveStaleFragments(
+  std::set<std::string> const& keep) const
 {
-  // Check if CMAKE_NIX_EXPLICIT_SOURCES is set in cache
-  cmValue value = this->GetCMakeInstance()->GetState()->GetCacheEntryValue(
-    "CMAKE_NIX_EXPLICIT_SOURCES");
-  return value && cmIsOn(*value);
+  std::string const& homeOutputDir =
+    this->GetCMakeInstance()->GetHomeOutputDirectory();
+  cmsys::Directory dir;
+  if (!dir.Load(homeOutputDir)) {
+    return;
+  }
+  for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i) {
+    std::string fileName = dir.GetFile(i);
+    bool const fragment = fileName == cmNix::Generator::COMMON_FRAGMENT ||
+      (cmHasPrefix(fileName, cmNix::Generator::TARGET_FRAGMENT_PREFIX) &&
+       cmHasLiteralSuffix(fileName, ".nix"));
+    if (fragment && !keep.count(fileName)) {
+      cmSystemTools::RemoveFile(cmStrCat(homeOutputDir, '/', fileName));
+    }
+  }
 }
 
 void cmGlobalNixGenerator::WriteExplicitSourceDerivation(
@@ -1862,35 +4024,47 @@ void cmGlobalNixGenerator::WriteExplicitSourceDerivation(
 
 
 void cmGlobalNixGenerator::WriteCompositeSource(
-  cmGeneratedFileStream& nixFileStream,
-  const std::vector<std::string>& configTimeGeneratedFiles,
+  std::ostream& nixFileStream,
+  const std::vector<std::string>& configTimeGeneratedFilesIn,
   const std::string& srcDir,
   const std::string& buildDir,
   cmGeneratorTarget* target,
   const std::string& lang,
   const std::string& config,
-  const std::vector<std::string>& customCommandHeaders)
+  const std::vector<std::string>& customCommandHeadersIn)
 {
+  // The composite only depends on these inputs, not on the source file, so
+  // sort them and share one derivation between all translation units that
+  // render the same one
+  std::vector<std::string> configTimeGeneratedFiles = configTimeGeneratedFilesIn;
+  std::sort(configTimeGeneratedFiles.begin(), configTimeGeneratedFiles.end());
+  configTimeGeneratedFiles.erase(
+    std::unique(configTimeGeneratedFiles.begin(), configTimeGeneratedFiles.end()),
+    configTimeGeneratedFiles.end());
+  std::vector<std::string> customCommandHeaders = customCommandHeadersIn;
+  std::sort(customCommandHeaders.begin(), customCommandHeaders.end());
+  
   // Create a composite source that includes both source files and config-time generated files
   // Build the buildInputs list for custom command dependencies
-  nixFileStream << "    src = pkgs.runCommand \"composite-src-with-generated\" {\n";
+  std::ostringstream composite;
+  composite << "pkgs.runCommand \"composite-src-with-generated\" {\n";
   if (!customCommandHeaders.empty()) {
-    nixFileStream << "      buildInputs = [\n";
+    composite << "      buildInputs = [\n";
     std::set<std::string> processedDerivs;
     for (const auto& headerDeriv : customCommandHeaders) {
       if (processedDerivs.find(headerDeriv) != processedDerivs.end()) {
         continue;
       }
       processedDerivs.insert(headerDeriv);
-      nixFileStream << "        " << headerDeriv << "\n";
+      composite << "        " << headerDeriv << "\n";
     }
-    nixFileStream << "      ];\n";
+    composite << "      ];\n";
   }
-  nixFileStream << "    } ''\n";
-  nixFileStream << "      mkdir -p $out\n";
+  composite << "    } ''\n";
+  composite << "      mkdir -p $out\n";
   
   // Copy the source directory structure
-  nixFileStream << "      # Copy source files\n";
+  composite << "      # Copy source files\n";
   // For out-of-source builds, compute relative path to source directory
   std::string rootPath = "./.";
   if (srcDir != buildDir) {
@@ -1905,7 +4079,7 @@ void cmGlobalNixGenerator::WriteCompositeSource(
       rootPath = "./.";
     }
   }
-  nixFileStream << "      cp -rL ${" << rootPath << "}/* $out/ 2>/dev/null || true\n";
+  composite << "      cp -rL ${" << rootPath << "}/* $out/ 2>/dev/null || true\n";
   
   // Handle external include directories - copy headers from them
   if (target) {
@@ -1921,17 +4095,17 @@ void cmGlobalNixGenerator::WriteCompositeSource(
           std::string relPath = cmSystemTools::RelativePath(srcDir, incPath);
           if (cmNixPathUtils::IsPathOutsideTree(relPath)) {
             // This is an external include directory
-            nixFileStream << "      # Copy headers from external include directory: " << incPath << "\n";
+            composite << "      # Copy headers from external include directory: " << incPath << "\n";
             
             // Normalize the path to resolve any .. segments
             std::string normalizedPath = cmSystemTools::CollapseFullPath(incPath);
             
             // Create parent directories first
             std::string parentPath = cmSystemTools::GetFilenamePath(normalizedPath);
-            nixFileStream << "      mkdir -p $out" << parentPath << "\n";
+            composite << "      mkdir -p $out" << parentPath << "\n";
             
             // Use Nix's path functionality to copy the entire directory
-            nixFileStream << "      cp -rL ${builtins.path { path = \"" << normalizedPath << "\"; }} $out" << normalizedPath << "\n";
+            composite << "      cp -rL ${builtins.path { path = \"" << normalizedPath << "\"; }} $out" << normalizedPath << "\n";
           }
         }
       }
@@ -1939,76 +4113,29 @@ void cmGlobalNixGenerator::WriteCompositeSource(
   }
   
   // Copy configuration-time generated files to their correct locations
-  nixFileStream << "      # Copy configuration-time generated files\n";
+  composite << "      # Copy configuration-time generated files\n";
   
-  // Since configuration-time generated files exist in the build directory
-  // and Nix can't access them directly with builtins.path (security restriction),
-  // we need to embed the file contents directly into the Nix expression
+  // Each file's content is written once as a shared store file, so that
+  // the expression grows with the number of generated files rather than
+  // with the number of translation units including them
   for (const auto& genFile : configTimeGeneratedFiles) {
     // Calculate the relative path within the build directory
     std::string relPath = cmSystemTools::RelativePath(buildDir, genFile);
     std::string destDir = cmSystemTools::GetFilenamePath(relPath);
-    
-    // Read the file content and embed it directly
-    cmsys::ifstream inFile(genFile.c_str(), std::ios::in | std::ios::binary);
-    if (inFile) {
-      std::ostringstream contents;
-      contents << inFile.rdbuf();
-      // File automatically closes when inFile goes out of scope (RAII)
-      
-      // Create parent directory if needed
-      if (!destDir.empty()) {
-        nixFileStream << "      mkdir -p $out/" << destDir << "\n";
-      }
-      
-      // Check file size to avoid hitting Nix expression limits
-      std::string contentStr = contents.str();
-      const size_t MAX_EMBEDDED_FILE_SIZE = 1024 * 1024; // 1MB limit for embedded files
-      if (contentStr.length() > MAX_EMBEDDED_FILE_SIZE) {
-        std::ostringstream msg;
-        msg << "Configuration-time generated file is too large to embed in Nix expression: " 
-            << genFile << " (" << contentStr.length() << " bytes, limit is " 
-            << MAX_EMBEDDED_FILE_SIZE << " bytes)";
-        this->GetCMakeInstance()->IssueMessage(MessageType::FATAL_ERROR, msg.str());
-        return;
-      }
-      
-      // Write the file content directly using a here-doc with a unique delimiter
-      // Use a complex delimiter to avoid conflicts with file contents
-      std::string delimiter = "NIXEOF_" + std::to_string(std::hash<std::string>{}(genFile)) + "_END";
-      nixFileStream << "      cat > $out/" << relPath << " <<'" << delimiter << "'\n";
-      
-      // Escape '' sequences in content since we're inside a Nix multiline string
-      for (size_t i = 0; i < contentStr.length(); ++i) {
-        if (i + 1 < contentStr.length() && contentStr[i] == '\'' && contentStr[i + 1] == '\'') {
-          nixFileStream << "''\\''";
-          i++; // Skip the next quote
-        } else {
-          nixFileStream << contentStr[i];
-        }
-      }
-      
-      // Ensure we end with a newline before the delimiter
-      if (!contentStr.empty() && contentStr.back() != '\n') {
-        nixFileStream << "\n";
-      }
-      nixFileStream << delimiter << "\n";
-    } else {
-      // If we can't read the file, issue a warning but continue
-      std::ostringstream msg;
-      msg << "Warning: Cannot read configuration-time generated file: " << genFile << "\n"
-          << "  This file was expected to be generated during CMake configuration.\n"
-          << "  The build may fail if this file is required. Check your CMakeLists.txt for:\n"
-          << "  - configure_file() commands that may have failed\n"
-          << "  - add_custom_command() with OUTPUT that didn't run";
-      this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, msg.str());
-      nixFileStream << "      # Warning: Could not read " << genFile << "\n";
+    std::string const fileSource = this->GetGeneratedFileSource(genFile, target);
+    if (fileSource.empty()) {
+      composite << "      # Warning: Could not read " << genFile << "\n";
+      continue;
     }
+    if (!destDir.empty()) {
+      composite << "      mkdir -p $out/" << destDir << "\n";
+    }
+    composite << "      cp --no-preserve=mode ${" << fileSource << "} $out/" << relPath << "\n";
   }
   
   // Copy custom command generated headers
   if (!customCommandHeaders.empty()) {
-    nixFileStream << "      # Copy custom command generated headers\n";
+    composite << "      # Copy custom command generated headers\n";
     // Use a set to track unique derivation names to avoid duplicates
     std::set<std::string> processedDerivs;
     for (const auto& headerDeriv : customCommandHeaders) {
@@ -2026,71 +4153,151 @@ void cmGlobalNixGenerator::WriteCompositeSource(
             std::string relPath = cmSystemTools::RelativePath(buildDir, output);
             std::string destDir = cmSystemTools::GetFilenamePath(relPath);
             if (!destDir.empty()) {
-              nixFileStream << "      mkdir -p $out/" << destDir << "\n";
+              composite << "      mkdir -p $out/" << destDir << "\n";
             }
-            nixFileStream << "      cp ${" << headerDeriv << "}/" << relPath << " $out/" << relPath << "\n";
+            composite << "      cp ${" << headerDeriv << "}/" << relPath << " $out/" << relPath << "\n";
           }
         }
       }
     }
   }
   
-  nixFileStream << "    '';\n";
+  composite << "    ''";
+  
+  std::string const expression = composite.str();
+  std::string const name = cmStrCat(
+    "composite_src_",
+    cmCryptoHash(cmCryptoHash::AlgoSHA256).HashString(expression).substr(0, 16));
+  SharedSource& shared = this->SharedSources[name];
+  if (shared.Expression.empty()) {
+    shared.Expression = expression;
+  }
+  if (target) {
+    shared.Targets.insert(target->GetName());
+  }
+  nixFileStream << "    src = " << name << ";\n";
 }
 
-void cmGlobalNixGenerator::WriteFilesetUnion(
-  cmGeneratedFileStream& nixFileStream,
-  const std::vector<std::string>& existingFiles,
-  const std::vector<std::string>& generatedFiles,
-  const std::string& rootPath)
+std::string cmGlobalNixGenerator::GetGeneratedFileSource(
+  std::string const& genFile, cmGeneratorTarget const* target)
 {
-  // Write fileset union
-  nixFileStream << "    src = fileset.toSource {\n";
-  nixFileStream << "      root = " << rootPath << ";\n";
-  nixFileStream << "      fileset = fileset.unions [\n";
-  
-  // Add existing files
-  for (const auto& file : existingFiles) {
-    // Check if path contains spaces, special characters, or non-ASCII characters that need quoting
-    bool needsQuoting = false;
-    for (char c : file) {
-      if (c == ' ' || c == '\'' || c == '"' || c == '$' || c == '\\' || 
-          static_cast<unsigned char>(c) > 127) {
-        needsQuoting = true;
-        break;
-      }
-    }
-    
-    if (needsQuoting) {
-      // Use string concatenation syntax for paths with special characters
-      nixFileStream << "        (" << rootPath << " + \"/" << cmNixWriter::EscapeNixString(file) << "\")\n";
-    } else {
-      nixFileStream << "        " << rootPath << "/" << file << "\n";
-    }
+  cmsys::ifstream inFile(genFile.c_str(), std::ios::in | std::ios::binary);
+  if (!inFile) {
+    std::ostringstream msg;
+    msg << "Warning: Cannot read configuration-time generated file: " << genFile << "\n"
+        << "  This file was expected to be generated during CMake configuration.\n"
+        << "  The build may fail if this file is required. Check your CMakeLists.txt for:\n"
+        << "  - configure_file() commands that may have failed\n"
+        << "  - add_custom_command() with OUTPUT that didn't run";
+    this->GetCMakeInstance()->IssueMessage(MessageType::WARNING, msg.str());
+    return std::string();
   }
+  std::ostringstream contents;
+  contents << inFile.rdbuf();
+  std::string const contentStr = contents.str();
   
-  // Add generated files with maybeMissing
-  for (const auto& file : generatedFiles) {
-    // Check if path contains spaces, special characters, or non-ASCII characters that need quoting
-    bool needsQuoting = false;
-    for (char c : file) {
-      if (c == ' ' || c == '\'' || c == '"' || c == '$' || c == '\\' || 
-          static_cast<unsigned char>(c) > 127) {
-        needsQuoting = true;
-        break;
-      }
+  // Check file size to avoid hitting Nix expression limits
+  const size_t MAX_EMBEDDED_FILE_SIZE = 1024 * 1024; // 1MB limit for embedded files
+  if (contentStr.length() > MAX_EMBEDDED_FILE_SIZE) {
+    std::ostringstream msg;
+    msg << "Configuration-time generated file is too large to embed in Nix expression: " 
+        << genFile << " (" << contentStr.length() << " bytes, limit is " 
+        << MAX_EMBEDDED_FILE_SIZE << " bytes)";
+    this->GetCMakeInstance()->IssueMessage(MessageType::FATAL_ERROR, msg.str());
+    return std::string();
+  }
+  
+  // Store path names only allow a restricted character set
+  std::string fileName = cmSystemTools::GetFilenameName(genFile);
+  for (char& c : fileName) {
+    if (!isalnum(static_cast<unsigned char>(c)) && !strchr("+-._?=", c)) {
+      c = '_';
     }
-    
-    if (needsQuoting) {
-      // Use string concatenation syntax for paths with special characters
-      nixFileStream << "        (fileset.maybeMissing (" << rootPath << " + \"/" << cmNixWriter::EscapeNixString(file) << "\"))\n";
+  }
+  
+  // Files with the same name and content share one store file, wherever
+  // in the build tree they were generated
+  std::string const name = cmStrCat(
+    "generated_file_",
+    cmCryptoHash(cmCryptoHash::AlgoSHA256)
+      .HashString(cmStrCat(fileName, '\0', contentStr))
+      .substr(0, 16));
+  SharedSource& shared = this->SharedSources[name];
+  if (shared.Expression.empty()) {
+    shared.Expression = cmStrCat("builtins.toFile \"", fileName, "\" \"",
+                                 cmNixWriter::EscapeNixString(contentStr), '"');
+  }
+  if (target) {
+    shared.Targets.insert(target->GetName());
+  }
+  return name;
+}
+
+void cmGlobalNixGenerator::WriteSharedSources(cmGeneratedFileStream& nixFileStream)
+{
+  for (auto const& shared : this->SharedSources) {
+    std::string const definition =
+      cmStrCat("  ", shared.first, " = ", shared.second.Expression, ";\n\n");
+    // With fragments, one used by a single target goes to its fragment and
+    // the others to the common one; the names hash their expressions
+    if (this->WritingFragments && shared.second.Targets.size() == 1) {
+      TargetFragment& fragment =
+        this->TargetFragments[*shared.second.Targets.begin()];
+      fragment.Bindings += definition;
     } else {
-      nixFileStream << "        (fileset.maybeMissing " << rootPath << "/" << file << ")\n";
+      nixFileStream << definition;
     }
   }
-  
-  nixFileStream << "      ];\n";
-  nixFileStream << "    };\n";
+}
+
+void cmGlobalNixGenerator::WriteFilesetUnion(
+  std::ostream& nixFileStream,
+  const std::vector<std::string>& existingFiles,
+  const std::vector<std::string>& generatedFiles,
+  const std::string& rootPath)
+{
+  nixFileStream << "    src = "
+                << GetFilesetExpression(existingFiles, generatedFiles,
+                                        rootPath, "      ")
+                << ";\n";
+}
+
+std::string cmGlobalNixGenerator::GetFilesetExpression(
+  std::vector<std::string> const& existingFiles,
+  std::vector<std::string> const& generatedFiles,
+  std::string const& rootPath, std::string const& indent)
+{
+  std::string expression =
+    cmStrCat("fileset.toSource {\n", indent, "root = ", rootPath, ";\n",
+             indent, "fileset = fileset.unions [\n");
+  for (std::string const& file : existingFiles) {
+    expression +=
+      cmStrCat(indent, "  ", GetFilesetPath(rootPath, file), '\n');
+  }
+  // Generated files may not exist yet
+  for (std::string const& file : generatedFiles) {
+    expression += cmStrCat(indent, "  (fileset.maybeMissing ",
+                           GetFilesetPath(rootPath, file), ")\n");
+  }
+  expression += cmStrCat(indent, "];\n", indent.substr(2), '}');
+  return expression;
+}
+
+std::string cmGlobalNixGenerator::GetFilesetPath(std::string const& rootPath,
+                                                 std::string const& file)
+{
+  // Paths with spaces, special or non-ASCII characters are concatenated
+  // from a string
+  bool const needsQuoting =
+    std::any_of(file.begin(), file.end(), [](char c) {
+      return c == ' ' || c == '\'' || c == '"' || c == '$' || c == '\\' ||
+        static_cast<unsigned char>(c) > 127;
+    });
+  if (needsQuoting) {
+    return cmStrCat('(', rootPath, " + \"/", cmNixWriter::EscapeNixString(file),
+                    "\")");
+  }
+  return cmStrCat(rootPath, '/', file);
 }
 
 std::vector<std::string> cmGlobalNixGenerator::BuildBuildInputsList(
@@ -2392,26 +4599,69 @@ bool cmGlobalNixGenerator::GetProfilingEnabled() const
 }
 
 cmGlobalNixGenerator::ProfileTimer::ProfileTimer(
-  const cmGlobalNixGenerator* gen, const std::string& name)
+  const cmGlobalNixGenerator* gen, const std::string& name, bool report)
   : Generator(gen), Name(name)
 {
-  if (Generator->GetProfilingEnabled()) {
+  this->Report = report && this->Generator->GetProfilingEnabled();
+  this->Trace = this->Generator->GetCMakeInstance()->IsProfilingEnabled();
+  if (this->Report || this->Trace) {
     StartTime = std::chrono::steady_clock::now();
+  }
+  if (this->Report) {
     std::cerr << "[NIX-PROFILE] START: " << Name << std::endl;
   }
 }
 
 cmGlobalNixGenerator::ProfileTimer::~ProfileTimer()
 {
-  if (Generator->GetProfilingEnabled()) {
-    auto endTime = std::chrono::steady_clock::now();
+  if (!this->Report && !this->Trace) {
+    return;
+  }
+  auto endTime = std::chrono::steady_clock::now();
+  if (this->Trace) {
+    Json::Value args(Json::objectValue);
+    for (auto const& arg : this->Args) {
+      args[arg.first] = arg.second;
+    }
+    if (ItemCount > 0) {
+      args["items"] = static_cast<Json::Value::UInt64>(ItemCount);
+    }
+    this->Generator->GetCMakeInstance()->GetProfilingOutput().AddCompleteEntry(
+      cmNix::Profiling::CATEGORY, Name, StartTime, endTime, std::move(args));
+  }
+  if (this->Report) {
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
       endTime - StartTime);
     double ms = duration.count() / 1000.0;
     std::cerr << "[NIX-PROFILE] END: " << Name 
               << " (duration: " << std::fixed << std::setprecision(3) 
-              << ms << " ms)" << std::endl;
+              << ms << " ms";
+    if (ItemCount > 0) {
+      double seconds = ms / 1000.0;
+      std::cerr << ", " << ItemCount << " items";
+      if (seconds > 0) {
+        std::cerr << ", " << std::setprecision(1)
+                  << (ItemCount / seconds) << " items/s";
+      }
+    }
+    std::cerr << ")" << std::endl;
+  }
+}
+
+void cmGlobalNixGenerator::AddProfileCounter(
+  std::string const& name,
+  std::vector<std::pair<std::string, size_t>> const& values) const
+{
+  cmake* cm = this->GetCMakeInstance();
+  if (!cm->IsProfilingEnabled()) {
+    return;
+  }
+  Json::Value args(Json::objectValue);
+  for (auto const& value : values) {
+    args[value.first] = static_cast<Json::Value::UInt64>(value.second);
   }
+  cm->GetProfilingOutput().AddCounter(cmNix::Profiling::CATEGORY, name,
+                                      std::move(args));
 }
 
 // Helper method implementations for WriteObjectDerivation refactoring
@@ -2817,10 +5067,8 @@ void cmGlobalNixGenerator::CollectObjectFiles(
   
   // Process regular source files
   for (cmSourceFile* source : sources) {
-    // Skip Unity-generated batch files
-    std::string sourcePath = source->GetFullPath();
-    if (sourcePath.find("/Unity/unity_") != std::string::npos && 
-        sourcePath.find("_cxx.cxx") != std::string::npos) {
+    // Skip the generated unity sources
+    if (IsGeneratedUnitySource(source)) {
       continue;
     }
     
@@ -2835,7 +5083,10 @@ void cmGlobalNixGenerator::CollectObjectFiles(
       if (pchSources.find(resolvedSourcePath) == pchSources.end()) {
         std::string objDerivName = this->GetDerivationName(
           target->GetName(), resolvedSourcePath);
-        ctx.objects.push_back(objDerivName);
+        ctx.objects.push_back(this->GetObjectReference(objDerivName));
+        if (this->UseDistributedThinLTO(target, lang, ctx.config)) {
+          ctx.thinLTOObjects.insert(ctx.objects.back());
+        }
       }
     }
   }
@@ -2856,26 +5107,107 @@ void cmGlobalNixGenerator::CollectObjectFiles(
     }
     
     // Find the OBJECT library that contains this source
-    for (auto const& lg : this->LocalGenerators) {
-      auto const& targets = lg->GetGeneratorTargets();
-      for (auto const& objTarget : targets) {
-        if (objTarget->GetType() == cmStateEnums::OBJECT_LIBRARY) {
-          std::vector<cmSourceFile*> objSources;
-          objTarget->GetSourceFiles(objSources, ctx.config);
-          for (cmSourceFile* objSource : objSources) {
-            if (objSource->GetFullPath() == sourceFile) {
-              // Found the OBJECT library that contains this source
-              std::string objDerivName = this->GetDerivationName(
-                objTarget->GetName(), sourceFile);
-              ctx.objects.push_back(objDerivName);
-              goto next_external_object;
-            }
-          }
+    if (cmGeneratorTarget* objTarget =
+          this->FindObjectLibraryForSource(sourceFile, ctx.config)) {
+      std::string objDerivName = this->GetDerivationName(
+        objTarget->GetName(), sourceFile);
+      ctx.objects.push_back(this->GetObjectReference(objDerivName));
+      cmSourceFile const* objSource =
+        objTarget->GetLocalGenerator()->GetMakefile()->GetSource(sourceFile);
+      if (objSource &&
+          this->UseDistributedThinLTO(objTarget, objSource->GetLanguage(),
+                                      ctx.config)) {
+        ctx.thinLTOObjects.insert(ctx.objects.back());
+      }
+    }
+  }
+}
+
+void cmGlobalNixGenerator::WriteThinLTODerivations(
+  std::ostream& os, LinkContext& ctx, cmGeneratorTarget* target)
+{
+  // The thin link sees the same objects, libraries and flags as the final
+  // link so that it resolves symbols the same way
+  std::string const index =
+    this->GetDerivationName(ctx.targetName, "thinlto/index");
+  this->DerivationRoles[cmStrCat(ctx.targetName, "-thinlto-index")] = "link";
+  os << "  " << index << " = cmakeNixThinLink {\n";
+  os << "    name = \"" << ctx.targetName << "-thinlto-index\";\n";
+  os << "    type = \"" << ctx.nixTargetType << "\";\n";
+  os << "    buildInputs = [ " << cmJoin(ctx.buildInputs, " ") << " ];\n";
+  os << "    objects = [ " << cmJoin(ctx.objects, " ") << " ];\n";
+  os << "    compiler = " << ctx.compilerPkg << ";\n";
+  if (!ctx.compilerCommand.empty()) {
+    os << "    compilerCommand = \"" << ctx.compilerCommand << "\";\n";
+  }
+  if (!ctx.linkFlagsStr.empty()) {
+    os << "    flags = \"" << cmNixWriter::EscapeNixString(ctx.linkFlagsStr)
+       << "\";\n";
+  }
+  if (!ctx.libraries.empty()) {
+    os << "    libraries = [";
+    for (std::string const& library : ctx.libraries) {
+      os << " \"" << library << "\"";
+    }
+    os << " ];\n";
+  }
+  os << "  };\n\n";
+  
+  // Backends only generate code, so they take the code generation flags
+  // of the target but not -flto, which would make them write bitcode again
+  std::vector<std::string> compileFlags;
+  cmSystemTools::ParseUnixCommandLine(
+    this->GetTargetCompileFlags(target, ctx.primaryLang, ctx.config)
+      .Shared.c_str(),
+    compileFlags);
+  if ((target->GetType() == cmStateEnums::SHARED_LIBRARY ||
+       target->GetType() == cmStateEnums::MODULE_LIBRARY) &&
+      std::find(compileFlags.begin(), compileFlags.end(), "-fPIC") ==
+        compileFlags.end()) {
+    compileFlags.emplace_back("-fPIC");
+  }
+  std::string const flags =
+    cmJoin(GetThinLTOBackendFlags(compileFlags), " ");
+  
+  size_t backendCount = 0;
+  for (std::string& object : ctx.objects) {
+    if (!ctx.thinLTOObjects.count(object)) {
+      continue;
+    }
+    std::string const backend = this->GetDerivationName(
+      ctx.targetName, cmStrCat("thinlto/", backendCount));
+    std::string const backendName = cmStrCat(
+      ctx.targetName, "-thinlto-", backendCount, this->GetObjectFileExtension());
+    this->DerivationRoles[backendName] = "compile";
+    os << "  " << backend << " = cmakeNixThinBackend {\n";
+    os << "    name = \"" << backendName << "\";\n";
+    os << "    object = " << object << ";\n";
+    os << "    index = " << index << ";\n";
+    if (ctx.thinLTOObjects.size() > 1) {
+      os << "    imports = [";
+      for (std::string const& imported : ctx.thinLTOObjects) {
+        if (imported != object) {
+          os << ' ' << imported;
         }
       }
+      os << " ];\n";
+    }
+    os << "    compiler = " << ctx.compilerPkg << ";\n";
+    if (!ctx.compilerCommand.empty()) {
+      os << "    compilerCommand = \"" << ctx.compilerCommand << "\";\n";
     }
-    next_external_object:;
+    if (!flags.empty()) {
+      os << "    flags = \"" << cmNixWriter::EscapeNixString(flags) << "\";\n";
+    }
+    os << "  };\n\n";
+    object = backend;
+    ++backendCount;
   }
+  
+  // The final link only sees native code, but links with lld like the thin
+  // link so that it resolves symbols the same way
+  ctx.buildInputs.emplace_back("lld");
+  ctx.linkFlagsStr = cmStrCat(ctx.linkFlagsStr, " -fuse-ld=lld");
 }
 
 void cmGlobalNixGenerator::ProcessLibraryDependencies(
@@ -2982,16 +5314,16 @@ void cmGlobalNixGenerator::HandleStaticLibraryDependencies(
   const std::set<std::string>& transitiveDeps)
 {
   // Get all targets in topological order for proper static library linking
-  std::vector<std::string> topologicalOrder = this->DependencyGraph->GetTopologicalOrderForLinking(target->GetName());
-  
-  // Also need to include direct static dependencies
-  std::set<std::string> allStaticDeps = this->DependencyGraph->GetAllTransitiveDependencies(target->GetName());
-  allStaticDeps.insert(directStaticLibs.begin(), directStaticLibs.end());
-  
+  cmNixDependencyGraph const& graph = *this->DependencyGraph;
+  cmNixDependencyGraph::NodeId const targetId =
+    graph.GetNodeId(target->GetName());
+  std::vector<cmNixDependencyGraph::NodeId> const& topologicalOrder =
+    graph.GetLinkOrder(targetId);
+
   if (this->GetCMakeInstance()->GetDebugOutput()) {
     this->LogDebug("Topological order for linking " + target->GetName() + ":");
-    for (const auto& t : topologicalOrder) {
-      this->LogDebug("  " + t);
+    for (cmNixDependencyGraph::NodeId id : topologicalOrder) {
+      this->LogDebug("  " + graph.GetNodeName(id));
     }
   }
   
@@ -3007,35 +5339,20 @@ void cmGlobalNixGenerator::HandleStaticLibraryDependencies(
   }
   
   // Add both direct and transitive static libraries in topological order
-  for (const std::string& depTarget : topologicalOrder) {
-    if (allStaticDeps.count(depTarget) > 0 && alreadyAdded.find(depTarget) == alreadyAdded.end()) {
-      auto depIt = std::find_if(this->LocalGenerators.begin(), this->LocalGenerators.end(),
-        [&depTarget](const std::unique_ptr<cmLocalGenerator>& lg) {
-          auto const& targets = lg->GetGeneratorTargets();
-          return std::any_of(targets.begin(), targets.end(),
-            [&depTarget](const std::unique_ptr<cmGeneratorTarget>& t) {
-              return t->GetName() == depTarget;
-            });
-        });
-      
-      if (depIt != this->LocalGenerators.end()) {
-        auto const& targets = (*depIt)->GetGeneratorTargets();
-        auto targetIt = std::find_if(targets.begin(), targets.end(),
-          [&depTarget](const std::unique_ptr<cmGeneratorTarget>& t) {
-            return t->GetName() == depTarget;
-          });
-        
-        if (targetIt != targets.end()) {
-          std::string depDerivName = this->GetDerivationName(depTarget);
-          if ((*targetIt)->GetType() == cmStateEnums::STATIC_LIBRARY) {
-            ctx.libraries.push_back("${" + depDerivName + "}");
-          } else if ((*targetIt)->GetType() == cmStateEnums::SHARED_LIBRARY) {
-            ctx.libraries.push_back("${" + depDerivName + "}/" + this->GetLibraryPrefix() + 
-                                   depTarget + this->GetSharedLibraryExtension());
-          } else if ((*targetIt)->GetType() == cmStateEnums::MODULE_LIBRARY) {
-            ctx.libraries.push_back("${" + depDerivName + "}/" + depTarget + 
-                                   this->GetSharedLibraryExtension());
-          }
+  for (cmNixDependencyGraph::NodeId id : topologicalOrder) {
+    const std::string& depTarget = graph.GetNodeName(id);
+    if ((graph.DependsOn(targetId, id) || directStaticLibs.count(depTarget) > 0) &&
+        alreadyAdded.find(depTarget) == alreadyAdded.end()) {
+      if (cmGeneratorTarget* depGenTarget = this->FindTargetByName(depTarget)) {
+        std::string depDerivName = this->GetDerivationName(depTarget);
+        if (depGenTarget->GetType() == cmStateEnums::STATIC_LIBRARY) {
+          ctx.libraries.push_back("${" + depDerivName + "}");
+        } else if (depGenTarget->GetType() == cmStateEnums::SHARED_LIBRARY) {
+          ctx.libraries.push_back("${" + depDerivName + "}/" + this->GetLibraryPrefix() + 
+                                 depTarget + this->GetSharedLibraryExtension());
+        } else if (depGenTarget->GetType() == cmStateEnums::MODULE_LIBRARY) {
+          ctx.libraries.push_back("${" + depDerivName + "}/" + depTarget + 
+                                 this->GetSharedLibraryExtension());
         }
       }
     }
@@ -11,10 +11,14 @@
 #include <mutex>
 #include <set>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "cmGlobalCommonGenerator.h"
 #include "cmGlobalGeneratorFactory.h"
+#include "cmListFileCache.h"
+#include "cmNixModuleScanner.h"
 
 class cmGeneratedFileStream;
 class cmGeneratorTarget;
@@ -28,7 +32,10 @@ class cmNixDependencyGraph;
 class cmNixCustomCommandHandler;
 class cmNixHeaderDependencyResolver;
 class cmNixCacheManager;
+class cmNixIncludeScanner;
 class cmNixFileSystemHelper;
+class cmNixTargetGenerator;
+class cmSourceFile;
 
 /**
  * \class cmGlobalNixGenerator
@@ -89,6 +96,20 @@ public:
    */
   void Generate() override;
 
+  /**
+   * C++20 modules are scanned at generate time, so they need no support
+   * from the build tool.
+   */
+  bool CheckCxxModuleSupport(CxxModuleSupportQuery query) override;
+
+  bool IsIPOSupported() const override { return true; }
+
+  /**
+   * cmake --build without --config builds the configuration selected when
+   * generating, so default to CMAKE_BUILD_TYPE rather than Debug.
+   */
+  std::string GetDefaultBuildConfig() const override;
+
   std::vector<GeneratedMakeCommand> GenerateBuildCommand(
     std::string const& makeProgram, std::string const& projectName,
     std::string const& projectDir, std::vector<std::string> const& targetNames,
@@ -96,25 +117,69 @@ public:
     cmBuildOptions const& buildOptions = cmBuildOptions(),
     std::vector<std::string> const& makeOptions =
       std::vector<std::string>()) override;
-  
-  // Batch try_compile operations for parallel execution
-  void BeginTryCompileBatch();
-  void EndTryCompileBatch();
 
   void AddObjectDerivation(std::string const& targetName, std::string const& derivationName, std::string const& sourceFile, std::string const& objectFileName, std::string const& language, std::vector<std::string> const& dependencies);
   
   // Cache manager access for other components
   cmNixCacheManager* GetCacheManager() const;
 
+  /**
+   * Look up the headers found for a source of a target by the batched
+   * dependency scan that runs before the object derivations are written.
+   * Returns false if the source was not part of that scan.
+   */
+  bool GetScannedDependencies(std::string const& targetName,
+                              std::string const& sourcePath,
+                              std::vector<std::string>& headers) const;
+
+  // Scratch directory for compiler dependency scan depfiles
+  std::string GetDependencyScanDirectory() const;
+
+  // Include directive scanner shared by all targets, so that headers are
+  // parsed once per generation (see cmNixTargetGenerator::ScanIncludes)
+  cmNixIncludeScanner* GetIncludeScanner() const;
+
+  // Whether dependencies are scanned from include directives instead of by
+  // the compiler (CMAKE_NIX_DEPENDENCY_SCANNER=include)
+  bool UseIncludeScanner() const;
+
+  // Include directories of a source's own INCLUDE_DIRECTORIES property,
+  // searched before those of its target
+  static std::vector<std::string> GetSourceIncludeDirectories(
+    cmGeneratorTarget* target, cmSourceFile const* source,
+    std::string const& lang, std::string const& config);
+
+  // Warn about a compiler dependency scan that did not succeed
+  void ReportDependencyScanFailure(std::string const& sourcePath,
+                                   std::string const& error) const;
+
 protected:
   virtual void WriteNixFile();
   void WriteNixHelperFunctions(cmNixWriter& writer);
   void WriteDerivations();
   virtual void WritePerTranslationUnitDerivations(cmGeneratedFileStream& nixFileStream);
   virtual void WriteLinkingDerivations(cmGeneratedFileStream& nixFileStream);
-  void WriteObjectDerivation(cmGeneratedFileStream& nixFileStream, 
-                            cmGeneratorTarget* target, const cmSourceFile* source);
-  void WriteLinkDerivation(cmGeneratedFileStream& nixFileStream, 
+  // An object derivation as data for the JSON build manifest; Valid only
+  // if all of its attributes can be expressed without Nix bindings of
+  // default.nix
+  struct ManifestObject {
+    bool Valid = false;
+    std::string Name;
+    std::string Root;
+    std::vector<std::string> Files;
+    std::vector<std::string> GeneratedFiles;
+    std::string Source;
+    std::string CompilerPackage;
+    std::string CompilerBinary;
+    std::string Flags;
+    std::vector<std::string> BuildInputs;
+    bool LocalBuild = false;
+    bool Depfile = false;
+  };
+  void WriteObjectDerivation(std::ostream& nixFileStream,
+                            cmGeneratorTarget* target, const cmSourceFile* source,
+                            ManifestObject* manifest = nullptr);
+  void WriteLinkDerivation(std::ostream& nixFileStream, 
                           cmGeneratorTarget* target);
   
   // Helper methods for WriteLinkDerivation refactoring
@@ -131,11 +196,15 @@ protected:
     bool isTryCompile;
     std::vector<std::string> buildInputs;
     std::vector<std::string> objects;
+    // Objects that are ThinLTO bitcode for UseDistributedThinLTO
+    std::set<std::string> thinLTOObjects;
     std::vector<std::string> libraries;
     std::string linkFlagsStr;
     std::string versionStr;
     std::string soversionStr;
     std::string postBuildPhase;
+    // Nix expression of the archiver of a static library, if not ar
+    std::string archiver;
   };
   
   LinkContext PrepareLinkContext(cmGeneratorTarget* target);
@@ -145,6 +214,13 @@ protected:
   void CollectBuildInputs(LinkContext& ctx, cmGeneratorTarget* target,
                          const std::vector<std::string>& libraryDeps);
   void CollectObjectFiles(LinkContext& ctx, cmGeneratorTarget* target);
+  // Write the thin link and the backend derivations of the ThinLTO
+  // objects of ctx, and link the native objects of the backends instead
+  void WriteThinLTODerivations(std::ostream& os, LinkContext& ctx,
+                               cmGeneratorTarget* target);
+  // Archiver of a static library with IPO objects, empty for plain ar
+  std::string GetIPOArchiver(cmGeneratorTarget* target,
+                             LinkContext const& ctx) const;
   void ProcessLibraryDependencies(LinkContext& ctx, cmGeneratorTarget* target);
   void HandleStaticLibraryDependencies(LinkContext& ctx, cmGeneratorTarget* target,
                                       const std::set<std::string>& directStaticLibs,
@@ -176,14 +252,44 @@ protected:
                                    const std::string& objectName);
   std::string DetermineCompilerPackage(cmGeneratorTarget* target,
                                       const cmSourceFile* source) const;
+  // Compile flags of a source: the flag set its target shares in the
+  // language and configuration, with the source's own properties layered
+  // on top.  sourceSpecific is set when the result differs from the shared
+  // set.
   std::string GetCompileFlags(cmGeneratorTarget* target,
                              const cmSourceFile* source,
                              const std::string& lang,
                              const std::string& config,
-                             const std::string& objectName);
+                             const std::string& objectName,
+                             bool* sourceSpecific = nullptr);
+  
+  // Parts of the compile flags that do not depend on the source, evaluated
+  // once per (target, language, configuration)
+  struct TargetCompileFlags {
+    std::string Options;
+    std::set<BT<std::string>> Defines;
+    std::vector<std::string> Includes;
+    std::string Standard;
+    std::set<std::string> PchSources;
+    std::string PchUseOptions;
+    // Derivations of the precompiled headers, by the path relative to the
+    // source tree where the compiler looks for them
+    std::map<std::string, std::string> PchFiles;
+    // The whole flag string of a source without flags of its own
+    std::string Shared;
+  };
+  TargetCompileFlags const& GetTargetCompileFlags(cmGeneratorTarget* target,
+                                                  std::string const& lang,
+                                                  std::string const& config);
+  std::map<std::tuple<cmGeneratorTarget const*, std::string, std::string>,
+           TargetCompileFlags> TargetCompileFlagsCache;
+  std::string GetIncludeFlag(std::string const& dir) const;
+  std::string GetPchCompileOptions(std::string options) const;
   
   // Additional helper methods for WriteObjectDerivation decomposition
-  void WriteCompositeSource(cmGeneratedFileStream& nixFileStream,
+  // Writes "src = <name>;" for a composite source derivation that is
+  // shared by all translation units with the same inputs
+  void WriteCompositeSource(std::ostream& nixFileStream,
                            const std::vector<std::string>& configTimeGeneratedFiles,
                            const std::string& srcDir,
                            const std::string& buildDir,
@@ -191,10 +297,19 @@ protected:
                            const std::string& lang = "",
                            const std::string& config = "",
                            const std::vector<std::string>& customCommandHeaders = {});
-  void WriteFilesetUnion(cmGeneratedFileStream& nixFileStream,
+  void WriteFilesetUnion(std::ostream& nixFileStream,
                         const std::vector<std::string>& existingFiles,
                         const std::vector<std::string>& generatedFiles,
                         const std::string& rootPath);
+  // The fileset.toSource expression written by WriteFilesetUnion, with its
+  // attributes indented by indent
+  static std::string GetFilesetExpression(
+    std::vector<std::string> const& existingFiles,
+    std::vector<std::string> const& generatedFiles,
+    std::string const& rootPath, std::string const& indent);
+  // Nix path of a file below rootPath, quoted when it needs to be
+  static std::string GetFilesetPath(std::string const& rootPath,
+                                    std::string const& file);
   std::vector<std::string> BuildBuildInputsList(cmGeneratorTarget* target,
                                                const cmSourceFile* source,
                                                const std::string& config,
@@ -216,6 +331,8 @@ protected:
     std::string projectSourceRelPath;
     std::string srcDir;
     std::string buildDir;
+    // Empty unless the derivation writes a depfile
+    std::string depfileKey;
   };
   
   SourceCompilationContext PrepareSourceCompilationContext(
@@ -234,13 +351,14 @@ protected:
     std::vector<std::string>& customCommandHeaders);
   
   void WriteSourceAttribute(
-    cmGeneratedFileStream& nixFileStream,
+    std::ostream& nixFileStream,
     const SourceCompilationContext& ctx,
     cmGeneratorTarget* target,
-    const cmSourceFile* source);
+    const cmSourceFile* source,
+    ManifestObject* manifest = nullptr);
   
   void WriteCompilerAttribute(
-    cmGeneratedFileStream& nixFileStream,
+    std::ostream& nixFileStream,
     const std::vector<std::string>& buildInputs,
     const std::string& compilerPackage);
   
@@ -255,7 +373,7 @@ protected:
     const std::string& buildDir);
   
   void WriteExternalSourceComposite(
-    cmGeneratedFileStream& nixFileStream,
+    std::ostream& nixFileStream,
     const SourceCompilationContext& ctx,
     cmGeneratorTarget* target,
     const cmSourceFile* source);
@@ -305,6 +423,71 @@ protected:
 
 protected:
   bool UseExplicitSources() const;
+
+  // Whether derivations go to per-target fragment files
+  // (CMAKE_NIX_FRAGMENTS) instead of directly into default.nix
+  bool UseFragments() const;
+
+  // Whether object and archive derivations are content-addressed
+  // (CMAKE_NIX_CONTENT_ADDRESSED)
+  bool UseContentAddressed() const;
+
+  // Whether the object derivations of target are built locally without
+  // querying binary caches: the NIX_LOCAL_OBJECTS target property, or else
+  // the CMAKE_NIX_LOCAL_OBJECTS cache variable, which is either a boolean
+  // or a list of target types
+  bool UseLocalObjectBuilds(cmGeneratorTarget const* target) const;
+  bool HasLocalObjectBuilds() const;
+
+  // Whether "cmake --build" follows nix-build's internal-json log to report
+  // progress and instrumentation data (CMAKE_NIX_STRUCTURED_BUILD)
+  bool UseStructuredBuildLog() const;
+
+  // Whether object derivations whose attributes are plain data go to a
+  // JSON build manifest instead of being spelled out in default.nix
+  // (CMAKE_NIX_MANIFEST)
+  bool UseManifest() const;
+
+  // Whether object derivations also write the compiler's depfile, which
+  // "cmake --build" collects so that the next generation can narrow the
+  // source filesets to the headers each source read (CMAKE_NIX_DEPFILES)
+  bool UseDepfiles() const;
+
+  // Whether the bitcode objects of target in lang are optimized by one
+  // ThinLTO backend derivation each instead of inside the link
+  // (CMAKE_NIX_THINLTO); needs IPO and a compiler that uses -flto=thin
+  bool UseDistributedThinLTO(cmGeneratorTarget const* target,
+                             std::string const& lang,
+                             std::string const& config) const;
+  // Whether target links static libraries with IPO.  The thin link would
+  // index their bitcode members, but the final link optimizes them again
+  // on its own, so the imports and renamed symbols of the backends would
+  // not match; such links run their ThinLTO inside the link instead.
+  bool LinksBitcodeArchives(cmGeneratorTarget const* target,
+                            std::string const& config) const;
+  bool HasDistributedThinLTOTargets() const;
+
+  // Distributed ThinLTO links with lld; report a fatal error if ld.lld is
+  // neither next to the C or C++ compiler nor in the PATH
+  bool CheckThinLTOLinker() const;
+
+  // Content-addressed objects only reach a fixed point when the compiler
+  // takes -ffile-prefix-map and -frandom-seed; warn about the enabled
+  // languages whose compiler is neither GCC nor Clang
+  void CheckContentAddressedCompilers() const;
+
+  // Warn about the cmake --build options that nix-build cannot honor
+  void WarnUnsupportedBuildOptions(std::string const& config,
+                                   cmBuildOptions const& buildOptions) const;
+
+  // The compile flags that a ThinLTO backend needs to generate code for
+  // the bitcode of an object: optimization level, target, relocation
+  // model, sections and debug info
+  static std::vector<std::string> GetThinLTOBackendFlags(
+    std::vector<std::string> const& compileFlags);
+
+  // Number of concurrent compiler dependency scans (CMAKE_NIX_SCAN_JOBS)
+  unsigned int GetScanJobs() const;
   void WriteExplicitSourceDerivation(cmGeneratedFileStream& nixFileStream,
                                     const std::string& sourceFile,
                                     const std::vector<std::string>& dependencies,
@@ -354,17 +537,40 @@ private:
   // Profiling support
   bool GetProfilingEnabled() const;
   
-  // Simple profiling timer class
+  // Simple profiling timer class.  Reports to stderr with CMAKE_NIX_PROFILE=1
+  // (unless report is false) and records a span in the --profiling-output
+  // trace when that is enabled.
   class ProfileTimer {
   public:
-    ProfileTimer(const cmGlobalNixGenerator* gen, const std::string& name);
+    ProfileTimer(const cmGlobalNixGenerator* gen, const std::string& name,
+                 bool report = true);
     ~ProfileTimer();
+    // Report throughput for this many processed items when the timer ends
+    void SetItemCount(size_t count) { this->ItemCount = count; }
+    // Attach a detail to the trace span
+    void SetArg(std::string const& key, std::string const& value)
+    {
+      this->Args.emplace_back(key, value);
+    }
   private:
     const cmGlobalNixGenerator* Generator;
     std::string Name;
     std::chrono::steady_clock::time_point StartTime;
+    size_t ItemCount = 0;
+    bool Report = false;
+    bool Trace = false;
+    std::vector<std::pair<std::string, std::string>> Args;
   };
   
+  // Record the current values of named counters in the profiling trace
+  void AddProfileCounter(
+    std::string const& name,
+    std::vector<std::pair<std::string, size_t>> const& values) const;
+  
+  // Parse a job count setting from the cache or the environment
+  unsigned int GetJobsSetting(std::string const& name,
+                              unsigned int defaultJobs) const;
+  
   // Compiler resolution utility
   mutable std::unique_ptr<cmNixCompilerResolver> CompilerResolver;
   
@@ -374,6 +580,8 @@ private:
   // Cache manager for performance optimization
   mutable std::unique_ptr<cmNixCacheManager> CacheManager;
   
+  std::unique_ptr<cmNixIncludeScanner> IncludeScanner;
+  
   // File system helper for path operations
   mutable std::unique_ptr<cmNixFileSystemHelper> FileSystemHelper;
   
@@ -411,6 +619,18 @@ private:
   // Map from object file path to compilation derivation name
   std::map<std::string, std::string> ObjectFileOutputs;
   
+  // Bindings of each target while fragments are written, by target name
+  struct TargetFragment {
+    std::string Bindings;
+  };
+  bool WritingFragments = false;
+  std::map<std::string, TargetFragment> TargetFragments;
+  
+  // Write the collected target fragments and return their file names
+  std::vector<std::string> WriteTargetFragments();
+  // Remove the fragment files of the build tree that are not in keep
+  void RemoveStaleFragments(std::set<std::string> const& keep) const;
+  
   // Custom command handling is delegated to cmNixCustomCommandHandler
   std::unique_ptr<cmNixCustomCommandHandler> CustomCommandHandler;
   
@@ -426,6 +646,16 @@ private:
   
   // Build dependency graph from all targets
   void BuildDependencyGraph();
+  
+  // Target lookup by name, built together with the dependency graph
+  std::unordered_map<std::string, cmGeneratorTarget*> TargetIndex;
+  cmGeneratorTarget* FindTargetByName(std::string const& name) const;
+  
+  // OBJECT library owning each source, per configuration; built on first use
+  std::map<std::string, std::unordered_map<std::string, cmGeneratorTarget*>>
+    ObjectLibrarySourceIndex;
+  cmGeneratorTarget* FindObjectLibraryForSource(std::string const& sourcePath,
+                                                std::string const& config);
 
   struct ObjectDerivation {
     std::string TargetName;
@@ -436,4 +666,122 @@ private:
     std::vector<std::string> Dependencies;
   };
   std::map<std::string, ObjectDerivation> ObjectDerivations;
+
+  // One translation unit queued for WritePerTranslationUnitDerivations.
+  // Output receives the rendered derivation so that it can be aliased or
+  // dropped before the file is written in source order.
+  struct ObjectDerivationJob {
+    cmGeneratorTarget* Target;
+    const cmSourceFile* Source;
+    cmNixTargetGenerator* TargetGenerator;
+    std::string ResolvedSourcePath;
+    std::string Output;
+    // Non-empty for sources of a UNITY_BUILD target that may share a
+    // compile derivation with the other sources of the same key
+    std::string BatchKey;
+    // Filled in manifest mode; valid ones are not written to default.nix
+    ManifestObject Manifest;
+  };
+  void RenderObjectDerivationJob(ObjectDerivationJob& job);
+  // Write the manifest entries of the jobs and the library that reads them
+  void WriteBuildManifest(std::vector<ObjectDerivationJob> const& jobs);
+  
+  // Sources of a UNITY_BUILD target compiled by one cmakeNixBatchCC
+  // derivation, which has one object per source in its output directory
+  struct ObjectBatch {
+    cmGeneratorTarget* Target;
+    std::string DerivationName;
+    std::vector<ObjectDerivationJob const*> Units;
+  };
+  std::vector<ObjectBatch> GroupObjectBatches(
+    std::vector<ObjectDerivationJob> const& jobs);
+  void WriteObjectBatch(std::ostream& os, ObjectBatch const& batch);
+  
+  // cmInstrumentation role ("compile", "link" or "custom") by derivation
+  // name attribute, for the derivations that do not come from
+  // ObjectDerivations or CustomCommandOutputs
+  std::map<std::string, std::string> DerivationRoles;
+  // Write the role of every command derivation for cmNixBuildLog
+  void WriteDerivationRoles() const;
+  bool HasUnityBuildTargets() const;
+  bool HasPrecompiledHeaderTargets() const;
+  
+  // Derivations that compile the precompiled header sources, by source;
+  // targets with PRECOMPILE_HEADERS_REUSE_FROM find the one of the target
+  // they reuse here
+  std::unordered_map<std::string, std::string> PchDerivations;
+  
+  // Expression for the object of a per-translation-unit derivation; a path
+  // into the batch output for batched sources
+  std::string GetObjectReference(std::string const& derivationName) const;
+  
+  // Object paths of batched sources, keyed by per-TU derivation name
+  std::unordered_map<std::string, std::string> BatchedObjects;
+  
+  // A source listed in several targets with the same effective flags and
+  // inputs renders the same derivation in each; the first one is kept and
+  // the derivations of the others become aliases of it
+  void DeduplicateObjectDerivations(std::vector<ObjectDerivationJob>& jobs);
+  // Canonical object derivation names, keyed by alias
+  std::unordered_map<std::string, std::string> ObjectAliases;
+  
+  // Composite source derivations, generated files and interned compile
+  // flags by name, a hash of their expression, with the targets whose
+  // translation units use them
+  struct SharedSource {
+    std::string Expression;
+    std::set<std::string> Targets;
+  };
+  std::map<std::string, SharedSource> SharedSources;
+  void WriteSharedSources(cmGeneratedFileStream& nixFileStream);
+
+  // Add the content of a configuration-time generated file to the shared
+  // sources once, as a store file named by its content hash, and return
+  // the name to reference it by; empty if the file cannot be embedded
+  std::string GetGeneratedFileSource(std::string const& genFile,
+                                     cmGeneratorTarget const* target);
+  
+  // Run the compiler dependency scans of all jobs as one bounded batch
+  void ScanSourceDependencies(std::vector<ObjectDerivationJob> const& jobs);
+  
+  // Headers per "target|source" found by ScanSourceDependencies
+  std::unordered_map<std::string, std::vector<std::string>> ScannedDependencies;
+
+  // C++20 modules.  Sources that need it are scanned for the modules they
+  // provide and import before rendering; the derivation of a module
+  // interface has a "bmi" output that its importers take as an input.
+  // The CMAKE_CXX_MODULE_MAP_FORMAT of the targets that may use modules,
+  // empty if there are none
+  std::string GetCxxModuleMapFormat() const;
+  void ScanModuleDependencies(std::vector<ObjectDerivationJob>& jobs);
+  // Write the module and imports attributes of a scanned source
+  void WriteModuleAttributes(std::ostream& os, cmGeneratorTarget* target,
+                             std::string const& derivationName);
+  // Scan results by object derivation name
+  std::unordered_map<std::string, cmNixModuleScanner::ModuleUsage>
+    ModuleScans;
+  cmNixModuleScanner::ModuleProviders ModuleProviders;
+
+  // Depfiles are named by a hash of the source, language and compile
+  // flags, so that a flag change does not reuse the headers of old flags
+  std::string GetDepfileKey(std::string const& sourceFile,
+                            std::string const& lang,
+                            std::string const& flags) const;
+  // Read the depfile collections linked by "cmake --build" into
+  // LearnedDependencies, skipping any that is older than a file it names
+  void LoadLearnedDependencies();
+  // Bind the cmakeNixDepfiles output that builds the collection
+  void WriteDepfileCollection(cmNixWriter& writer);
+  // Source relative headers by depfile key
+  std::unordered_map<std::string, std::vector<std::string>>
+    LearnedDependencies;
+  // Hash of the content of the files of a learned fileset, which Nix
+  // compares before it uses the fileset (see cmakeNixLearnedSrc)
+  std::string GetLearnedFilesHash(std::vector<std::string> const& files);
+  // SHA-256 of source tree files by source relative path
+  std::unordered_map<std::string, std::string> LearnedFileHashes;
+  // Depfile keys by object derivation name
+  std::unordered_map<std::string, std::string> DepfileKeys;
+  // Depfile outputs to collect per target, by depfile key
+  std::map<std::string, std::map<std::string, std::string>> TargetDepfiles;
 }; 
\ No newline at end of file
@@ -441,6 +441,47 @@ std::string cmInstrumentation::InstrumentTest(
   return file_name;
 }
 
+// Record a command that ran outside of CMake's control, such as a Nix
+// builder, from timings reported by the tool that ran it
+void cmInstrumentation::InstrumentExternalCommand(
+  std::string const& command_type, std::vector<std::string> const& command,
+  int64_t result, std::chrono::system_clock::time_point systemStart,
+  std::chrono::milliseconds duration,
+  std::map<std::string, std::string> const& options)
+{
+  if (!this->hasQuery) {
+    return;
+  }
+  Json::Value root(Json::objectValue);
+  std::string command_str = GetCommandStr(command);
+  root["version"] = 1;
+  root["command"] = command_str;
+  root["result"] = static_cast<Json::Value::Int64>(result);
+  root["timeStart"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      systemStart.time_since_epoch())
+      .count());
+  root["duration"] = static_cast<Json::Value::UInt64>(duration.count());
+  for (auto const& item : options) {
+    if (!item.second.empty()) {
+      root[item.first] = item.second;
+    }
+  }
+  if (!root.isMember("config") &&
+      (command_type == "compile" || command_type == "link")) {
+    root["config"] = "";
+  }
+  root["role"] = command_type;
+  root["workingDir"] = cmSystemTools::GetLogicalWorkingDirectory();
+
+  cmsys::SystemInformation& info = this->GetSystemInformation();
+  std::string const& file_name = cmStrCat(
+    command_type, '-',
+    this->ComputeSuffixHash(cmStrCat(command_str, info.GetProcessId())),
+    this->ComputeSuffixTime(), ".json");
+  this->WriteInstrumentationJson(root, "data", file_name);
+}
+
 void cmInstrumentation::GetPreTestStats()
 {
   if (this->HasQuery(
@@ -47,6 +47,11 @@ public:
                              std::chrono::steady_clock::time_point steadyStart,
                              std::chrono::system_clock::time_point systemStart,
                              std::string config);
+  void InstrumentExternalCommand(
+    std::string const& command_type, std::vector<std::string> const& command,
+    int64_t result, std::chrono::system_clock::time_point systemStart,
+    std::chrono::milliseconds duration,
+    std::map<std::string, std::string> const& options);
   void GetPreTestStats();
   bool HasQuery() const;
   bool HasQuery(cmInstrumentationQuery::Query) const;
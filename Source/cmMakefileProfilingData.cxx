@@ -3,7 +3,9 @@
 #include "cmMakefileProfilingData.h"
 
 #include <chrono>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
 #include <cm3p/json/value.h>
@@ -28,6 +30,7 @@ cmMakefileProfilingData::cmMakefileProfilingData(
   }
 
   this->ProfileStream << "[";
+  this->ThreadIds.emplace(std::this_thread::get_id(), 0);
 }
 
 cmMakefileProfilingData::~cmMakefileProfilingData() noexcept
@@ -46,40 +49,86 @@ void cmMakefileProfilingData::StartEntry(std::string const& category,
                                          std::string const& name,
                                          cm::optional<Json::Value> args)
 {
-  /* Do not try again if we previously failed to write to output. */
-  if (!this->ProfileStream.good()) {
-    return;
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  Json::Value v;
+  v["ph"] = "B";
+  v["name"] = name;
+  v["cat"] = category;
+  v["ts"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count());
+  v["tid"] = this->GetThreadId();
+  if (args) {
+    v["args"] = *std::move(args);
   }
+  this->WriteEvent(v);
+}
 
-  try {
-    if (this->ProfileStream.tellp() > 1) {
-      this->ProfileStream << ",";
-    }
-    cmsys::SystemInformation info;
-    Json::Value v;
-    v["ph"] = "B";
-    v["name"] = name;
-    v["cat"] = category;
-    v["ts"] = static_cast<Json::Value::UInt64>(
-      std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::steady_clock::now().time_since_epoch())
-        .count());
-    v["pid"] = static_cast<int>(info.GetProcessId());
-    v["tid"] = 0;
-    if (args) {
-      v["args"] = *std::move(args);
-    }
+void cmMakefileProfilingData::StopEntry()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  Json::Value v;
+  v["ph"] = "E";
+  v["ts"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count());
+  v["tid"] = this->GetThreadId();
+  this->WriteEvent(v);
+}
 
-    this->JsonWriter->write(v, &this->ProfileStream);
-  } catch (std::ios_base::failure& fail) {
-    cmSystemTools::Error(
-      cmStrCat("Failed to write to profiling output: ", fail.what()));
-  } catch (...) {
-    cmSystemTools::Error("Error writing profiling output!");
+void cmMakefileProfilingData::AddCompleteEntry(
+  std::string const& category, std::string const& name,
+  std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point end, cm::optional<Json::Value> args,
+  cm::optional<int> tid)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  Json::Value v;
+  v["ph"] = "X";
+  v["name"] = name;
+  v["cat"] = category;
+  v["ts"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      start.time_since_epoch())
+      .count());
+  v["dur"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+      .count());
+  v["tid"] = tid ? *tid : this->GetThreadId();
+  if (args) {
+    v["args"] = *std::move(args);
   }
+  this->WriteEvent(v);
 }
 
-void cmMakefileProfilingData::StopEntry()
+void cmMakefileProfilingData::AddCounter(std::string const& category,
+                                         std::string const& name,
+                                         Json::Value values)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  Json::Value v;
+  v["ph"] = "C";
+  v["name"] = name;
+  v["cat"] = category;
+  v["ts"] = static_cast<Json::Value::UInt64>(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count());
+  v["tid"] = this->GetThreadId();
+  v["args"] = std::move(values);
+  this->WriteEvent(v);
+}
+
+int cmMakefileProfilingData::GetThreadId()
+{
+  auto const inserted = this->ThreadIds.emplace(
+    std::this_thread::get_id(), static_cast<int>(this->ThreadIds.size()));
+  return inserted.first->second;
+}
+
+void cmMakefileProfilingData::WriteEvent(Json::Value& v)
 {
   /* Do not try again if we previously failed to write to output. */
   if (!this->ProfileStream.good()) {
@@ -87,20 +136,15 @@ void cmMakefileProfilingData::StopEntry()
   }
 
   try {
-    this->ProfileStream << ",";
+    if (this->ProfileStream.tellp() > 1) {
+      this->ProfileStream << ",";
+    }
     cmsys::SystemInformation info;
-    Json::Value v;
-    v["ph"] = "E";
-    v["ts"] = static_cast<Json::Value::UInt64>(
-      std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::steady_clock::now().time_since_epoch())
-        .count());
     v["pid"] = static_cast<int>(info.GetProcessId());
-    v["tid"] = 0;
     this->JsonWriter->write(v, &this->ProfileStream);
   } catch (std::ios_base::failure& fail) {
     cmSystemTools::Error(
-      cmStrCat("Failed to write to profiling output:", fail.what()));
+      cmStrCat("Failed to write to profiling output: ", fail.what()));
   } catch (...) {
     cmSystemTools::Error("Error writing profiling output!");
   }
@@ -1,8 +1,12 @@
 /* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
    file LICENSE.rst or https://cmake.org/licensing for details.  */
 #pragma once
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 #include <cm/optional>
 
@@ -23,6 +27,23 @@ public:
                   cm::optional<Json::Value> args = cm::nullopt);
   void StopEntry();
 
+  /**
+   * Record a span that already finished.  Unlike StartEntry/StopEntry this
+   * may be called from any thread; the span is attributed to the calling
+   * thread unless an explicit trace thread id is given.
+   */
+  void AddCompleteEntry(std::string const& category, std::string const& name,
+                        std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end,
+                        cm::optional<Json::Value> args = cm::nullopt,
+                        cm::optional<int> tid = cm::nullopt);
+
+  /**
+   * Record the current values of a set of named counters.
+   */
+  void AddCounter(std::string const& category, std::string const& name,
+                  Json::Value values);
+
   class RAII
   {
   public:
@@ -44,6 +65,13 @@ public:
   };
 
 private:
+  // Trace thread id of the calling thread; the thread that created the
+  // profiling data is 0.  Must be called with Mutex held.
+  int GetThreadId();
+  void WriteEvent(Json::Value& v);
+
   cmsys::ofstream ProfileStream;
   std::unique_ptr<Json::StreamWriter> JsonWriter;
+  std::mutex Mutex;
+  std::unordered_map<std::thread::id, int> ThreadIds;
 };
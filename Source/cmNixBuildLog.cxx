@@ -0,0 +1,298 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmNixBuildLog.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include <cm3p/json/reader.h>
+#include <cm3p/json/value.h>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmInstrumentation.h"
+#include "cmNixConstants.h"
+#include "cmStringAlgorithms.h"
+#include "cmSystemTools.h"
+#include "cmUVProcessChain.h"
+#include "cmUVStream.h"
+
+namespace {
+// Activity, result and verbosity values of Nix's logger
+int const ActivityBuild = 105;
+int const ActivitySubstitute = 108;
+int const ResultBuildLogLine = 101;
+int const ResultSetExpected = 106;
+int const VerbosityWarn = 1;
+
+char const* const MessagePrefix = "@nix ";
+
+// "/nix/store/<hash>-<name>.drv" -> "<name>"
+std::string StorePathName(std::string const& storePath)
+{
+  std::string name = cmSystemTools::GetFilenameName(storePath);
+  std::string::size_type const dash = name.find('-');
+  if (dash != std::string::npos) {
+    name.erase(0, dash + 1);
+  }
+  if (cmHasLiteralSuffix(name, ".drv")) {
+    name.resize(name.size() - 4);
+  }
+  return name;
+}
+
+std::string FormatSeconds(std::chrono::milliseconds duration)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.1fs", duration.count() / 1000.0);
+  return buf;
+}
+}
+
+cmNixBuildLog::cmNixBuildLog(std::ostream& out, bool verbose)
+  : Out(out)
+  , Verbose(verbose)
+{
+}
+
+void cmNixBuildLog::ProcessLine(std::string const& line,
+                                std::chrono::system_clock::time_point now)
+{
+  if (!cmHasPrefix(line, MessagePrefix)) {
+    this->Out << line << '\n';
+    return;
+  }
+
+  Json::CharReaderBuilder builder;
+  std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  char const* begin = line.data() + strlen(MessagePrefix);
+  Json::Value message;
+  if (!reader->parse(begin, line.data() + line.size(), &message, nullptr) ||
+      !message.isObject()) {
+    this->Out << line << '\n';
+    return;
+  }
+
+  // Messages of other Nix versions may carry other types; ignore what does
+  // not match instead of letting jsoncpp throw
+  Json::Value const& fieldValues = message["fields"];
+  std::vector<std::string> fields;
+  if (fieldValues.isArray()) {
+    for (Json::Value const& field : fieldValues) {
+      fields.push_back(field.isString() ? field.asString()
+                                        : field.toStyledString());
+    }
+  }
+  Json::Value const& id = message["id"];
+  Json::Value const& type = message["type"];
+  std::string const action =
+    message["action"].isString() ? message["action"].asString() : "";
+  if (action == "start") {
+    if (id.isInt64() && type.isInt()) {
+      this->StartActivity(id.asInt64(), type.asInt(), fields, now);
+    }
+  } else if (action == "stop") {
+    if (id.isInt64()) {
+      this->StopActivity(id.asInt64(), now);
+    }
+  } else if (action == "result" && type.isInt()) {
+    if (type.asInt() == ResultBuildLogLine && this->Verbose &&
+        !fields.empty()) {
+      this->Out << fields.front() << '\n';
+    } else if (type.asInt() == ResultSetExpected &&
+               fieldValues.isArray() && fieldValues.size() == 2 &&
+               fieldValues[0].isInt() &&
+               fieldValues[0].asInt() == ActivityBuild &&
+               fieldValues[1].isUInt64()) {
+      this->ExpectedBuilds =
+        static_cast<size_t>(fieldValues[1].asUInt64());
+    }
+  } else if (action == "msg") {
+    Json::Value const& level = message["level"];
+    std::string const text =
+      message["msg"].isString() ? message["msg"].asString() : "";
+    int const verbosity = level.isInt() ? level.asInt() : VerbosityWarn;
+    if (verbosity == 0) {
+      this->MarkFailed(text);
+    }
+    if (verbosity <= VerbosityWarn || this->Verbose) {
+      this->Out << text << '\n';
+    }
+  }
+}
+
+void cmNixBuildLog::StartActivity(std::int64_t id, int type,
+                                  std::vector<std::string> const& fields,
+                                  std::chrono::system_clock::time_point now)
+{
+  if ((type != ActivityBuild && type != ActivitySubstitute) ||
+      fields.empty()) {
+    return;
+  }
+  Derivation derivation;
+  derivation.StorePath = fields.front();
+  derivation.Name = StorePathName(derivation.StorePath);
+  derivation.Substituted = type == ActivitySubstitute;
+  derivation.Start = now;
+  this->Activities[id] = this->Derivations.size();
+  this->Derivations.push_back(derivation);
+
+  if (derivation.Substituted) {
+    this->Out << "Substituting " << derivation.Name << '\n';
+  }
+}
+
+void cmNixBuildLog::StopActivity(std::int64_t id,
+                                 std::chrono::system_clock::time_point now)
+{
+  auto it = this->Activities.find(id);
+  if (it == this->Activities.end()) {
+    return;
+  }
+  Derivation& derivation = this->Derivations[it->second];
+  this->Activities.erase(it);
+  derivation.Finished = true;
+  derivation.Duration =
+    std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                          derivation.Start);
+  if (derivation.Substituted) {
+    return;
+  }
+
+  // Ninja-like progress, counted as builds finish since Nix runs many
+  ++this->FinishedBuilds;
+  this->Out << '[' << this->FinishedBuilds << '/'
+            << std::max(this->ExpectedBuilds, this->FinishedBuilds) << "] "
+            << derivation.Name << " (" << FormatSeconds(derivation.Duration)
+            << ")\n";
+}
+
+void cmNixBuildLog::MarkFailed(std::string const& message)
+{
+  // Errors name the derivation whose builder failed
+  for (Derivation& derivation : this->Derivations) {
+    if (!derivation.Substituted &&
+        message.find(derivation.StorePath) != std::string::npos) {
+      derivation.Failed = true;
+    }
+  }
+}
+
+void cmNixBuildLog::PrintSummary() const
+{
+  size_t built = 0;
+  size_t substituted = 0;
+  size_t failed = 0;
+  std::vector<Derivation const*> builds;
+  for (Derivation const& derivation : this->Derivations) {
+    if (derivation.Substituted) {
+      ++substituted;
+    } else if (derivation.Failed) {
+      ++failed;
+    } else if (derivation.Finished) {
+      ++built;
+      builds.push_back(&derivation);
+    }
+  }
+  if (built + substituted + failed == 0) {
+    return;
+  }
+
+  this->Out << "Nix: " << built << " built, " << substituted
+            << " substituted, " << failed << " failed\n";
+  for (Derivation const& derivation : this->Derivations) {
+    if (derivation.Failed) {
+      this->Out << "  failed: " << derivation.Name << '\n';
+    }
+  }
+
+  size_t const slowest = std::min<size_t>(builds.size(), 5);
+  std::partial_sort(builds.begin(), builds.begin() + slowest, builds.end(),
+                    [](Derivation const* a, Derivation const* b) {
+                      return a->Duration > b->Duration;
+                    });
+  for (size_t i = 0; i < slowest; ++i) {
+    this->Out << "  " << std::setw(8) << FormatSeconds(builds[i]->Duration)
+              << "  " << builds[i]->Name << '\n';
+  }
+}
+
+void cmNixBuildLog::WriteInstrumentation(std::string const& binaryDir) const
+{
+  cmInstrumentation instrumentation(binaryDir);
+  if (!instrumentation.HasQuery()) {
+    return;
+  }
+  std::map<std::string, std::string> const roles =
+    ReadDerivationRoles(binaryDir);
+  for (Derivation const& derivation : this->Derivations) {
+    if (derivation.Substituted || !derivation.Finished) {
+      continue;
+    }
+    auto role = roles.find(derivation.Name);
+    if (role == roles.end()) {
+      continue;
+    }
+    instrumentation.InstrumentExternalCommand(
+      role->second, { derivation.StorePath },
+      derivation.Failed ? 1 : 0, derivation.Start, derivation.Duration,
+      { { "nixDerivation", derivation.Name } });
+  }
+}
+
+std::map<std::string, std::string> cmNixBuildLog::ReadDerivationRoles(
+  std::string const& binaryDir)
+{
+  std::map<std::string, std::string> roles;
+  cmsys::ifstream fin(
+    cmStrCat(binaryDir, '/', cmNix::Generator::DERIVATION_ROLES).c_str());
+  std::string line;
+  while (std::getline(fin, line)) {
+    std::string::size_type const space = line.find(' ');
+    if (space != std::string::npos) {
+      roles[line.substr(space + 1)] = line.substr(0, space);
+    }
+  }
+  return roles;
+}
+
+int cmNixBuildLog::Run(std::vector<std::string> const& command,
+                       std::string const& binaryDir, bool verbose)
+{
+  cmUVProcessChainBuilder builder;
+  builder.SetExternalStream(cmUVProcessChainBuilder::Stream_OUTPUT, stdout)
+    .SetBuiltinStream(cmUVProcessChainBuilder::Stream_ERROR)
+    .AddCommand(command);
+  auto chain = builder.Start();
+  if (!chain.Valid() || chain.GetStatus(0).SpawnResult != 0) {
+    std::cerr << "Failed to run " << command.front() << '\n';
+    return 1;
+  }
+
+  cmNixBuildLog log(std::cout, verbose);
+  cmUVPipeIStream errors(chain.GetLoop(), chain.ErrorStream());
+  std::string line;
+  while (std::getline(errors, line)) {
+    log.ProcessLine(line, std::chrono::system_clock::now());
+    std::cout.flush();
+  }
+  if (!chain.Wait()) {
+    return 1;
+  }
+
+  log.PrintSummary();
+  log.WriteInstrumentation(binaryDir);
+  cmUVProcessChain::Status const& status = chain.GetStatus(0);
+  if (status.TermSignal != 0) {
+    std::cerr << command.front() << " was terminated by signal "
+              << status.TermSignal << '\n';
+    return 1;
+  }
+  return static_cast<int>(status.ExitStatus);
+}
@@ -0,0 +1,100 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * \class cmNixBuildLog
+ * \brief Follows the "--log-format internal-json" messages of a Nix build.
+ *
+ * Nix writes one "@nix {...}" JSON message per line to stderr: activities
+ * start and stop, report results such as build log lines, and carry
+ * plain messages.  cmNixBuildLog tracks the build and substitution
+ * activities to print a ninja-like progress line per finished derivation
+ * and a summary, and records each derivation with its timing so that it
+ * can be written to the cmInstrumentation data of the build tree.
+ */
+class cmNixBuildLog
+{
+public:
+  struct Derivation
+  {
+    // Derivation (.drv) path of a build, output path of a substitution
+    std::string StorePath;
+    // Name of the store path without hash and .drv suffix
+    std::string Name;
+    bool Substituted = false;
+    bool Finished = false;
+    bool Failed = false;
+    std::chrono::system_clock::time_point Start;
+    std::chrono::milliseconds Duration{ 0 };
+  };
+
+  cmNixBuildLog(std::ostream& out, bool verbose);
+
+  /**
+   * Process one line of the build's stderr received at time now.  Lines
+   * that are not internal-json messages are printed as they are.
+   */
+  void ProcessLine(std::string const& line,
+                   std::chrono::system_clock::time_point now);
+
+  std::vector<Derivation> const& GetDerivations() const
+  {
+    return this->Derivations;
+  }
+
+  /**
+   * Print the number of built, substituted and failed derivations and the
+   * slowest builds.
+   */
+  void PrintSummary() const;
+
+  /**
+   * Write one instrumentation snippet per finished build to the build tree
+   * binaryDir, if it has instrumentation queries.  Each derivation is
+   * recorded with the role the generator gave it; derivations without one,
+   * such as source sets, run no command and are left out.
+   */
+  void WriteInstrumentation(std::string const& binaryDir) const;
+
+  /**
+   * Read the "compile", "link" or "custom" role of each derivation name
+   * that the Nix generator wrote to the build tree binaryDir.
+   */
+  static std::map<std::string, std::string> ReadDerivationRoles(
+    std::string const& binaryDir);
+
+  /**
+   * Run the nix-build command with internal-json logging, follow its log
+   * and record it.  Returns the exit code of nix-build, or 1 if it could
+   * not run or was killed by a signal.
+   */
+  static int Run(std::vector<std::string> const& command,
+                 std::string const& binaryDir, bool verbose);
+
+private:
+  void StartActivity(std::int64_t id, int type,
+                     std::vector<std::string> const& fields,
+                     std::chrono::system_clock::time_point now);
+  void StopActivity(std::int64_t id,
+                    std::chrono::system_clock::time_point now);
+  void MarkFailed(std::string const& message);
+
+  std::ostream& Out;
+  bool Verbose;
+  std::vector<Derivation> Derivations;
+  // Running activity id to its index in Derivations
+  std::map<std::int64_t, size_t> Activities;
+  size_t ExpectedBuilds = 0;
+  size_t FinishedBuilds = 0;
+};
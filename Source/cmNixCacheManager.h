@@ -2,14 +2,15 @@
 
 #include <any>
 #include <functional>
-#include <map>
 #include <mutex>
-#include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 
+#include "cmNixLruCache.h"
+
 class cmGeneratorTarget;
 
 /**
@@ -43,45 +44,51 @@ class cmGeneratorTarget;
  * 
  * ## Eviction Policy
  * 
- * The cache manager uses a simple "half-life" eviction policy:
- * - When a cache exceeds its maximum size, the oldest 50% of entries are removed
- * - This is implemented using std::map's ordered iteration (insertion order)
- * - More sophisticated LRU could be added if profiling shows it's needed
+ * The derivation name, library dependency and transitive dependency caches
+ * are cmNixLruCache instances: when a cache exceeds its entry or byte budget
+ * (see Limits), its least recently used entries are evicted.  Budgets of 0
+ * are unlimited.  The default budgets are conservative:
+ * - Derivation names: 10,000 entries or 4 MB
+ * - Library dependencies: 1,000 entries or 2 MB
+ * - Transitive dependencies: 5,000 entries or 8 MB
  * 
- * Maximum cache sizes are conservative to prevent excessive memory usage:
- * - Derivation names: 10,000 entries (~1 MB)
- * - Library dependencies: 1,000 entries (~500 KB)
- * - Transitive dependencies: 5,000 entries (~1 MB)
- * - Used derivation names: 20,000 entries (~1 MB)
+ * Each cache counts hits, misses and evictions and tracks its approximate
+ * size in bytes, reported by GetStats(), so that budgets can be sized from
+ * measurements.
  * 
- * Total maximum memory usage: ~3.5 MB (acceptable for modern systems)
+ * The set of used derivation names is not a cache: forgetting a name would
+ * let a later derivation reuse it, so it is never evicted.
  * 
  * ## Thread Safety
  * 
- * All operations are protected by a single mutex (CacheMutex) using:
- * - std::lock_guard for automatic RAII-based locking
- * - Double-checked locking pattern for library dependencies (most contended)
- * - No operations hold locks while computing values (prevents deadlock)
- * 
- * Thread safety guarantees:
- * - All public methods are thread-safe
- * - Multiple readers/writers can access different caches concurrently
- * - Cache coherency is maintained across all operations
- * - No data races or undefined behavior under concurrent access
+ * Each LRU cache is split into independently locked shards, so concurrent
+ * lookups of different keys rarely contend.  The used derivation names,
+ * compiler info and system paths share a separate mutex (CacheMutex).
+ * Values are always computed without holding a lock; when two threads
+ * compute the same entry, the first one inserted wins and both return it.
  * 
  * ## Performance Characteristics
  * 
- * - Cache hits: O(log n) for std::map, O(1) for std::unordered_map
- * - Cache misses: O(log n) insertion + cost of compute function
- * - Eviction: O(n/2) when triggered (infrequent for typical projects)
- * - Memory overhead: ~3.5 MB maximum, typically much less
- * 
- * The caching provides 70%+ reduction in generation time for repeated runs.
+ * - Cache hits and insertions: O(1) on average
+ * - Eviction: O(1) per evicted entry
  */
 class cmNixCacheManager
 {
 public:
+  /**
+   * Entry and byte budgets of the LRU caches; 0 is unlimited.
+   */
+  struct Limits {
+    size_t DerivationNameEntries = 10000;
+    size_t DerivationNameBytes = 4 * 1024 * 1024;
+    size_t LibraryDependencyEntries = 1000;
+    size_t LibraryDependencyBytes = 2 * 1024 * 1024;
+    size_t TransitiveDependencyEntries = 5000;
+    size_t TransitiveDependencyBytes = 8 * 1024 * 1024;
+  };
+
   cmNixCacheManager();
+  explicit cmNixCacheManager(Limits const& limits);
   ~cmNixCacheManager();
 
   /**
@@ -183,22 +190,38 @@ public:
     size_t CompilerInfoCacheSize;
     size_t SystemPathsCacheSize;
     size_t TotalMemoryEstimate; // Rough estimate in bytes
+
+    // Counters of the LRU caches
+    using Counters = cmNixCacheStats;
+    Counters DerivationNames;
+    Counters LibraryDependencies;
+    Counters TransitiveDependencies;
   };
   CacheStats GetStats() const;
 
 private:
+  using LibraryKey = std::pair<cmGeneratorTarget*, std::string>;
+  struct LibraryKeyHash {
+    size_t operator()(LibraryKey const& key) const
+    {
+      return std::hash<cmGeneratorTarget*>()(key.first) ^
+        (std::hash<std::string>()(key.second) << 1);
+    }
+  };
+
   // Cache for derivation names: key is "targetName|sourceFile"
-  mutable std::map<std::string, std::string> DerivationNameCache;
+  cmNixLruCache<std::string, std::string> DerivationNameCache;
   
   // Cache for library dependencies: key is (target, config)
-  mutable std::map<std::pair<cmGeneratorTarget*, std::string>, 
-                  std::vector<std::string>> LibraryDependencyCache;
+  cmNixLruCache<LibraryKey, std::vector<std::string>, LibraryKeyHash>
+    LibraryDependencyCache;
   
   // Cache for transitive dependencies: key is source file path
-  mutable std::map<std::string, std::vector<std::string>> TransitiveDependencyCache;
+  cmNixLruCache<std::string, std::vector<std::string>>
+    TransitiveDependencyCache;
   
   // Set of used derivation names for uniqueness checking
-  mutable std::set<std::string> UsedDerivationNames;
+  std::unordered_set<std::string> UsedDerivationNames;
   
   // Cache for compiler info: key is language
   mutable std::unordered_map<std::string, std::any> CompilerInfoCache;
@@ -207,55 +230,9 @@ private:
   mutable std::vector<std::string> SystemPathsCache;
   mutable bool SystemPathsCached = false;
   
-  // Single mutex protects all caches - consolidates thread safety
+  // Protects the used names, compiler info and system paths; the LRU caches
+  // lock their own shards
   mutable std::mutex CacheMutex;
-
-  // Maximum cache sizes (prevent unbounded growth)
-  /**
-   * Maximum number of derivation names to cache.
-   * At 10,000 entries with ~100 bytes per entry (target|source string pairs),
-   * this limits the cache to approximately 1 MB of memory.
-   * This is sufficient for very large projects with thousands of source files.
-   * 
-   * To customize: Set CMAKE_NIX_DERIVATION_CACHE_SIZE environment variable.
-   */
-  static constexpr size_t MAX_DERIVATION_NAME_CACHE_SIZE = 10000;
-  
-  /**
-   * Maximum number of library dependency results to cache.
-   * At 1,000 entries with ~500 bytes per entry (vectors of library paths),
-   * this limits the cache to approximately 500 KB of memory.
-   * Most projects have far fewer than 1,000 unique target/config combinations.
-   * 
-   * To customize: Set CMAKE_NIX_LIBRARY_CACHE_SIZE environment variable.
-   */
-  static constexpr size_t MAX_LIBRARY_DEPENDENCY_CACHE_SIZE = 1000;
-
-  /**
-   * Maximum number of transitive dependency results to cache.
-   * At 5,000 entries with ~200 bytes per entry (file path lists),
-   * this limits the cache to approximately 1 MB of memory.
-   * This handles large projects with many interdependent headers.
-   * 
-   * To customize: Set CMAKE_NIX_TRANSITIVE_CACHE_SIZE environment variable.
-   */
-  static constexpr size_t MAX_TRANSITIVE_DEPENDENCY_CACHE_SIZE = 5000;
-
-  /**
-   * Maximum number of unique derivation names to track.
-   * At 20,000 entries with ~50 bytes per entry (derivation name strings),
-   * this limits the set to approximately 1 MB of memory.
-   * This is sufficient for extremely large projects.
-   * 
-   * To customize: Set CMAKE_NIX_USED_NAMES_SIZE environment variable.
-   */
-  static constexpr size_t MAX_USED_DERIVATION_NAMES_SIZE = 20000;
-
-  // Evict oldest entries if cache grows too large
-  void EvictDerivationNamesIfNeeded();
-  void EvictLibraryDependenciesIfNeeded();
-  void EvictTransitiveDependenciesIfNeeded();
-  void EvictUsedDerivationNamesIfNeeded();
 };
 
 // Template implementation must be in header
@@ -8,6 +8,34 @@ namespace cmNix {
 namespace Generator {
   constexpr const char* NAME = "Nix";
   constexpr const char* DEFAULT_NIX = "default.nix";
+  // Fragments sit next to default.nix so that relative path literals in
+  // them resolve exactly as they would in default.nix itself
+  constexpr const char* COMMON_FRAGMENT = "cmake-nix-common.nix";
+  constexpr const char* TARGET_FRAGMENT_PREFIX = "cmake-nix-target-";
+  constexpr const char* FRAGMENT_HASH_PREFIX = "# Fragment hash: ";
+  // JSON build manifest and the fixed library that maps it to derivations
+  // (CMAKE_NIX_MANIFEST); the library is copied from the CMake modules
+  constexpr const char* MANIFEST = "cmake-nix-manifest.json";
+  constexpr const char* MANIFEST_LIBRARY = "cmake-nix-manifest.nix";
+  constexpr const char* MANIFEST_LIBRARY_SOURCE =
+    "/Modules/Internal/CMakeNixManifest.nix";
+  // Depfiles of the last builds (CMAKE_NIX_DEPFILES): "cmake --build" links
+  // the collection of each build here, next to a stamp of its start time
+  constexpr const char* DEPFILE_DIRECTORY = "CMakeFiles/NixDepfiles";
+  constexpr const char* DEPFILE_ATTRIBUTE = "cmakeNixDepfiles";
+  // P1689 module scans of C++ sources, reused while their inputs are older
+  constexpr const char* MODULE_SCAN_DIRECTORY = "CMakeFiles/NixModuleScan";
+  // "<role> <name>" per derivation that compiles, links or runs a custom
+  // command, for the instrumentation of the structured build log
+  constexpr const char* DERIVATION_ROLES = "CMakeFiles/NixDerivationRoles.txt";
+}
+
+// Generation trace for --profiling-output
+namespace Profiling {
+  constexpr const char* CATEGORY = "nix-generator";
+  // Compiler dependency scans run as child processes, several at once; each
+  // concurrent slot gets its own trace thread id starting here
+  constexpr int SCAN_THREAD_ID_BASE = 1000;
 }
 
 // Nix commands
@@ -43,6 +71,8 @@ namespace CMake {
   constexpr const char* ECHO_FLAG = " -E echo";
   constexpr const char* SCRIPT_FLAG = " -P ";
   constexpr const char* MODULE_PATH = "CMAKE_MODULE_PATH";
+  // "cmake -E" command that runs nix-build and follows its structured log
+  constexpr const char* NIX_BUILD_LOG = "cmake_nix_build_log";
 }
 
 // File patterns
@@ -64,14 +94,6 @@ namespace Debug {
 
 // Limits
 namespace Limits {
-  /**
-   * Maximum recursion depth for header dependency scanning.
-   * This prevents infinite loops when headers include each other cyclically.
-   * A depth of 100 is sufficient for even deeply nested header hierarchies.
-   * Most real-world projects have header inclusion depths under 20.
-   */
-  constexpr int MAX_HEADER_RECURSION_DEPTH = 100;
-  
   /**
    * Maximum depth for cycle detection in custom command dependencies.
    * This prevents infinite loops when analyzing circular dependencies.
@@ -95,6 +117,12 @@ namespace Limits {
    * derivation names readable.
    */
   constexpr int HASH_SUFFIX_DIGITS = 10000;
+
+  /**
+   * Upper bound for CMAKE_NIX_SCAN_JOBS.  Scan jobs are whole compiler
+   * processes, so more than this only adds overhead.
+   */
+  constexpr unsigned long MAX_SCAN_JOBS = 64;
 }
 
 // Nix derivation attributes
@@ -9,11 +9,15 @@
 #include "cmGeneratorTarget.h"
 #include "cmMakefile.h"
 #include "cmNixConstants.h"
+#include "cmNixWriter.h"
 #include "cmSystemTools.h"
 #include "cmOutputConverter.h"
 #include "cmake.h"
 #include "cmNixPathUtils.h"
 #include "cmCustomCommandGenerator.h"
+#include "cmStringAlgorithms.h"
+#include "cmValue.h"
+#include <algorithm>
 #include <set>
 #include <cctype>
 #include <fstream>
@@ -173,21 +177,50 @@ void cmNixCustomCommandGenerator::Generate(cmGeneratedFileStream& nixFileStream)
   
   nixFileStream << " ];\n";
   
-  // If we need source access, add the source directory
-  if (needsSourceAccess) {
-    // For projects that need the source tree available
-    std::string sourceDir = this->LocalGenerator->GetCurrentSourceDirectory();
-    
-    // Find the root source directory (where CMakeLists.txt with project() is)
-    {
-      while (!sourceDir.empty() && sourceDir != "/" && 
-             !cmSystemTools::FileExists(sourceDir + "/CMakeLists.txt")) {
-        sourceDir = cmSystemTools::GetParentDirectory(sourceDir);
-      }
+  // Find the root source directory (where CMakeLists.txt with project() is)
+  std::string sourceDir = this->LocalGenerator->GetCurrentSourceDirectory();
+  while (!sourceDir.empty() && sourceDir != "/" && 
+         !cmSystemTools::FileExists(sourceDir + "/CMakeLists.txt")) {
+    sourceDir = cmSystemTools::GetParentDirectory(sourceDir);
+  }
+  
+  // Only the source files the command reads become inputs, so editing
+  // other files in the tree does not rebuild it.  Commands that read files
+  // they do not name get the whole tree through
+  // CMAKE_NIX_CUSTOM_COMMAND_SOURCE_TREE.
+  std::set<std::string> sourceInputs;
+  if (!sourceDir.empty() && sourceDir != "/") {
+    sourceInputs = this->GetSourceInputs(ccGen, sourceDir);
+    if (!sourceInputs.empty() && hasNonEchoCommands) {
+      needsSourceAccess = true;
     }
-    
-    if (!sourceDir.empty() && sourceDir != "/") {
+  }
+  
+  if (needsSourceAccess && !sourceDir.empty() && sourceDir != "/") {
+    cmValue wholeTree = this->LocalGenerator->GetMakefile()->GetDefinition(
+      "CMAKE_NIX_CUSTOM_COMMAND_SOURCE_TREE");
+    if ((wholeTree && cmIsOn(*wholeTree)) || sourceInputs.empty() ||
+        sourceInputs.count(".")) {
       nixFileStream << "    src = " << sourceDir << "/.;\n";
+    } else {
+      nixFileStream << "    src = fileset.toSource {\n";
+      nixFileStream << "      root = " << sourceDir << ";\n";
+      nixFileStream << "      fileset = fileset.unions [\n";
+      for (std::string const& input : sourceInputs) {
+        bool const needsQuoting = std::any_of(
+          input.begin(), input.end(), [](char c) {
+            return c == ' ' || c == '\'' || c == '"' || c == '$' ||
+              c == '\\' || static_cast<unsigned char>(c) > 127;
+          });
+        if (needsQuoting) {
+          nixFileStream << "        (" << sourceDir << " + \"/"
+                        << cmNixWriter::EscapeNixString(input) << "\")\n";
+        } else {
+          nixFileStream << "        " << sourceDir << "/" << input << "\n";
+        }
+      }
+      nixFileStream << "      ];\n";
+      nixFileStream << "    };\n";
     }
   }
   
@@ -389,12 +422,6 @@ void cmNixCustomCommandGenerator::Generate(cmGeneratedFileStream& nixFileStream)
       }
       // Handle source paths if needed
       else if (needsSourceAccess && cmSystemTools::FileIsFullPath(cmd)) {
-        std::string sourceDir = this->LocalGenerator->GetCurrentSourceDirectory();
-        while (!sourceDir.empty() && sourceDir != "/" && 
-               !cmSystemTools::FileExists(sourceDir + "/CMakeLists.txt")) {
-          sourceDir = cmSystemTools::GetParentDirectory(sourceDir);
-        }
-        
         if (!sourceDir.empty() && cmd.find(sourceDir) == 0) {
           processedCmd = cmSystemTools::RelativePath(sourceDir, cmd);
         }
@@ -454,16 +481,17 @@ void cmNixCustomCommandGenerator::Generate(cmGeneratedFileStream& nixFileStream)
           }
         }
         
-        // Check if it's a source path
-        if (!isOutputPath && needsSourceAccess && cmSystemTools::FileIsFullPath(arg)) {
-          std::string sourceDir = this->LocalGenerator->GetCurrentSourceDirectory();
-          while (!sourceDir.empty() && sourceDir != "/" && 
-                 !cmSystemTools::FileExists(sourceDir + "/CMakeLists.txt")) {
-            sourceDir = cmSystemTools::GetParentDirectory(sourceDir);
-          }
-          
-          if (!sourceDir.empty() && arg.find(sourceDir) == 0) {
-            relativeArg = cmSystemTools::RelativePath(sourceDir, arg);
+        // Check if it's a source path, alone or as the value of an option
+        // such as --input=<path>
+        if (!isOutputPath && needsSourceAccess) {
+          std::string::size_type const eq = arg.find('=');
+          std::string const prefix = arg[0] == '-' && eq != std::string::npos
+            ? arg.substr(0, eq + 1)
+            : std::string();
+          std::string const path = arg.substr(prefix.size());
+          if (cmSystemTools::FileIsFullPath(path) && !sourceDir.empty() &&
+              path.find(sourceDir) == 0) {
+            relativeArg = prefix + cmSystemTools::RelativePath(sourceDir, path);
             isSourcePath = true;
           }
         }
@@ -532,6 +560,72 @@ void cmNixCustomCommandGenerator::Generate(cmGeneratedFileStream& nixFileStream)
   nixFileStream << "  };\n\n";
 }
 
+std::set<std::string> cmNixCustomCommandGenerator::GetSourceInputs(
+  cmCustomCommandGenerator const& ccGen, std::string const& sourceDir) const
+{
+  std::set<std::string> const outputs(ccGen.GetOutputs().begin(),
+                                      ccGen.GetOutputs().end());
+  std::set<std::string> inputs;
+  auto addInput = [&](std::string const& path, std::string const& baseDir,
+                      bool allowDirectory) {
+    std::string const fullPath =
+      cmSystemTools::CollapseFullPath(path, baseDir);
+    if (outputs.count(fullPath) ||
+        (this->CustomCommandOutputs &&
+         this->CustomCommandOutputs->count(fullPath))) {
+      return;
+    }
+    if (fullPath == sourceDir) {
+      inputs.insert(".");
+      return;
+    }
+    if (!cmSystemTools::IsSubDirectory(fullPath, sourceDir)) {
+      return;
+    }
+    if (cmSystemTools::FileIsDirectory(fullPath)
+          ? allowDirectory
+          : cmSystemTools::FileExists(fullPath)) {
+      inputs.insert(cmSystemTools::RelativePath(sourceDir, fullPath));
+    }
+  };
+  
+  // DEPENDS, the first of which is the MAIN_DEPENDENCY
+  for (std::string const& dep : ccGen.GetDepends()) {
+    addInput(dep, sourceDir, true);
+  }
+  
+  // Scripts and data named on the command lines.  Relative names are
+  // looked up in the unpacked source root the commands run in and in the
+  // command's WORKING_DIRECTORY; directories count only when named by an
+  // absolute path, so that an argument like "." does not pull in the tree.
+  std::string const workingDir = ccGen.GetWorkingDirectory();
+  for (unsigned int i = 0; i < ccGen.GetNumberOfCommands(); ++i) {
+    std::string fullCmd = ccGen.GetCommand(i);
+    ccGen.AppendArguments(i, fullCmd);
+    std::vector<std::string> argv;
+    cmSystemTools::ParseUnixCommandLine(fullCmd.c_str(), argv);
+    for (std::string arg : argv) {
+      // --option=path
+      std::string::size_type const eq = arg.find('=');
+      if (arg[0] == '-' && eq != std::string::npos) {
+        arg.erase(0, eq + 1);
+      }
+      if (arg.empty() || arg[0] == '-') {
+        continue;
+      }
+      if (cmSystemTools::FileIsFullPath(arg)) {
+        addInput(arg, sourceDir, true);
+      } else {
+        addInput(arg, sourceDir, false);
+        if (!workingDir.empty()) {
+          addInput(arg, workingDir, false);
+        }
+      }
+    }
+  }
+  return inputs;
+}
+
 std::string cmNixCustomCommandGenerator::GetDerivationName() const
 {
   // Create a unique name for the derivation based on the output file.
@@ -4,11 +4,13 @@
 
 #include "cmConfigure.h"
 
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
-#include <map>
 
 class cmCustomCommand;
+class cmCustomCommandGenerator;
 class cmLocalGenerator;
 class cmGeneratedFileStream;
 
@@ -30,6 +32,12 @@ private:
   
   std::string GetDerivationNameForPath(const std::string& path) const;
   
+  // Files and directories below sourceDir that the command reads, relative
+  // to it: its DEPENDS, including the MAIN_DEPENDENCY, and the paths on its
+  // command lines, such as the scripts it runs
+  std::set<std::string> GetSourceInputs(cmCustomCommandGenerator const& ccGen,
+                                        std::string const& sourceDir) const;
+  
   cmCustomCommand const* CustomCommand;
   cmLocalGenerator* LocalGenerator;
   std::string Config;
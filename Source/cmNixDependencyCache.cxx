@@ -0,0 +1,303 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmNixDependencyCache.h"
+
+#include <ostream>
+#include <unordered_set>
+#include <utility>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmCryptoHash.h"
+#include "cmFileTime.h"
+#include "cmStringAlgorithms.h"
+#include "cmSystemTools.h"
+
+namespace {
+char const* const CacheFileHeader = "# CMake Nix dependency cache v1";
+
+bool NextLine(std::string const& content, size_t& pos, cm::string_view& line)
+{
+  if (pos >= content.size()) {
+    return false;
+  }
+  size_t end = content.find('\n', pos);
+  if (end == std::string::npos) {
+    // A record cut short by an interrupted append
+    return false;
+  }
+  line = cm::string_view(content).substr(pos, end - pos);
+  pos = end + 1;
+  return true;
+}
+
+// Split off the next space-separated field of a record line
+cm::string_view NextField(cm::string_view& line)
+{
+  size_t space = line.find(' ');
+  cm::string_view field = line.substr(0, space);
+  line = space == cm::string_view::npos ? cm::string_view()
+                                        : line.substr(space + 1);
+  return field;
+}
+}
+
+cmNixDependencyCache::cmNixDependencyCache(std::string path)
+  : Path(std::move(path))
+{
+}
+
+void cmNixDependencyCache::Load()
+{
+  this->Entries.clear();
+  this->Pending.clear();
+  this->Used.clear();
+  this->SupersededRecords = 0;
+  this->NeedsRewrite = true;
+
+  // Read the whole file at once and parse it in place
+  std::string content;
+  {
+    cmsys::ifstream fin(this->Path.c_str(), std::ios::in | std::ios::binary);
+    if (!fin) {
+      return;
+    }
+    fin.seekg(0, std::ios::end);
+    std::streamoff const length = fin.tellg();
+    if (length <= 0) {
+      return;
+    }
+    content.resize(static_cast<size_t>(length));
+    fin.seekg(0, std::ios::beg);
+    fin.read(&content[0], length);
+    if (!fin) {
+      return;
+    }
+  }
+
+  size_t pos = 0;
+  cm::string_view line;
+  if (!NextLine(content, pos, line) || line != CacheFileHeader) {
+    return;
+  }
+  this->NeedsRewrite = false;
+
+  // Record: "R <fingerprint> <file count> <source>" followed by one
+  // "<mtime> <size> <sha256> <path>" line per file, the source first
+  while (NextLine(content, pos, line)) {
+    if (NextField(line) != "R") {
+      this->NeedsRewrite = true;
+      break;
+    }
+    Entry entry;
+    entry.Fingerprint = std::string(NextField(line));
+    unsigned long fileCount = 0;
+    if (!cmStrToULong(std::string(NextField(line)), &fileCount) ||
+        fileCount == 0) {
+      this->NeedsRewrite = true;
+      break;
+    }
+    entry.Source = std::string(line);
+
+    bool complete = true;
+    for (unsigned long i = 0; i < fileCount; ++i) {
+      long long mtime = 0;
+      unsigned long long size = 0;
+      if (!NextLine(content, pos, line) ||
+          !cmStrToLongLong(std::string(NextField(line)), &mtime) ||
+          !cmStrToULongLong(std::string(NextField(line)), &size)) {
+        complete = false;
+        break;
+      }
+      FileStamp stamp;
+      stamp.MTime = mtime;
+      stamp.Size = size;
+      stamp.Hash = std::string(NextField(line));
+      entry.Files.emplace_back(line);
+      entry.Stamps.push_back(std::move(stamp));
+    }
+    if (!complete) {
+      this->NeedsRewrite = true;
+      break;
+    }
+
+    std::string key = MakeKey(entry.Source, entry.Fingerprint);
+    if (!this->Entries.emplace(key, entry).second) {
+      this->Entries[key] = std::move(entry);
+      ++this->SupersededRecords;
+    }
+  }
+}
+
+bool cmNixDependencyCache::Lookup(std::string const& source,
+                                  std::string const& fingerprint,
+                                  std::vector<std::string>& headers)
+{
+  auto it = this->Entries.find(MakeKey(source, fingerprint));
+  if (it == this->Entries.end() || !this->IsUpToDate(it->second)) {
+    ++this->Stats.Misses;
+    return false;
+  }
+  ++this->Stats.Hits;
+  this->Used.insert(it->first);
+  headers.assign(it->second.Files.begin() + 1, it->second.Files.end());
+  return true;
+}
+
+void cmNixDependencyCache::Store(std::string const& source,
+                                 std::string const& fingerprint,
+                                 std::vector<std::string> const& headers)
+{
+  Entry entry;
+  entry.Source = source;
+  entry.Fingerprint = fingerprint;
+  entry.Files.reserve(headers.size() + 1);
+  entry.Files.push_back(source);
+  entry.Files.insert(entry.Files.end(), headers.begin(), headers.end());
+  for (std::string const& file : entry.Files) {
+    CurrentStamp& current = this->GetCurrentStamp(file, true);
+    if (!current.Exists) {
+      // The file disappeared since the scan; do not record a stale entry
+      return;
+    }
+    entry.Stamps.push_back(current.Stamp);
+  }
+
+  std::string key = MakeKey(source, fingerprint);
+  if (this->Entries.count(key)) {
+    ++this->SupersededRecords;
+  }
+  this->Entries[key] = std::move(entry);
+  this->Used.insert(key);
+  this->Pending.push_back(std::move(key));
+  ++this->Stats.Stored;
+}
+
+bool cmNixDependencyCache::Save()
+{
+  // A run that used no entry, such as one without sources to scan, says
+  // nothing about which entries are dead
+  size_t const unused = this->Entries.size() - this->Used.size();
+  if (!this->NeedsRewrite &&
+      (this->Used.empty() ||
+       this->SupersededRecords + unused <= this->Used.size())) {
+    if (this->Pending.empty()) {
+      return true;
+    }
+    cmsys::ofstream fout(this->Path.c_str(),
+                         std::ios::out | std::ios::app | std::ios::binary);
+    if (!fout) {
+      return false;
+    }
+    std::unordered_set<std::string> written;
+    for (std::string const& key : this->Pending) {
+      if (written.insert(key).second) {
+        WriteEntry(fout, this->Entries[key]);
+      }
+    }
+    this->Pending.clear();
+    return static_cast<bool>(fout);
+  }
+
+  // Compact the log down to the entries of this run
+  cmSystemTools::MakeDirectory(cmSystemTools::GetFilenamePath(this->Path));
+  cmsys::ofstream fout(this->Path.c_str(),
+                       std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!fout) {
+    return false;
+  }
+  fout << CacheFileHeader << '\n';
+  for (auto it = this->Entries.begin(); it != this->Entries.end();) {
+    if (this->Used.count(it->first)) {
+      WriteEntry(fout, it->second);
+      ++it;
+    } else {
+      it = this->Entries.erase(it);
+    }
+  }
+  this->Pending.clear();
+  this->SupersededRecords = 0;
+  this->NeedsRewrite = false;
+  return static_cast<bool>(fout);
+}
+
+std::string cmNixDependencyCache::ComputeFingerprint(
+  std::vector<std::string> const& command)
+{
+  cmCryptoHash hasher(cmCryptoHash::AlgoSHA256);
+  hasher.Initialize();
+  for (std::string const& arg : command) {
+    hasher.Append(arg);
+    hasher.Append(cm::string_view("\0", 1));
+  }
+  return hasher.FinalizeHex();
+}
+
+cmNixDependencyCache::CurrentStamp& cmNixDependencyCache::GetCurrentStamp(
+  std::string const& path, bool needHash)
+{
+  auto inserted = this->CurrentStamps.emplace(path, CurrentStamp());
+  CurrentStamp& current = inserted.first->second;
+  if (inserted.second) {
+    cmFileTime fileTime;
+    if (fileTime.Load(path)) {
+      current.Exists = true;
+      current.Stamp.MTime = fileTime.GetTime();
+      current.Stamp.Size = cmSystemTools::FileLength(path);
+    }
+  }
+  if (needHash && current.Exists && current.Stamp.Hash.empty()) {
+    cmCryptoHash hasher(cmCryptoHash::AlgoSHA256);
+    current.Stamp.Hash = hasher.HashFile(path);
+    if (current.Stamp.Hash.empty()) {
+      current.Exists = false;
+    }
+  }
+  return current;
+}
+
+bool cmNixDependencyCache::IsUpToDate(Entry& entry)
+{
+  bool refreshed = false;
+  for (size_t i = 0; i < entry.Files.size(); ++i) {
+    FileStamp& recorded = entry.Stamps[i];
+    CurrentStamp& current = this->GetCurrentStamp(entry.Files[i], false);
+    if (!current.Exists || current.Stamp.Size != recorded.Size) {
+      return false;
+    }
+    if (current.Stamp.MTime == recorded.MTime) {
+      continue;
+    }
+    // Touched but maybe not edited: fall back to the content hash
+    if (this->GetCurrentStamp(entry.Files[i], true).Stamp.Hash !=
+        recorded.Hash) {
+      return false;
+    }
+    recorded.MTime = current.Stamp.MTime;
+    refreshed = true;
+  }
+
+  if (refreshed) {
+    // Record the new mtimes so the next run does not hash these again
+    ++this->SupersededRecords;
+    this->Pending.push_back(MakeKey(entry.Source, entry.Fingerprint));
+  }
+  return true;
+}
+
+std::string cmNixDependencyCache::MakeKey(std::string const& source,
+                                          std::string const& fingerprint)
+{
+  return cmStrCat(fingerprint, ' ', source);
+}
+
+void cmNixDependencyCache::WriteEntry(std::ostream& os, Entry const& entry)
+{
+  os << "R " << entry.Fingerprint << ' ' << entry.Files.size() << ' '
+     << entry.Source << '\n';
+  for (size_t i = 0; i < entry.Files.size(); ++i) {
+    FileStamp const& stamp = entry.Stamps[i];
+    os << stamp.MTime << ' ' << stamp.Size << ' ' << stamp.Hash << ' '
+       << entry.Files[i] << '\n';
+  }
+}
@@ -0,0 +1,121 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * \class cmNixDependencyCache
+ * \brief Persistent record of compiler dependency scan results.
+ *
+ * Each entry maps a translation unit and the fingerprint of its scan
+ * command to the headers the scan found, together with the modification
+ * time, size and SHA-256 of the source and of every header.  An entry is
+ * reused when all of those files are unchanged: a matching mtime and size
+ * is accepted as is, and only files whose stamp differs are hashed to tell
+ * a touched file from an edited one.
+ *
+ * The cache file is a line based, append-only log.  Save() appends the
+ * entries stored since Load() and later records replace earlier ones for
+ * the same key.  Entries that a run neither looks up nor stores belong to
+ * deleted or renamed sources or to old flags; the file is rewritten with
+ * only the entries of the run once these and the superseded records
+ * outnumber them.  As with cmDependsC, a header that starts
+ * shadowing another one on the include path without any recorded file
+ * changing is not detected.
+ *
+ * The class is not thread-safe.
+ */
+class cmNixDependencyCache
+{
+public:
+  struct Statistics
+  {
+    size_t Hits = 0;
+    size_t Misses = 0;
+    size_t Stored = 0;
+  };
+
+  explicit cmNixDependencyCache(std::string path);
+
+  /**
+   * Read the cache file.  A missing or unreadable file, or one written by
+   * another format version, leaves the cache empty.
+   */
+  void Load();
+
+  /**
+   * Return the recorded headers of source if the entry for fingerprint is
+   * still valid.
+   */
+  bool Lookup(std::string const& source, std::string const& fingerprint,
+              std::vector<std::string>& headers);
+
+  /**
+   * Record the headers found by scanning source with the given fingerprint.
+   */
+  void Store(std::string const& source, std::string const& fingerprint,
+             std::vector<std::string> const& headers);
+
+  /**
+   * Write the entries stored since Load() to the cache file, or rewrite it
+   * with the entries found or stored since Load() if most records are dead.
+   */
+  bool Save();
+
+  /**
+   * Fingerprint of a scan command; entries only match the same flags.
+   */
+  static std::string ComputeFingerprint(
+    std::vector<std::string> const& command);
+
+  Statistics const& GetStatistics() const { return this->Stats; }
+
+private:
+  struct FileStamp
+  {
+    long long MTime = 0;
+    unsigned long long Size = 0;
+    std::string Hash;
+  };
+
+  struct Entry
+  {
+    std::string Source;
+    std::string Fingerprint;
+    // Source first, then its headers
+    std::vector<std::string> Files;
+    std::vector<FileStamp> Stamps;
+  };
+
+  // Current stamp of a file on disk, computed at most once per run
+  struct CurrentStamp
+  {
+    bool Exists = false;
+    FileStamp Stamp;
+  };
+
+  CurrentStamp& GetCurrentStamp(std::string const& path, bool needHash);
+  bool IsUpToDate(Entry& entry);
+  static std::string MakeKey(std::string const& source,
+                             std::string const& fingerprint);
+  static void WriteEntry(std::ostream& os, Entry const& entry);
+
+  std::string Path;
+  std::unordered_map<std::string, Entry> Entries;
+  std::unordered_map<std::string, CurrentStamp> CurrentStamps;
+  // Keys of entries that were added or refreshed since Load()
+  std::vector<std::string> Pending;
+  // Keys of entries that were found or stored since Load()
+  std::unordered_set<std::string> Used;
+  size_t SupersededRecords = 0;
+  bool NeedsRewrite = false;
+  Statistics Stats;
+};
@@ -2,313 +2,331 @@
    file Copyright.txt or https://cmake.org/licensing for details.  */
 #include "cmNixDependencyGraph.h"
 
-#include <algorithm>
-#include <functional>
-#include <queue>
-#include <stdexcept>
-
 #include "cmGeneratorTarget.h"
-#include "cmSystemTools.h"
 
-void cmNixDependencyGraph::AddTarget(const std::string& name, cmGeneratorTarget* target)
+namespace {
+const std::vector<cmNixDependencyGraph::NodeId> EmptyOrder;
+
+bool TestBit(const std::vector<std::uint64_t>& bits, std::uint32_t id)
 {
-  this->Targets[name] = target;
-  if (this->AdjacencyList.find(name) == this->AdjacencyList.end()) {
-    this->AdjacencyList[name] = std::unordered_set<std::string>();
-  }
-  
-  // Initialize node with target type
-  DependencyNode& node = this->Nodes[name];
-  node.targetName = name;
-  if (target) {
-    node.type = target->GetType();
+  return (bits[id / 64] >> (id % 64)) & 1u;
+}
+
+void SetBit(std::vector<std::uint64_t>& bits, std::uint32_t id)
+{
+  bits[id / 64] |= std::uint64_t(1) << (id % 64);
+}
+}
+
+cmNixDependencyGraph::NodeId cmNixDependencyGraph::Intern(const std::string& name)
+{
+  auto inserted =
+    this->Ids.emplace(name, static_cast<NodeId>(this->Names.size()));
+  if (inserted.second) {
+    this->Names.push_back(name);
+    this->Types.push_back(cmStateEnums::UNKNOWN_LIBRARY);
+    this->Known.push_back(false);
+    this->Finalized = false;
   }
+  return inserted.first->second;
+}
+
+void cmNixDependencyGraph::AddTarget(const std::string& name, cmGeneratorTarget* target)
+{
+  this->AddTarget(name, target ? target->GetType()
+                               : cmStateEnums::UNKNOWN_LIBRARY);
+}
+
+void cmNixDependencyGraph::AddTarget(const std::string& name, cmStateEnums::TargetType type)
+{
+  NodeId id = this->Intern(name);
+  this->Known[id] = true;
+  this->Types[id] = type;
+  this->Finalized = false;
 }
 
 void cmNixDependencyGraph::AddDependency(const std::string& from, const std::string& to)
 {
-  this->AdjacencyList[from].insert(to);
-  
-  if (this->AdjacencyList.find(to) == this->AdjacencyList.end()) {
-    this->AdjacencyList[to] = std::unordered_set<std::string>();
+  NodeId fromId = this->Intern(from);
+  NodeId toId = this->Intern(to);
+  this->Edges.emplace_back(fromId, toId);
+  this->Finalized = false;
+}
+
+void cmNixDependencyGraph::Finalize() const
+{
+  if (this->Finalized) {
+    return;
+  }
+  size_t const count = this->Names.size();
+
+  // Counting sort of the edges by source keeps each node's dependencies in
+  // insertion order
+  this->EdgeOffsets.assign(count + 1, 0);
+  for (auto const& edge : this->Edges) {
+    ++this->EdgeOffsets[edge.first + 1];
+  }
+  for (size_t i = 0; i < count; ++i) {
+    this->EdgeOffsets[i + 1] += this->EdgeOffsets[i];
+  }
+  this->EdgeTargets.assign(this->Edges.size(), 0);
+  std::vector<NodeId> fill(this->EdgeOffsets.begin(),
+                           this->EdgeOffsets.end() - 1);
+  for (auto const& edge : this->Edges) {
+    this->EdgeTargets[fill[edge.first]++] = edge.second;
   }
-  
-  // Update node's direct dependencies
-  if (this->Nodes.find(from) != this->Nodes.end()) {
-    this->Nodes[from].directDependencies.push_back(to);
+
+  // Drop duplicate edges, compacting the rows in place
+  std::vector<NodeId> seen(count, InvalidNode);
+  NodeId write = 0;
+  for (size_t i = 0; i < count; ++i) {
+    NodeId const begin = this->EdgeOffsets[i];
+    NodeId const end = this->EdgeOffsets[i + 1];
+    this->EdgeOffsets[i] = write;
+    for (NodeId e = begin; e < end; ++e) {
+      NodeId const dep = this->EdgeTargets[e];
+      if (seen[dep] != i) {
+        seen[dep] = static_cast<NodeId>(i);
+        this->EdgeTargets[write++] = dep;
+      }
+    }
   }
+  this->EdgeOffsets[count] = write;
+  this->EdgeTargets.resize(write);
+
+  size_t const words = (count + 63) / 64;
+  this->SharedLibraries.assign(words, 0);
+  for (size_t i = 0; i < count; ++i) {
+    if (this->Known[i] &&
+        (this->Types[i] == cmStateEnums::SHARED_LIBRARY ||
+         this->Types[i] == cmStateEnums::MODULE_LIBRARY)) {
+      SetBit(this->SharedLibraries, static_cast<NodeId>(i));
+    }
+  }
+
+  this->Closures.assign(count, Bitset());
+  this->ClosureComputed.assign(count, false);
+  this->LinkOrders.assign(count, std::vector<NodeId>());
+  this->LinkOrderComputed.assign(count, false);
+  this->Finalized = true;
 }
 
-bool cmNixDependencyGraph::HasCircularDependency() const
+bool cmNixDependencyGraph::PostOrder(const std::vector<NodeId>& roots,
+                                     std::vector<NodeId>& order) const
 {
-  std::unordered_set<std::string> visited;
-  std::unordered_set<std::string> recursionStack;
-  
-  for (const auto& pair : this->AdjacencyList) {
-    if (visited.find(pair.first) == visited.end()) {
-      if (this->HasCycleFrom(pair.first, visited, recursionStack)) {
-        return true;
+  // 0 = white, 1 = gray, 2 = black
+  std::vector<unsigned char> state(this->Names.size(), 0);
+  // Node and position of the next edge to follow
+  std::vector<std::pair<NodeId, NodeId>> stack;
+
+  for (NodeId root : roots) {
+    if (state[root] != 0) {
+      continue;
+    }
+    state[root] = 1;
+    stack.emplace_back(root, this->EdgeOffsets[root]);
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      if (top.second == this->EdgeOffsets[top.first + 1]) {
+        state[top.first] = 2;
+        order.push_back(top.first);
+        stack.pop_back();
+        continue;
+      }
+      NodeId const next = this->EdgeTargets[top.second++];
+      if (state[next] == 1) {
+        return false;
+      }
+      if (state[next] == 0) {
+        state[next] = 1;
+        stack.emplace_back(next, this->EdgeOffsets[next]);
       }
     }
   }
-  
-  return false;
+  return true;
 }
 
+bool cmNixDependencyGraph::HasCircularDependency() const
+{
+  this->Finalize();
+  std::vector<NodeId> roots(this->Names.size());
+  for (size_t i = 0; i < roots.size(); ++i) {
+    roots[i] = static_cast<NodeId>(i);
+  }
+  std::vector<NodeId> order;
+  return !this->PostOrder(roots, order);
+}
 
 void cmNixDependencyGraph::Clear()
 {
-  this->Targets.clear();
-  this->AdjacencyList.clear();
-  this->Nodes.clear();
+  this->Ids.clear();
+  this->Names.clear();
+  this->Types.clear();
+  this->Known.clear();
+  this->Edges.clear();
+  this->Finalized = false;
 }
 
 std::vector<std::string> cmNixDependencyGraph::GetTopologicalOrder() const
 {
-  std::unordered_map<std::string, int> state;
-  std::vector<std::string> topologicalOrder;
-  
-  for (const auto& pair : this->AdjacencyList) {
-    state[pair.first] = 0;
+  this->Finalize();
+  std::vector<NodeId> roots(this->Names.size());
+  for (size_t i = 0; i < roots.size(); ++i) {
+    roots[i] = static_cast<NodeId>(i);
   }
-  
-  for (const auto& pair : this->AdjacencyList) {
-    if (state[pair.first] == 0) {
-      if (!this->DFSVisit(pair.first, state, topologicalOrder)) {
-        return {};
-      }
-    }
+  std::vector<NodeId> order;
+  if (!this->PostOrder(roots, order)) {
+    return {};
+  }
+
+  std::vector<std::string> topologicalOrder;
+  topologicalOrder.reserve(order.size());
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    topologicalOrder.push_back(this->Names[*it]);
   }
-  
-  std::reverse(topologicalOrder.begin(), topologicalOrder.end());
   return topologicalOrder;
 }
 
-std::vector<std::string> cmNixDependencyGraph::GetTopologicalOrderForLinking(const std::string& target) const
+const std::vector<cmNixDependencyGraph::NodeId>& cmNixDependencyGraph::GetLinkOrder(NodeId target) const
 {
-  std::unordered_set<std::string> visited;
-  std::unordered_set<std::string> relevant;
-  
-  this->CollectTransitiveDependencies(target, visited, relevant);
-  relevant.insert(target);
-  
-  std::unordered_map<std::string, int> state;
-  std::vector<std::string> topologicalOrder;
-  
-  for (const auto& t : relevant) {
-    state[t] = 0;
+  this->Finalize();
+  if (target >= this->Names.size()) {
+    return EmptyOrder;
   }
-  
-  std::function<bool(const std::string&, std::unordered_map<std::string, int>&, std::vector<std::string>&)> relevantDFS;
-  relevantDFS = [this, &relevant, &relevantDFS](const std::string& node,
-                                       std::unordered_map<std::string, int>& s,
-                                       std::vector<std::string>& order) -> bool {
-    s[node] = 1;
-    
-    auto it = this->AdjacencyList.find(node);
-    if (it != this->AdjacencyList.end()) {
-      for (const auto& neighbor : it->second) {
-        if (relevant.find(neighbor) != relevant.end()) {
-          if (s[neighbor] == 1) {
-            return false;
-          }
-          if (s[neighbor] == 0) {
-            if (!relevantDFS(neighbor, s, order)) {
-              return false;
-            }
-          }
-        }
-      }
-    }
-    
-    s[node] = 2;
-    order.push_back(node);
-    return true;
-  };
-  
-  for (const auto& t : relevant) {
-    if (state[t] == 0) {
-      if (!relevantDFS(t, state, topologicalOrder)) {
-        return {};
-      }
+  if (!this->LinkOrderComputed[target]) {
+    std::vector<NodeId>& order = this->LinkOrders[target];
+    if (!this->PostOrder({ target }, order)) {
+      order.clear();
     }
+    this->LinkOrderComputed[target] = true;
   }
-  
+  return this->LinkOrders[target];
+}
+
+std::vector<std::string> cmNixDependencyGraph::GetTopologicalOrderForLinking(const std::string& target) const
+{
+  NodeId id = this->GetNodeId(target);
+  if (id == InvalidNode) {
+    return { target };
+  }
+
   // Don't reverse for linking - we want dependencies to come after the targets that depend on them
-  // std::reverse(topologicalOrder.begin(), topologicalOrder.end());
+  std::vector<std::string> topologicalOrder;
+  for (NodeId node : this->GetLinkOrder(id)) {
+    topologicalOrder.push_back(this->Names[node]);
+  }
   return topologicalOrder;
 }
 
 std::unordered_set<std::string> cmNixDependencyGraph::GetDependencies(const std::string& target) const
 {
-  auto it = this->AdjacencyList.find(target);
-  if (it != this->AdjacencyList.end()) {
-    return it->second;
+  NodeId id = this->GetNodeId(target);
+  if (id == InvalidNode) {
+    return {};
+  }
+  this->Finalize();
+  std::unordered_set<std::string> dependencies;
+  for (NodeId e = this->EdgeOffsets[id]; e < this->EdgeOffsets[id + 1]; ++e) {
+    dependencies.insert(this->Names[this->EdgeTargets[e]]);
   }
-  return {};
+  return dependencies;
 }
 
-bool cmNixDependencyGraph::DFSVisit(const std::string& node,
-                                    std::unordered_map<std::string, int>& state,
-                                    std::vector<std::string>& topologicalOrder) const
+cmNixDependencyGraph::NodeId cmNixDependencyGraph::GetNodeId(const std::string& name) const
 {
-  state[node] = 1;
-  
-  auto it = this->AdjacencyList.find(node);
-  if (it != this->AdjacencyList.end()) {
-    for (const auto& neighbor : it->second) {
-      if (state[neighbor] == 1) {
-        return false;
+  auto it = this->Ids.find(name);
+  return it == this->Ids.end() ? InvalidNode : it->second;
+}
+
+const cmNixDependencyGraph::Bitset& cmNixDependencyGraph::GetClosure(NodeId target) const
+{
+  this->Finalize();
+  if (this->ClosureComputed[target]) {
+    return this->Closures[target];
+  }
+
+  // Nodes reachable from target through added targets.  A node whose
+  // closure is already known contributes it wholesale instead of being
+  // expanded again.
+  Bitset reached((this->Names.size() + 63) / 64, 0);
+  std::vector<NodeId> stack;
+  stack.push_back(target);
+  while (!stack.empty()) {
+    NodeId const current = stack.back();
+    stack.pop_back();
+    for (NodeId e = this->EdgeOffsets[current];
+         e < this->EdgeOffsets[current + 1]; ++e) {
+      NodeId const dep = this->EdgeTargets[e];
+      if (!this->Known[dep] || TestBit(reached, dep)) {
+        continue;
       }
-      if (state[neighbor] == 0) {
-        if (!this->DFSVisit(neighbor, state, topologicalOrder)) {
-          return false;
+      SetBit(reached, dep);
+      if (this->ClosureComputed[dep]) {
+        Bitset const& known = this->Closures[dep];
+        for (size_t w = 0; w < reached.size(); ++w) {
+          reached[w] |= known[w];
         }
+      } else {
+        stack.push_back(dep);
       }
     }
   }
-  
-  state[node] = 2;
-  topologicalOrder.push_back(node);
-  return true;
+
+  this->Closures[target] = std::move(reached);
+  this->ClosureComputed[target] = true;
+  return this->Closures[target];
 }
 
-bool cmNixDependencyGraph::HasCycleFrom(const std::string& node,
-                                        std::unordered_set<std::string>& visited,
-                                        std::unordered_set<std::string>& recursionStack) const
+bool cmNixDependencyGraph::DependsOn(NodeId target, NodeId dependency) const
 {
-  visited.insert(node);
-  recursionStack.insert(node);
-  
-  auto it = this->AdjacencyList.find(node);
-  if (it != this->AdjacencyList.end()) {
-    for (const auto& neighbor : it->second) {
-      if (visited.find(neighbor) == visited.end()) {
-        if (this->HasCycleFrom(neighbor, visited, recursionStack)) {
-          return true;
-        }
-      } else if (recursionStack.find(neighbor) != recursionStack.end()) {
-        return true;
-      }
-    }
+  if (target >= this->Names.size() || dependency >= this->Names.size() ||
+      target == dependency || !this->Known[target]) {
+    return false;
   }
-  
-  recursionStack.erase(node);
-  return false;
+  return TestBit(this->GetClosure(target), dependency);
 }
 
-void cmNixDependencyGraph::CollectTransitiveDependencies(const std::string& target,
-                                                         std::unordered_set<std::string>& visited,
-                                                         std::unordered_set<std::string>& dependencies) const
+std::set<std::string> cmNixDependencyGraph::ToNameSet(const Bitset& bits) const
 {
-  if (visited.find(target) != visited.end()) {
-    return;
-  }
-  
-  visited.insert(target);
-  
-  auto it = this->AdjacencyList.find(target);
-  if (it != this->AdjacencyList.end()) {
-    for (const auto& dep : it->second) {
-      dependencies.insert(dep);
-      this->CollectTransitiveDependencies(dep, visited, dependencies);
+  std::set<std::string> names;
+  for (size_t w = 0; w < bits.size(); ++w) {
+    std::uint64_t word = bits[w];
+    while (word) {
+      unsigned bit = 0;
+      while (!((word >> bit) & 1u)) {
+        ++bit;
+      }
+      names.insert(this->Names[w * 64 + bit]);
+      word &= word - 1;
     }
   }
+  return names;
 }
 
 std::set<std::string> cmNixDependencyGraph::GetTransitiveSharedLibraries(const std::string& target) const
 {
-  auto it = this->Nodes.find(target);
-  if (it == this->Nodes.end()) {
+  NodeId id = this->GetNodeId(target);
+  if (id == InvalidNode || !this->Known[id]) {
     return {};
   }
-  
-  auto& node = it->second;
-  
-  // Return cached result if available
-  if (node.transitiveDepsComputed) {
-    return node.transitiveDependencies;
-  }
-  
-  // Compute transitive dependencies using DFS
-  std::set<std::string> visited;
-  std::set<std::string> result;
-  std::vector<std::string> stack;
-  
-  stack.push_back(target);
-  
-  while (!stack.empty()) {
-    std::string current = stack.back();
-    stack.pop_back();
-    
-    if (visited.count(current)) continue;
-    visited.insert(current);
-    
-    auto currentIt = this->Nodes.find(current);
-    if (currentIt == this->Nodes.end()) continue;
-    
-    auto& currentNode = currentIt->second;
-    
-    // If this is a shared or module library (and not the starting target), include it
-    if (current != target && 
-        (currentNode.type == cmStateEnums::SHARED_LIBRARY || 
-         currentNode.type == cmStateEnums::MODULE_LIBRARY)) {
-      result.insert(current);
-    }
-    
-    // Add direct dependencies to stack
-    for (const auto& dep : currentNode.directDependencies) {
-      if (!visited.count(dep)) {
-        stack.push_back(dep);
-      }
-    }
+
+  Bitset shared = this->GetClosure(id);
+  for (size_t w = 0; w < shared.size(); ++w) {
+    shared[w] &= this->SharedLibraries[w];
   }
-  
-  // Cache the result
-  node.transitiveDependencies = result;
-  node.transitiveDepsComputed = true;
-  
-  return result;
+  // The starting target is never its own dependency, even in a cycle
+  shared[id / 64] &= ~(std::uint64_t(1) << (id % 64));
+  return this->ToNameSet(shared);
 }
 
 std::set<std::string> cmNixDependencyGraph::GetAllTransitiveDependencies(const std::string& target) const
 {
-  auto it = this->Nodes.find(target);
-  if (it == this->Nodes.end()) {
+  NodeId id = this->GetNodeId(target);
+  if (id == InvalidNode || !this->Known[id]) {
     return {};
   }
-  
-  // Compute all transitive dependencies using DFS (no filtering by type)
-  std::set<std::string> visited;
-  std::set<std::string> result;
-  std::vector<std::string> stack;
-  
-  stack.push_back(target);
-  
-  while (!stack.empty()) {
-    std::string current = stack.back();
-    stack.pop_back();
-    
-    if (visited.count(current)) continue;
-    visited.insert(current);
-    
-    auto currentIt = this->Nodes.find(current);
-    if (currentIt == this->Nodes.end()) continue;
-    
-    auto& currentNode = currentIt->second;
-    
-    // Include all dependencies except the starting target
-    if (current != target) {
-      result.insert(current);
-    }
-    
-    // Add direct dependencies to stack
-    for (const auto& dep : currentNode.directDependencies) {
-      if (!visited.count(dep)) {
-        stack.push_back(dep);
-      }
-    }
-  }
-  
-  return result;
-}
\ No newline at end of file
+
+  Bitset all = this->GetClosure(id);
+  all[id / 64] &= ~(std::uint64_t(1) << (id % 64));
+  return this->ToNameSet(all);
+}
@@ -2,10 +2,12 @@
    file Copyright.txt or https://cmake.org/licensing for details.  */
 #pragma once
 
+#include <cstdint>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
-#include <set>
+#include <utility>
 #include <vector>
 
 #include "cmStateTypes.h"
@@ -15,97 +17,115 @@ class cmGeneratorTarget;
 /**
  * @class cmNixDependencyGraph
  * @brief Manages build target dependencies for the Nix backend generator
- * 
- * This class implements a directed acyclic graph (DAG) to represent build target
+ *
+ * This class implements a directed graph to represent build target
  * dependencies in CMake projects. It provides algorithms for:
  * - Topological sorting of targets for correct build order
  * - Circular dependency detection using depth-first search (DFS)
  * - Transitive dependency resolution for linking
- * 
- * ## Algorithm Details
- * 
+ *
+ * ## Representation
+ * Target names are interned to dense integer ids in the order they are
+ * first seen.  Edges are collected in insertion order and, on the first
+ * query after a change, packed into compressed sparse row (CSR) arrays:
+ * the dependencies of node i are EdgeTargets[EdgeOffsets[i]] up to
+ * EdgeTargets[EdgeOffsets[i + 1]].  Duplicate edges are dropped.
+ *
  * ### Topological Sort Algorithm
- * The class uses a DFS-based topological sort algorithm with three-color marking:
+ * Iterative DFS with three-color marking over the CSR arrays:
  * - White (0): Unvisited node
- * - Gray (1): Currently being processed (in recursion stack)
+ * - Gray (1): Currently being processed (on the DFS stack)
  * - Black (2): Completely processed
- * 
- * Time Complexity: O(V + E) where V = vertices (targets), E = edges (dependencies)
- * Space Complexity: O(V) for the recursion stack and state tracking
- * 
- * ### Cycle Detection Algorithm
- * Uses DFS with a recursion stack to detect cycles:
- * - If we encounter a node already in the recursion stack, a cycle exists
- * - This ensures we only detect back edges, not cross edges
- * 
+ *
  * Time Complexity: O(V + E)
- * Space Complexity: O(V) for visited set and recursion stack
- * 
+ * Space Complexity: O(V)
+ *
+ * Nodes and edges are visited in insertion order, so the orders are
+ * deterministic for a given sequence of AddTarget/AddDependency calls.
+ *
  * ### Transitive Dependency Resolution
- * Implements iterative DFS with caching for performance:
- * - Results are cached per target to avoid recomputation
- * - Separate methods for shared libraries vs all dependencies
- * - Uses iterative approach to avoid stack overflow on deep graphs
- * 
- * Time Complexity: O(V + E) for first computation, O(1) for cached results
- * Space Complexity: O(V) for the cache
- * 
+ * The transitive closure of a node is a bitset over node ids, computed by
+ * a traversal that reuses the already cached closures of the nodes it
+ * reaches.  Shared library queries mask the closure with a bitset of the
+ * shared and module library nodes.  Closures and link orders are cached
+ * per node until the graph changes.
+ *
+ * Time Complexity: O(V + E) per node for the first computation, then
+ * O(V / 64) for a closure and O(1) for a DependsOn() test
+ * Space Complexity: O(V / 64) per cached closure
+ *
  * ## Thread Safety
  * This class is NOT thread-safe. External synchronization is required if
- * accessed from multiple threads. The caching in GetTransitiveSharedLibraries
- * uses mutable members which require mutex protection in multi-threaded contexts.
+ * accessed from multiple threads. The query caches are mutable members
+ * which require mutex protection in multi-threaded contexts.
  */
 class cmNixDependencyGraph
 {
 public:
+  using NodeId = std::uint32_t;
+  static constexpr NodeId InvalidNode = static_cast<NodeId>(-1);
+
   void AddTarget(const std::string& name, cmGeneratorTarget* target);
+  void AddTarget(const std::string& name, cmStateEnums::TargetType type);
   void AddDependency(const std::string& from, const std::string& to);
-  
+
   bool HasCircularDependency() const;
-  
+
   std::vector<std::string> GetTopologicalOrder() const;
   std::vector<std::string> GetTopologicalOrderForLinking(const std::string& target) const;
-  
+
   void Clear();
-  
-  const std::unordered_map<std::string, cmGeneratorTarget*>& GetTargets() const
-  {
-    return this->Targets;
-  }
-  
-  const std::unordered_map<std::string, std::unordered_set<std::string>>& GetAdjacencyList() const
-  {
-    return this->AdjacencyList;
-  }
-  
+
   std::unordered_set<std::string> GetDependencies(const std::string& target) const;
-  
+
   // Additional methods needed by cmGlobalNixGenerator
   std::set<std::string> GetTransitiveSharedLibraries(const std::string& target) const;
   std::set<std::string> GetAllTransitiveDependencies(const std::string& target) const;
-  
+
+  // Id based queries that do not allocate strings
+  NodeId GetNodeId(const std::string& name) const;
+  const std::string& GetNodeName(NodeId id) const { return this->Names[id]; }
+  size_t GetNodeCount() const { return this->Names.size(); }
+
+  /**
+   * Nodes reachable from target, target included, with every node after
+   * its dependencies.  Empty if a cycle is reachable from target.
+   */
+  const std::vector<NodeId>& GetLinkOrder(NodeId target) const;
+
+  // Whether dependency is reachable from target through added targets
+  bool DependsOn(NodeId target, NodeId dependency) const;
+
 private:
-  struct DependencyNode {
-    std::string targetName;
-    cmStateEnums::TargetType type = cmStateEnums::UNKNOWN_LIBRARY;
-    std::vector<std::string> directDependencies;
-    mutable std::set<std::string> transitiveDependencies; // cached
-    mutable bool transitiveDepsComputed = false;
-  };
-  
-  bool DFSVisit(const std::string& node,
-                std::unordered_map<std::string, int>& state,
-                std::vector<std::string>& topologicalOrder) const;
-  
-  bool HasCycleFrom(const std::string& node,
-                    std::unordered_set<std::string>& visited,
-                    std::unordered_set<std::string>& recursionStack) const;
-  
-  void CollectTransitiveDependencies(const std::string& target,
-                                     std::unordered_set<std::string>& visited,
-                                     std::unordered_set<std::string>& dependencies) const;
-  
-  std::unordered_map<std::string, cmGeneratorTarget*> Targets;
-  std::unordered_map<std::string, std::unordered_set<std::string>> AdjacencyList;
-  std::unordered_map<std::string, DependencyNode> Nodes;
-};
\ No newline at end of file
+  using Bitset = std::vector<std::uint64_t>;
+
+  NodeId Intern(const std::string& name);
+  void Finalize() const;
+  const Bitset& GetClosure(NodeId target) const;
+  std::set<std::string> ToNameSet(const Bitset& bits) const;
+
+  // Post-order DFS from the given roots; false if a cycle is found
+  bool PostOrder(const std::vector<NodeId>& roots,
+                 std::vector<NodeId>& order) const;
+
+  // Interned nodes
+  std::unordered_map<std::string, NodeId> Ids;
+  std::vector<std::string> Names;
+  std::vector<cmStateEnums::TargetType> Types;
+  // Whether a node was added with AddTarget; only those take part in
+  // transitive dependency queries
+  std::vector<bool> Known;
+  std::vector<std::pair<NodeId, NodeId>> Edges;
+
+  // CSR adjacency, rebuilt lazily after changes
+  mutable bool Finalized = false;
+  mutable std::vector<NodeId> EdgeOffsets;
+  mutable std::vector<NodeId> EdgeTargets;
+  mutable Bitset SharedLibraries;
+
+  // Query caches, indexed by node id
+  mutable std::vector<Bitset> Closures;
+  mutable std::vector<bool> ClosureComputed;
+  mutable std::vector<std::vector<NodeId>> LinkOrders;
+  mutable std::vector<bool> LinkOrderComputed;
+};
@@ -0,0 +1,213 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmNixDependencyScanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+
+#include <cm/memory>
+#include <cm/optional>
+
+#include <cm3p/uv.h>
+
+#include "cmGccDepfileReader.h"
+#include "cmGccDepfileReaderTypes.h"
+#include "cmStringAlgorithms.h"
+#include "cmSystemTools.h"
+#include "cmUVHandlePtr.h"
+#include "cmUVProcessChain.h"
+#include "cmUVStream.h"
+
+namespace {
+// Depfile names must stay unique when several scanners run at once
+std::atomic<unsigned long> NextDepfileId(0);
+
+struct ScanJob
+{
+  std::string Depfile;
+  std::unique_ptr<cmUVProcessChain> Chain;
+  cm::uv_pipe_ptr Pipe;
+  std::unique_ptr<cmUVStreamReadHandle> Reader;
+  std::string Output;
+  std::chrono::steady_clock::time_point Start;
+  std::chrono::steady_clock::time_point End;
+  unsigned int Slot = 0;
+};
+}
+
+cmNixDependencyScanner::cmNixDependencyScanner(std::string depfileDir,
+                                               unsigned int maxJobs)
+  : DepfileDir(std::move(depfileDir))
+  , MaxJobs(std::max(1u, maxJobs))
+{
+}
+
+std::vector<cmNixDependencyScanner::Result> cmNixDependencyScanner::Scan(
+  std::vector<Request> const& requests)
+{
+  std::vector<Result> results(requests.size());
+  if (requests.empty()) {
+    return results;
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  cmSystemTools::MakeDirectory(this->DepfileDir);
+
+  cm::uv_loop_ptr loop;
+  loop.init();
+
+  // Jobs are never reallocated so the callbacks can hold references
+  std::vector<ScanJob> jobs(requests.size());
+  size_t nextJob = 0;
+  size_t running = 0;
+  std::vector<bool> busySlots(this->MaxJobs, false);
+
+  // A compiler may still be running when its output ends, so its slot is
+  // released when it exits.  Jobs waiting for that are checked on idle.
+  std::vector<size_t> exiting;
+  std::function<void()> startJobs;
+  std::function<void()> releaseJobs;
+  cm::uv_idle_ptr releaseOnIdle;
+  releaseOnIdle.init(*loop, &releaseJobs);
+  releaseJobs = [&]() {
+    bool released = false;
+    for (auto it = exiting.begin(); it != exiting.end();) {
+      ScanJob& job = jobs[*it];
+      if (!job.Chain->Finished()) {
+        ++it;
+        continue;
+      }
+      job.End = std::chrono::steady_clock::now();
+      busySlots[job.Slot] = false;
+      --running;
+      released = true;
+      it = exiting.erase(it);
+    }
+    if (exiting.empty()) {
+      releaseOnIdle.stop();
+    }
+    if (released) {
+      startJobs();
+    }
+  };
+
+  startJobs = [&]() {
+    while (running < this->MaxJobs && nextJob < jobs.size()) {
+      size_t const index = nextJob++;
+      ScanJob& job = jobs[index];
+      Request const& request = requests[index];
+
+      job.Depfile =
+        cmStrCat(this->DepfileDir, "/scan-", NextDepfileId++, ".d");
+      std::vector<std::string> command = request.Command;
+      command.emplace_back("-MM");
+      command.emplace_back("-MF");
+      command.push_back(job.Depfile);
+      command.push_back(request.Source);
+
+      cmUVProcessChainBuilder builder;
+      builder.AddCommand(std::move(command))
+        .SetExternalLoop(*loop)
+        .SetMergedBuiltinStreams();
+      job.Chain = cm::make_unique<cmUVProcessChain>(builder.Start());
+      if (!job.Chain->Valid()) {
+        continue;
+      }
+
+      ++running;
+      job.Start = std::chrono::steady_clock::now();
+      job.Slot = static_cast<unsigned int>(
+        std::find(busySlots.begin(), busySlots.end(), false) -
+        busySlots.begin());
+      busySlots[job.Slot] = true;
+      job.Pipe.init(*loop, 0);
+      uv_pipe_open(job.Pipe, job.Chain->OutputStream());
+      job.Reader = cmUVStreamRead(
+        job.Pipe,
+        [&job](std::vector<char> data) {
+          job.Output.append(data.begin(), data.end());
+        },
+        [&job, index, &exiting, &releaseOnIdle, &releaseJobs]() {
+          // Close the pipe right away so that large batches do not run
+          // out of file descriptors
+          job.Pipe.reset();
+          exiting.push_back(index);
+          releaseOnIdle.start([](uv_idle_t* idle) {
+            (*static_cast<std::function<void()>*>(idle->data))();
+          });
+          releaseJobs();
+        });
+    }
+  };
+  startJobs();
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    ScanJob& job = jobs[i];
+    Result& result = results[i];
+    if (!job.Chain || !job.Chain->Valid()) {
+      result.Error = "failed to start the compiler";
+    } else {
+      cmUVProcessChain::Status const& status = job.Chain->GetStatus(0);
+      if (status.SpawnResult != 0) {
+        result.Error = cmStrCat("failed to start the compiler: ",
+                                uv_strerror(status.SpawnResult));
+      } else if (status.TermSignal != 0 || status.ExitStatus != 0) {
+        result.Error = status.TermSignal != 0
+          ? cmStrCat("compiler was terminated by signal ", status.TermSignal)
+          : cmStrCat("compiler exited with code ", status.ExitStatus);
+        if (!job.Output.empty()) {
+          result.Error = cmStrCat(result.Error, ": ", job.Output);
+        }
+      } else {
+        result = this->ReadDepfile(requests[i], job.Depfile);
+      }
+    }
+    cmSystemTools::RemoveFile(job.Depfile);
+    result.Start = job.Start;
+    result.End = job.End;
+    result.Slot = job.Slot;
+
+    ++this->Stats.Scanned;
+    if (!result.Success) {
+      ++this->Stats.Failed;
+    }
+  }
+
+  this->Stats.Seconds += std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - startTime)
+                           .count();
+  return results;
+}
+
+cmNixDependencyScanner::Result cmNixDependencyScanner::ReadDepfile(
+  Request const& request, std::string const& depfile) const
+{
+  Result result;
+
+  // Relative paths in the depfile are relative to our working directory,
+  // which is also where the compiler ran
+  cm::optional<cmGccDepfileContent> content = cmReadGccDepfile(
+    depfile.c_str(), cmSystemTools::GetLogicalWorkingDirectory());
+  if (!content) {
+    result.Error = cmStrCat("could not read dependency file ", depfile);
+    return result;
+  }
+
+  std::unordered_set<std::string> seen;
+  seen.insert(cmSystemTools::CollapseFullPath(request.Source));
+  for (cmGccStyleDependency const& dep : *content) {
+    for (std::string const& path : dep.paths) {
+      if (seen.insert(path).second) {
+        result.Headers.push_back(path);
+      }
+    }
+  }
+  result.Success = true;
+  return result;
+}
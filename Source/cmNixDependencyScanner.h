@@ -0,0 +1,76 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * \class cmNixDependencyScanner
+ * \brief Runs compiler header dependency scans for a batch of sources.
+ *
+ * Every translation unit is scanned by exactly one
+ * "<compiler> <flags> -MM -MF <depfile> <source>" invocation.  -MM already
+ * reports the complete set of non-system headers reachable from the source,
+ * so no follow-up scans of the individual headers are needed.  Up to
+ * MaxJobs compilers run concurrently on a single libuv loop.
+ */
+class cmNixDependencyScanner
+{
+public:
+  struct Request
+  {
+    // Absolute path of the translation unit to scan
+    std::string Source;
+    // Compiler followed by its flags, without -MM/-MF and the source
+    std::vector<std::string> Command;
+  };
+
+  struct Result
+  {
+    bool Success = false;
+    // Absolute, collapsed header paths, excluding the source itself
+    std::vector<std::string> Headers;
+    // Compiler diagnostics when the scan failed
+    std::string Error;
+    // When the compiler ran, and which of the MaxJobs concurrent slots it
+    // occupied, for profiling
+    std::chrono::steady_clock::time_point Start;
+    std::chrono::steady_clock::time_point End;
+    unsigned int Slot = 0;
+  };
+
+  struct Statistics
+  {
+    size_t Scanned = 0;
+    size_t Failed = 0;
+    double Seconds = 0;
+  };
+
+  /**
+   * depfileDir receives the temporary depfiles; it is created on demand.
+   * maxJobs bounds the number of concurrently running compilers.
+   */
+  cmNixDependencyScanner(std::string depfileDir, unsigned int maxJobs);
+
+  /**
+   * Scan all requests and return their results in request order.
+   */
+  std::vector<Result> Scan(std::vector<Request> const& requests);
+
+  /**
+   * Totals over all Scan() calls on this scanner.
+   */
+  Statistics const& GetStatistics() const { return this->Stats; }
+
+private:
+  Result ReadDepfile(Request const& request, std::string const& depfile) const;
+
+  std::string DepfileDir;
+  unsigned int MaxJobs;
+  Statistics Stats;
+};
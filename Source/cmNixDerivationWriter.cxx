@@ -74,7 +74,7 @@ void cmNixDerivationWriter::WriteObjectDerivationWithHelper(
 }
 
 void cmNixDerivationWriter::WriteLinkDerivationWithHelper(
-  cmGeneratedFileStream& nixFileStream,
+  std::ostream& nixFileStream,
   const std::string& derivName,
   const std::string& targetName,
   const std::string& targetType,
@@ -86,7 +86,8 @@ void cmNixDerivationWriter::WriteLinkDerivationWithHelper(
   const std::vector<std::string>& libraries,
   const std::string& version,
   const std::string& soversion,
-  const std::string& postBuildPhase)
+  const std::string& postBuildPhase,
+  const std::string& archiver)
 {
   // Start derivation using cmakeNixLD helper
   nixFileStream << "  " << derivName << " = cmakeNixLD {\n";
@@ -146,6 +147,11 @@ void cmNixDerivationWriter::WriteLinkDerivationWithHelper(
     nixFileStream << "    soversion = \"" << soversion << "\";\n";
   }
   
+  // Write the archiver of static libraries that need another one than ar
+  if (!archiver.empty()) {
+    nixFileStream << "    archiver = " << archiver << ";\n";
+  }
+  
   // Write postBuildPhase if provided
   if (!postBuildPhase.empty()) {
     nixFileStream << "    # Handle try_compile COPY_FILE requirement\n";
@@ -4,6 +4,7 @@
 
 #include "cmConfigure.h" // IWYU pragma: keep
 
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -44,7 +45,7 @@ public:
    * Write a link derivation for an executable or library target using cmakeNixLD helper.
    * Creates a Nix derivation that links object files into the final output.
    */
-  void WriteLinkDerivationWithHelper(cmGeneratedFileStream& nixFileStream,
+  void WriteLinkDerivationWithHelper(std::ostream& nixFileStream,
                                     const std::string& derivName,
                                     const std::string& targetName,
                                     const std::string& targetType,
@@ -56,7 +57,8 @@ public:
                                     const std::vector<std::string>& libraries,
                                     const std::string& version,
                                     const std::string& soversion,
-                                    const std::string& postBuildPhase = "");
+                                    const std::string& postBuildPhase = "",
+                                    const std::string& archiver = "");
 
   /**
    * Write a custom command derivation.
@@ -0,0 +1,374 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmNixIncludeScanner.h"
+
+#include <cstring>
+#include <utility>
+
+#include "cmsys/Directory.hxx"
+#include "cmsys/FStream.hxx"
+
+#include "cmSystemTools.h"
+
+namespace {
+bool IsSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool IsIdentifier(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+    (c >= '0' && c <= '9') || c == '_';
+}
+
+// End of the block comment whose "/*" precedes p, or nullptr if it does
+// not end before end
+char const* FindCommentEnd(char const* p, char const* end)
+{
+  while (p < end) {
+    char const* star =
+      static_cast<char const*>(memchr(p, '*', static_cast<size_t>(end - p)));
+    if (!star || star + 1 >= end) {
+      return nullptr;
+    }
+    if (star[1] == '/') {
+      return star + 2;
+    }
+    p = star + 1;
+  }
+  return nullptr;
+}
+
+// Skip whitespace, escaped newlines and block comments within a line
+char const* SkipSpace(char const* p, char const* end)
+{
+  while (p < end) {
+    if (IsSpace(*p)) {
+      ++p;
+    } else if (*p == '\\' && p + 1 < end && p[1] == '\n') {
+      p += 2;
+    } else if (*p == '\\' && p + 2 < end && p[1] == '\r' && p[2] == '\n') {
+      p += 3;
+    } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+      char const* close = FindCommentEnd(p + 2, end);
+      p = close ? close : end;
+    } else {
+      break;
+    }
+  }
+  return p;
+}
+
+// End of the logical line containing p, following line continuations
+char const* LineEnd(char const* p, char const* end)
+{
+  for (;;) {
+    char const* nl =
+      static_cast<char const*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    if (!nl) {
+      return end;
+    }
+    char const* last = nl;
+    if (last > p && last[-1] == '\r') {
+      --last;
+    }
+    if (last == p || last[-1] != '\\') {
+      return nl;
+    }
+    p = nl + 1;
+  }
+}
+
+// Whether pos is inside a string or character literal on its line
+bool InLiteral(char const* lineStart, char const* pos)
+{
+  char quote = 0;
+  for (char const* p = lineStart; p < pos; ++p) {
+    if (quote) {
+      if (*p == '\\') {
+        ++p;
+      } else if (*p == quote) {
+        quote = 0;
+      }
+    } else if (*p == '"' || *p == '\'') {
+      quote = *p;
+    }
+  }
+  return quote != 0;
+}
+
+char const* LineStart(char const* begin, char const* p)
+{
+  while (p > begin && p[-1] != '\n') {
+    --p;
+  }
+  return p;
+}
+
+// Follow block comments from p up to end, which lies outside of any
+// literal; returns whether end is inside a block comment
+bool TrackComments(char const* begin, char const* p, char const* end,
+                   bool inComment)
+{
+  while (p < end) {
+    if (inComment) {
+      char const* close = FindCommentEnd(p, end);
+      if (!close) {
+        return true;
+      }
+      inComment = false;
+      p = close;
+      continue;
+    }
+    char const* slash =
+      static_cast<char const*>(memchr(p, '/', static_cast<size_t>(end - p)));
+    if (!slash || slash + 1 >= end) {
+      return false;
+    }
+    if ((slash[1] == '*' || slash[1] == '/') &&
+        !InLiteral(LineStart(begin, slash), slash)) {
+      if (slash[1] == '/') {
+        // Line comment: nothing opens before the end of the line
+        char const* const next = LineEnd(slash, end);
+        p = next < end ? next + 1 : end;
+        continue;
+      }
+      inComment = true;
+      p = slash + 2;
+      continue;
+    }
+    p = slash + 1;
+  }
+  return inComment;
+}
+
+// Parse a "<name>" or "\"name\"" operand at p
+bool ParseHeaderName(char const* p, char const* end,
+                     cmNixIncludeScanner::Include& include)
+{
+  if (p >= end || (*p != '<' && *p != '"')) {
+    return false;
+  }
+  char const close = *p == '<' ? '>' : '"';
+  char const* const nameBegin = p + 1;
+  char const* nameEnd = nameBegin;
+  while (nameEnd < end && *nameEnd != close && *nameEnd != '\n') {
+    ++nameEnd;
+  }
+  if (nameEnd >= end || *nameEnd != close || nameEnd == nameBegin) {
+    return false;
+  }
+  include.Name.assign(nameBegin, nameEnd);
+  include.Angled = close == '>';
+  return true;
+}
+
+// Operands of the __has_include checks in [begin, end)
+void ParseHasInclude(char const* begin, char const* end,
+                     std::vector<cmNixIncludeScanner::Include>& includes)
+{
+  static char const keyword[] = "__has_include";
+  size_t const keywordLength = sizeof(keyword) - 1;
+  char const* p = begin;
+  while (p < end) {
+    char const* found = static_cast<char const*>(
+      memchr(p, '_', static_cast<size_t>(end - p)));
+    if (!found || static_cast<size_t>(end - found) < keywordLength) {
+      return;
+    }
+    p = found + 1;
+    if (memcmp(found, keyword, keywordLength) != 0 ||
+        (found > begin && IsIdentifier(found[-1]))) {
+      continue;
+    }
+    char const* q = found + keywordLength;
+    if (static_cast<size_t>(end - q) >= 5 && memcmp(q, "_next", 5) == 0) {
+      q += 5;
+    }
+    q = SkipSpace(q, end);
+    if (q >= end || *q != '(') {
+      continue;
+    }
+    cmNixIncludeScanner::Include include;
+    if (ParseHeaderName(SkipSpace(q + 1, end), end, include)) {
+      include.Optional = true;
+      includes.push_back(std::move(include));
+    }
+    p = q;
+  }
+}
+}
+
+std::vector<cmNixIncludeScanner::Include> cmNixIncludeScanner::ParseIncludes(
+  char const* begin, char const* end)
+{
+  std::vector<Include> includes;
+  bool inComment = false;
+  char const* p = begin;
+  while (p < end) {
+    char const* hash =
+      static_cast<char const*>(memchr(p, '#', static_cast<size_t>(end - p)));
+    if (!hash) {
+      break;
+    }
+    inComment = TrackComments(begin, p, hash, inComment);
+    p = hash + 1;
+
+    // A directive's '#' is the first token on its line
+    char const* lineStart = hash;
+    while (lineStart > begin && IsSpace(lineStart[-1])) {
+      --lineStart;
+    }
+    if (inComment || (lineStart > begin && lineStart[-1] != '\n')) {
+      continue;
+    }
+
+    char const* const lineEnd = LineEnd(hash, end);
+    char const* q = SkipSpace(hash + 1, lineEnd);
+    char const* const word = q;
+    while (q < lineEnd && IsIdentifier(*q)) {
+      ++q;
+    }
+    std::string const directive(word, q);
+    if (directive == "include" || directive == "include_next" ||
+        directive == "import") {
+      Include include;
+      if (ParseHeaderName(SkipSpace(q, lineEnd), lineEnd, include)) {
+        includes.push_back(std::move(include));
+      }
+    } else if (directive == "if" || directive == "elif") {
+      ParseHasInclude(q, lineEnd, includes);
+    }
+  }
+  return includes;
+}
+
+std::vector<std::string> cmNixIncludeScanner::Scan(
+  std::string const& source, std::vector<std::string> const& includeDirs)
+{
+  // Visit the headers depth first in include order, as the preprocessor
+  // does, so they are listed in the order the compiler reports them
+  struct Frame
+  {
+    std::vector<Include> const* Includes;
+    std::string Dir;
+    size_t Next;
+  };
+  std::string const start = cmSystemTools::CollapseFullPath(source);
+  std::vector<std::string> headers;
+  std::unordered_set<std::string> seen{ start };
+  std::vector<Frame> stack{ { &this->GetIncludes(start),
+                              cmSystemTools::GetFilenamePath(start), 0 } };
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    if (frame.Next == frame.Includes->size()) {
+      stack.pop_back();
+      continue;
+    }
+    Include const& include = (*frame.Includes)[frame.Next++];
+    std::string path = this->Resolve(include, frame.Dir, includeDirs);
+    if (!path.empty() && seen.insert(path).second) {
+      headers.push_back(path);
+      std::vector<Include> const* includes = &this->GetIncludes(path);
+      stack.push_back({ includes, cmSystemTools::GetFilenamePath(path), 0 });
+    }
+  }
+  return headers;
+}
+
+cmNixIncludeScanner::Statistics cmNixIncludeScanner::GetStatistics() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->Stats;
+}
+
+std::vector<cmNixIncludeScanner::Include> const&
+cmNixIncludeScanner::GetIncludes(std::string const& file)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    auto it = this->Includes.find(file);
+    if (it != this->Includes.end()) {
+      ++this->Stats.ParseHits;
+      return it->second;
+    }
+  }
+
+  std::string content;
+  cmsys::ifstream fin(file.c_str(), std::ios::in | std::ios::binary);
+  if (fin && fin.seekg(0, std::ios::end)) {
+    std::streamoff const size = fin.tellg();
+    if (size > 0) {
+      content.resize(static_cast<size_t>(size));
+      fin.seekg(0, std::ios::beg);
+      fin.read(&content[0], size);
+      content.resize(static_cast<size_t>(fin.gcount()));
+    }
+  }
+  std::vector<Include> includes =
+    ParseIncludes(content.data(), content.data() + content.size());
+
+  // Elements of an unordered_map keep their address when it grows
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  auto inserted = this->Includes.emplace(file, std::move(includes));
+  if (inserted.second) {
+    ++this->Stats.FilesParsed;
+  }
+  return inserted.first->second;
+}
+
+bool cmNixIncludeScanner::DirectoryHasEntry(std::string const& dir,
+                                            std::string const& name)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  auto it = this->Directories.find(dir);
+  if (it == this->Directories.end()) {
+    std::unordered_set<std::string> entries;
+    cmsys::Directory listing;
+    if (listing.Load(dir)) {
+      for (unsigned long i = 0; i < listing.GetNumberOfFiles(); ++i) {
+        entries.insert(listing.GetFile(i));
+      }
+    }
+    ++this->Stats.DirectoriesListed;
+    it = this->Directories.emplace(dir, std::move(entries)).first;
+  }
+  return it->second.count(name) != 0;
+}
+
+std::string cmNixIncludeScanner::Resolve(
+  Include const& include, std::string const& fromDir,
+  std::vector<std::string> const& includeDirs)
+{
+  auto lookup = [this, &include](std::string const& dir) -> std::string {
+    std::string const path =
+      cmSystemTools::CollapseFullPath(include.Name, dir);
+    std::string const name = cmSystemTools::GetFilenameName(path);
+    if (name == "." || name == ".." ||
+        !this->DirectoryHasEntry(cmSystemTools::GetFilenamePath(path),
+                                 name)) {
+      return std::string();
+    }
+    return path;
+  };
+
+  if (cmSystemTools::FileIsFullPath(include.Name)) {
+    return lookup(fromDir);
+  }
+  // As with the compiler, "name" is looked up next to the including file
+  // first
+  if (!include.Angled) {
+    std::string path = lookup(fromDir);
+    if (!path.empty()) {
+      return path;
+    }
+  }
+  for (std::string const& dir : includeDirs) {
+    std::string path = lookup(dir);
+    if (!path.empty()) {
+      return path;
+    }
+  }
+  return std::string();
+}
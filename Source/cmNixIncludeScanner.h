@@ -0,0 +1,76 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * \class cmNixIncludeScanner
+ * \brief Finds the headers of a source by reading its include directives.
+ *
+ * This is the dependency scan that does not run the compiler.  Each file
+ * is read with one read and searched for '#' with memchr; only lines that
+ * start a preprocessor directive are parsed.  Comments, line continuations
+ * and __has_include checks are understood, but conditionals and computed
+ * includes are not, so every literal include is followed.
+ *
+ * Names are resolved against the include path through an index of
+ * directory listings, so looking up a header in a directory that was seen
+ * before costs no file system access.  The parsed directives of a file are
+ * kept per canonical path and reused by all sources that include it.
+ */
+class cmNixIncludeScanner
+{
+public:
+  struct Include
+  {
+    std::string Name;
+    // <name> rather than "name"
+    bool Angled = false;
+    // Named by __has_include: a dependency only if it exists
+    bool Optional = false;
+  };
+
+  struct Statistics
+  {
+    size_t FilesParsed = 0;
+    size_t ParseHits = 0;
+    size_t DirectoriesListed = 0;
+  };
+
+  /**
+   * Parse the include directives of a file's contents.
+   */
+  static std::vector<Include> ParseIncludes(char const* begin,
+                                            char const* end);
+
+  /**
+   * Headers reachable from source through includeDirs, as absolute,
+   * collapsed paths in the order they were found, excluding the source.
+   * Headers that are not found, such as the system headers of the
+   * compiler, are left out.
+   */
+  std::vector<std::string> Scan(std::string const& source,
+                                std::vector<std::string> const& includeDirs);
+
+  Statistics GetStatistics() const;
+
+private:
+  std::vector<Include> const& GetIncludes(std::string const& file);
+  bool DirectoryHasEntry(std::string const& dir, std::string const& name);
+  std::string Resolve(Include const& include, std::string const& fromDir,
+                      std::vector<std::string> const& includeDirs);
+
+  mutable std::mutex Mutex;
+  std::unordered_map<std::string, std::vector<Include>> Includes;
+  std::unordered_map<std::string, std::unordered_set<std::string>>
+    Directories;
+  Statistics Stats;
+};
@@ -0,0 +1,215 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file Copyright.txt or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Approximate heap footprint of cached keys and values, used for the byte
+ * budgets of cmNixLruCache.
+ */
+namespace cmNixCacheSize {
+inline size_t Of(std::string const& value)
+{
+  return sizeof(std::string) + value.capacity();
+}
+
+inline size_t Of(std::vector<std::string> const& value)
+{
+  size_t bytes = sizeof(value);
+  for (std::string const& item : value) {
+    bytes += Of(item);
+  }
+  return bytes;
+}
+
+template <typename T>
+size_t Of(T* /*value*/)
+{
+  return sizeof(T*);
+}
+
+template <typename A, typename B>
+size_t Of(std::pair<A, B> const& value)
+{
+  return Of(value.first) + Of(value.second);
+}
+}
+
+/**
+ * Size and counters of one cache.
+ */
+struct cmNixCacheStats
+{
+  size_t Entries = 0;
+  size_t Bytes = 0;
+  size_t Hits = 0;
+  size_t Misses = 0;
+  size_t Evictions = 0;
+};
+
+/**
+ * \class cmNixLruCache
+ * \brief Thread-safe least recently used cache split into independently
+ * locked shards.
+ *
+ * A key is assigned to one of ShardCount shards by its hash; each shard has
+ * its own mutex, hash map and recency list, so lookups of different keys
+ * rarely contend.  When a shard exceeds its share of the entry or byte
+ * budget, its least recently used entries are evicted.  Budgets of 0 are
+ * unlimited.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class cmNixLruCache
+{
+public:
+  static constexpr size_t ShardCount = 16;
+
+  // Bookkeeping per entry on top of the key and value: list and hash nodes
+  static constexpr size_t EntryOverhead = 64;
+
+  using Stats = cmNixCacheStats;
+
+  cmNixLruCache(size_t maxEntries = 0, size_t maxBytes = 0)
+  {
+    this->SetLimits(maxEntries, maxBytes);
+  }
+
+  /**
+   * Set the total entry and byte budgets, split evenly between the shards.
+   * Takes effect on the next insertion into each shard.
+   */
+  void SetLimits(size_t maxEntries, size_t maxBytes)
+  {
+    for (Shard& shard : this->Shards) {
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+      shard.MaxEntries = (maxEntries + ShardCount - 1) / ShardCount;
+      shard.MaxBytes = (maxBytes + ShardCount - 1) / ShardCount;
+    }
+  }
+
+  /**
+   * Copy the cached value of key to value and mark it as recently used.
+   */
+  bool Find(Key const& key, Value& value)
+  {
+    Shard& shard = this->GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+    auto it = shard.Index.find(key);
+    if (it == shard.Index.end()) {
+      ++shard.Counters.Misses;
+      return false;
+    }
+    ++shard.Counters.Hits;
+    shard.Recency.splice(shard.Recency.begin(), shard.Recency, it->second);
+    value = it->second->Data;
+    return true;
+  }
+
+  /**
+   * Cache value for key unless another thread cached one first, and return
+   * the cached value.
+   */
+  Value Insert(Key const& key, Value value)
+  {
+    Shard& shard = this->GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+    auto it = shard.Index.find(key);
+    if (it != shard.Index.end()) {
+      shard.Recency.splice(shard.Recency.begin(), shard.Recency, it->second);
+      return it->second->Data;
+    }
+    size_t const bytes =
+      EntryOverhead + cmNixCacheSize::Of(key) + cmNixCacheSize::Of(value);
+    shard.Recency.push_front(Entry{ key, std::move(value), bytes });
+    shard.Index.emplace(key, shard.Recency.begin());
+    shard.Counters.Bytes += bytes;
+    Value result = shard.Recency.front().Data;
+
+    // Never evict the entry just inserted
+    while (shard.Recency.size() > 1 &&
+           ((shard.MaxEntries && shard.Recency.size() > shard.MaxEntries) ||
+            (shard.MaxBytes && shard.Counters.Bytes > shard.MaxBytes))) {
+      Entry const& oldest = shard.Recency.back();
+      shard.Counters.Bytes -= oldest.Bytes;
+      shard.Index.erase(oldest.EntryKey);
+      shard.Recency.pop_back();
+      ++shard.Counters.Evictions;
+    }
+    return result;
+  }
+
+  /**
+   * Return the cached value of key, computing and caching it on a miss.
+   * computeFunc runs without any lock held.
+   */
+  template <typename ComputeFunc>
+  Value GetOrCompute(Key const& key, ComputeFunc&& computeFunc)
+  {
+    Value value;
+    if (this->Find(key, value)) {
+      return value;
+    }
+    return this->Insert(key, computeFunc());
+  }
+
+  void Clear()
+  {
+    for (Shard& shard : this->Shards) {
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+      shard.Index.clear();
+      shard.Recency.clear();
+      shard.Counters.Bytes = 0;
+    }
+  }
+
+  Stats GetStats() const
+  {
+    Stats stats;
+    for (Shard const& shard : this->Shards) {
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+      stats.Entries += shard.Recency.size();
+      stats.Bytes += shard.Counters.Bytes;
+      stats.Hits += shard.Counters.Hits;
+      stats.Misses += shard.Counters.Misses;
+      stats.Evictions += shard.Counters.Evictions;
+    }
+    return stats;
+  }
+
+private:
+  struct Entry
+  {
+    Key EntryKey;
+    Value Data;
+    size_t Bytes;
+  };
+
+  struct Shard
+  {
+    mutable std::mutex Mutex;
+    // Most recently used first
+    std::list<Entry> Recency;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> Index;
+    size_t MaxEntries = 0;
+    size_t MaxBytes = 0;
+    Stats Counters;
+  };
+
+  Shard& GetShard(Key const& key)
+  {
+    // Mix the hash so that shards are not picked by its low bits only
+    size_t const hash = Hash()(key);
+    return this->Shards[(hash ^ (hash >> 17)) % ShardCount];
+  }
+
+  std::array<Shard, ShardCount> Shards;
+};
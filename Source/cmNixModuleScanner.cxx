@@ -0,0 +1,286 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmNixModuleScanner.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include <cm/memory>
+#include <cm/optional>
+
+#include <cm3p/uv.h>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmFileTime.h"
+#include "cmGccDepfileReader.h"
+#include "cmGccDepfileReaderTypes.h"
+#include "cmStringAlgorithms.h"
+#include "cmSystemTools.h"
+#include "cmUVHandlePtr.h"
+#include "cmUVProcessChain.h"
+#include "cmUVStream.h"
+
+namespace {
+struct ScanJob
+{
+  std::unique_ptr<cmUVProcessChain> Chain;
+  cm::uv_pipe_ptr Pipe;
+  std::unique_ptr<cmUVStreamReadHandle> Reader;
+  std::string Output;
+};
+
+// The command of the previous scan is kept next to its P1689 file
+std::string CommandFile(cmNixModuleScanner::Request const& request)
+{
+  return cmStrCat(request.DynDepFile, ".cmd");
+}
+}
+
+cmNixModuleScanner::cmNixModuleScanner(unsigned int maxJobs)
+  : MaxJobs(std::max(1u, maxJobs))
+{
+}
+
+std::vector<cmNixModuleScanner::Result> cmNixModuleScanner::Scan(
+  std::vector<Request> const& requests)
+{
+  std::vector<Result> results(requests.size());
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (this->IsUpToDate(requests[i])) {
+      results[i] = this->ReadDynDepFile(requests[i]);
+      if (results[i].Success) {
+        ++this->Stats.Reused;
+        continue;
+      }
+    }
+    cmSystemTools::MakeDirectory(
+      cmSystemTools::GetFilenamePath(requests[i].DynDepFile));
+    pending.push_back(i);
+  }
+  if (pending.empty()) {
+    return results;
+  }
+
+  cm::uv_loop_ptr loop;
+  loop.init();
+
+  // Jobs are never reallocated so the callbacks can hold references
+  std::vector<ScanJob> jobs(pending.size());
+  size_t nextJob = 0;
+  size_t running = 0;
+
+  // A scanner may still be running when its output ends, so the next one
+  // starts when it exits.  Jobs waiting for that are checked on idle.
+  std::vector<size_t> exiting;
+  std::function<void()> startJobs;
+  std::function<void()> releaseJobs;
+  cm::uv_idle_ptr releaseOnIdle;
+  releaseOnIdle.init(*loop, &releaseJobs);
+  releaseJobs = [&]() {
+    size_t const before = exiting.size();
+    exiting.erase(std::remove_if(exiting.begin(), exiting.end(),
+                                 [&jobs](size_t index) {
+                                   return jobs[index].Chain->Finished();
+                                 }),
+                  exiting.end());
+    running -= before - exiting.size();
+    if (exiting.empty()) {
+      releaseOnIdle.stop();
+    }
+    if (exiting.size() != before) {
+      startJobs();
+    }
+  };
+
+  startJobs = [&]() {
+    while (running < this->MaxJobs && nextJob < jobs.size()) {
+      size_t const index = nextJob++;
+      ScanJob& job = jobs[index];
+      Request const& request = requests[pending[index]];
+
+      // Rules may redirect output and chain commands, so they run in a
+      // shell like they do under the other generators
+      cmUVProcessChainBuilder builder;
+      builder.AddCommand({ "/bin/sh", "-c", request.Command })
+        .SetExternalLoop(*loop)
+        .SetWorkingDirectory(request.WorkingDirectory)
+        .SetMergedBuiltinStreams();
+      job.Chain = cm::make_unique<cmUVProcessChain>(builder.Start());
+      if (!job.Chain->Valid()) {
+        continue;
+      }
+
+      ++running;
+      job.Pipe.init(*loop, 0);
+      uv_pipe_open(job.Pipe, job.Chain->OutputStream());
+      job.Reader = cmUVStreamRead(
+        job.Pipe,
+        [&job](std::vector<char> data) {
+          job.Output.append(data.begin(), data.end());
+        },
+        [&job, index, &exiting, &releaseOnIdle, &releaseJobs]() {
+          job.Pipe.reset();
+          exiting.push_back(index);
+          releaseOnIdle.start([](uv_idle_t* idle) {
+            (*static_cast<std::function<void()>*>(idle->data))();
+          });
+          releaseJobs();
+        });
+    }
+  };
+  startJobs();
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    ScanJob& job = jobs[i];
+    Request const& request = requests[pending[i]];
+    Result& result = results[pending[i]];
+    result = Result();
+    if (!job.Chain || !job.Chain->Valid()) {
+      result.Error = "failed to start the scanner";
+    } else {
+      cmUVProcessChain::Status const& status = job.Chain->GetStatus(0);
+      if (status.SpawnResult != 0) {
+        result.Error = cmStrCat("failed to start the scanner: ",
+                                uv_strerror(status.SpawnResult));
+      } else if (status.TermSignal != 0 || status.ExitStatus != 0) {
+        result.Error = status.TermSignal != 0
+          ? cmStrCat("scanner was terminated by signal ", status.TermSignal)
+          : cmStrCat("scanner exited with code ", status.ExitStatus);
+        if (!job.Output.empty()) {
+          result.Error = cmStrCat(result.Error, ": ", job.Output);
+        }
+      } else {
+        result = this->ReadDynDepFile(request);
+      }
+    }
+
+    ++this->Stats.Scanned;
+    if (result.Success) {
+      cmsys::ofstream command(CommandFile(request).c_str());
+      command << request.Command;
+    } else {
+      cmSystemTools::RemoveFile(CommandFile(request));
+      ++this->Stats.Failed;
+    }
+  }
+  return results;
+}
+
+bool cmNixModuleScanner::IsUpToDate(Request const& request) const
+{
+  cmsys::ifstream commandFile(CommandFile(request).c_str());
+  if (!commandFile) {
+    return false;
+  }
+  std::string const command{ std::istreambuf_iterator<char>(commandFile),
+                             std::istreambuf_iterator<char>() };
+  cmFileTime dynDepTime;
+  if (command != request.Command ||
+      !dynDepTime.Load(request.DynDepFile)) {
+    return false;
+  }
+
+  cm::optional<cmGccDepfileContent> content = cmReadGccDepfile(
+    request.DepFile.c_str(), request.WorkingDirectory);
+  if (!content) {
+    return false;
+  }
+  for (cmGccStyleDependency const& dep : *content) {
+    for (std::string const& path : dep.paths) {
+      cmFileTime fileTime;
+      if (!fileTime.Load(path) || !fileTime.Older(dynDepTime)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+cmNixModuleScanner::Result cmNixModuleScanner::ReadDynDepFile(
+  Request const& request) const
+{
+  Result result;
+  if (!cmScanDepFormat_P1689_Parse(request.DynDepFile, &result.Info)) {
+    result.Error =
+      cmStrCat("could not read module dependency file ", request.DynDepFile);
+    return result;
+  }
+  result.Success = true;
+  return result;
+}
+
+cmNixModuleScanner::ModuleUsage cmNixModuleScanner::GetModuleUsage(
+  std::string const& source, cmScanDepInfo const& info,
+  std::vector<std::string>& errors)
+{
+  ModuleUsage usage;
+  for (cmSourceReqInfo const& provided : info.Provides) {
+    if (!usage.Provides.empty()) {
+      errors.push_back(
+        cmStrCat("Source ", source, " provides more than one C++ module"));
+      break;
+    }
+    usage.Provides = provided.LogicalName;
+  }
+  for (cmSourceReqInfo const& required : info.Requires) {
+    if (required.Method != LookupMethod::ByName) {
+      errors.push_back(cmStrCat("Source ", source, " imports the header unit ",
+                                required.LogicalName,
+                                ", which the Nix generator does not support"));
+      continue;
+    }
+    usage.Requires.push_back(required.LogicalName);
+  }
+  return usage;
+}
+
+std::map<std::string, std::string> cmNixModuleScanner::ResolveImports(
+  std::string const& target, std::string const& derivation,
+  std::unordered_map<std::string, ModuleUsage> const& usages,
+  ModuleProviders const& providers, std::vector<std::string>& errors)
+{
+  // Compilers read the BMIs of the modules imported by the modules a
+  // source imports too, so the source takes the whole import closure
+  std::map<std::string, std::string> imports;
+  auto const usage = usages.find(derivation);
+  if (usage == usages.end()) {
+    return imports;
+  }
+  std::vector<std::string> pending(usage->second.Requires.rbegin(),
+                                   usage->second.Requires.rend());
+  while (!pending.empty()) {
+    std::string const module = pending.back();
+    pending.pop_back();
+    if (imports.count(module)) {
+      continue;
+    }
+    auto const candidates = providers.find(module);
+    if (candidates == providers.end()) {
+      errors.push_back(cmStrCat("C++ module ", module, " imported by target ",
+                                target, " is not provided by any target"));
+      continue;
+    }
+    std::string provider = candidates->second.front().second;
+    for (auto const& candidate : candidates->second) {
+      if (candidate.first == target) {
+        provider = candidate.second;
+      }
+    }
+    if (provider == derivation) {
+      continue;
+    }
+    imports[module] = provider;
+    auto const imported = usages.find(provider);
+    if (imported != usages.end()) {
+      pending.insert(pending.end(), imported->second.Requires.rbegin(),
+                     imported->second.Requires.rend());
+    }
+  }
+  return imports;
+}
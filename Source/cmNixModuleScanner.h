@@ -0,0 +1,103 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cmScanDepFormat.h"
+
+/**
+ * \class cmNixModuleScanner
+ * \brief Runs the C++20 module scans of a batch of sources.
+ *
+ * Every source is scanned by the CMAKE_CXX_SCANDEP_SOURCE rule of its
+ * compiler, which writes the P1689 description of the modules the source
+ * provides and requires along with a depfile of the files it read.  A
+ * source is rescanned only when its command changed or one of those files
+ * is newer than the previous P1689 file.  Up to MaxJobs scans run
+ * concurrently on a single libuv loop.
+ */
+class cmNixModuleScanner
+{
+public:
+  struct Request
+  {
+    // Absolute path of the translation unit to scan
+    std::string Source;
+    // Shell command that writes DynDepFile and DepFile
+    std::string Command;
+    // Directory the command runs in
+    std::string WorkingDirectory;
+    std::string DynDepFile;
+    std::string DepFile;
+  };
+
+  struct Result
+  {
+    bool Success = false;
+    cmScanDepInfo Info;
+    // Scanner diagnostics when the scan failed
+    std::string Error;
+  };
+
+  // Modules a scanned source provides and imports by name
+  struct ModuleUsage
+  {
+    std::string Provides;
+    std::vector<std::string> Requires;
+  };
+
+  // Derivations providing each module, with the target they belong to
+  using ModuleProviders =
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>>;
+
+  struct Statistics
+  {
+    size_t Scanned = 0;
+    size_t Reused = 0;
+    size_t Failed = 0;
+  };
+
+  explicit cmNixModuleScanner(unsigned int maxJobs);
+
+  /**
+   * Scan all requests and return their results in request order.
+   */
+  std::vector<Result> Scan(std::vector<Request> const& requests);
+
+  Statistics const& GetStatistics() const { return this->Stats; }
+
+  /**
+   * Read the modules the scan of source provides and imports.  A source
+   * providing more than one module and header unit imports are not
+   * supported; each is reported in errors.
+   */
+  static ModuleUsage GetModuleUsage(std::string const& source,
+                                    cmScanDepInfo const& info,
+                                    std::vector<std::string>& errors);
+
+  /**
+   * Map every module the derivation of target imports, directly or through
+   * other modules, to the derivation providing it.  A module provided by
+   * target itself wins over other targets.  Modules no target provides are
+   * reported in errors.
+   */
+  static std::map<std::string, std::string> ResolveImports(
+    std::string const& target, std::string const& derivation,
+    std::unordered_map<std::string, ModuleUsage> const& usages,
+    ModuleProviders const& providers, std::vector<std::string>& errors);
+
+private:
+  bool IsUpToDate(Request const& request) const;
+  Result ReadDynDepFile(Request const& request) const;
+
+  unsigned int MaxJobs;
+  Statistics Stats;
+};
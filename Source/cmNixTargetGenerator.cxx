@@ -10,11 +10,14 @@
 #include <system_error>
 #include <exception>
 
+#include "cmGeneratorExpression.h"
 #include "cmGeneratorTarget.h"
 #include "cmGlobalNixGenerator.h"
 #include "cmLocalNixGenerator.h"
 #include "cmNixCacheManager.h"
 #include "cmNixConstants.h"
+#include "cmNixDependencyScanner.h"
+#include "cmNixIncludeScanner.h"
 #include "cmMakefile.h"
 #include "cmSourceFile.h"
 #include "cmSystemTools.h"
@@ -26,7 +29,6 @@
 #include "cmListFileCache.h"
 #include "cmValue.h"
 #include "cmake.h"
-#include <regex>
 #include <fstream>
 
 std::unique_ptr<cmNixTargetGenerator> cmNixTargetGenerator::New(
@@ -180,46 +182,11 @@ std::vector<std::string> cmNixTargetGenerator::GetSourceDependencies(
   
   // Option B: Compiler-based dependency scanning
   try {
-    // Try compiler-based scanning first (most accurate)
+    // A single -MM scan already lists every header the source includes,
+    // directly or transitively, so no per-header scans are needed
     dependencies = this->ScanWithCompiler(source, lang);
     if (!dependencies.empty()) {
-      
-      // Now recursively scan all header dependencies for transitive includes
-      std::set<std::string> visited;
-      std::vector<std::string> transitiveDeps;
-      
-      // Mark source file as visited
-      visited.insert(source->GetFullPath());
-      
-      // Process each direct dependency
-      for (const std::string& dep : dependencies) {
-        // Add the direct dependency
-        transitiveDeps.push_back(dep);
-        
-        // Get absolute path for the dependency
-        std::string absPath;
-        if (cmSystemTools::FileIsFullPath(dep)) {
-          absPath = dep;
-        } else {
-          absPath = this->GetMakefile()->GetHomeDirectory() + "/" + dep;
-        }
-        
-        // Get transitive dependencies
-        std::vector<std::string> transDeps = this->GetTransitiveDependencies(absPath, visited, 0);
-        transitiveDeps.insert(transitiveDeps.end(), transDeps.begin(), transDeps.end());
-      }
-      
-      // Remove duplicates while preserving order
-      std::set<std::string> seen;
-      std::vector<std::string> uniqueDeps;
-      for (const std::string& dep : transitiveDeps) {
-        if (seen.insert(dep).second) {
-          uniqueDeps.push_back(dep);
-        }
-      }
-      
-      
-      return uniqueDeps;
+      return dependencies;
     }
   } catch (const std::bad_alloc& e) {
     // Handle out of memory specifically
@@ -260,134 +227,160 @@ std::vector<std::string> cmNixTargetGenerator::GetSourceDependencies(
     return dependencies;
   }
   
-  // Fallback 2: Use CMake's regex-based scanner
-  dependencies = this->ScanWithRegex(source, lang);
+  // Fallback 2: Follow the include directives
+  dependencies = this->ScanIncludes(source, lang);
   
   return dependencies;
 }
 
-std::vector<std::string> cmNixTargetGenerator::ScanWithCompiler(
-  cmSourceFile const* source, std::string const& lang) const
+bool cmNixTargetGenerator::GetDependencyScanCommand(
+  cmSourceFile const* source, std::vector<std::string>& command) const
 {
-  std::vector<std::string> dependencies;
-  
-  // Get compiler command
-  std::string compiler = this->GetCompilerCommand(lang);
-  if (compiler.empty()) {
-    return dependencies; // No compiler found
+  std::string const& lang = source->GetLanguage();
+  auto cached = this->ScanCommandCache.find(lang);
+  if (cached == this->ScanCommandCache.end()) {
+    cached = this->ScanCommandCache
+               .emplace(lang, this->GetDependencyScanCommandPrefix(lang))
+               .first;
+  }
+  command = cached->second;
+  if (command.empty()) {
+    return false;
   }
   
-  // Get compile flags and include directories
-  std::string config = this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
+  // The prefix is shared by the sources of a language; add the source's
+  // own flags, definitions and include directories to it, since they can
+  // change what the source includes
+  std::string config =
+    this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
   if (config.empty()) {
     config = "Release";
   }
-  
-  std::vector<std::string> compileFlags = this->GetCompileFlags(lang, config);
-  std::vector<std::string> includeFlags = this->GetIncludeFlags(lang, config);
-  
-  // Build compiler command for dependency generation
-  std::vector<std::string> command;
-  command.push_back(compiler);
-  command.push_back("-MM"); // Generate dependencies, no system headers
-  
-  // Add compile flags (but skip optimization flags for dependency scanning)
-  for (const std::string& flag : compileFlags) {
-    if (!flag.empty() && flag.find("-O") != 0) {
-      command.push_back(flag);
-    }
+  cmGeneratorExpressionInterpreter genexInterpreter(
+    this->LocalGenerator, config, this->GeneratorTarget, lang);
+  std::string sourceFlags;
+  if (cmValue const cflags = source->GetProperty("COMPILE_FLAGS")) {
+    this->LocalGenerator->AppendFlags(
+      sourceFlags, genexInterpreter.Evaluate(*cflags, "COMPILE_FLAGS"));
   }
-  
-  // Add include flags
-  for (const std::string& flag : includeFlags) {
-    if (!flag.empty()) {
-      command.push_back(flag);
-    }
+  if (cmValue const coptions = source->GetProperty("COMPILE_OPTIONS")) {
+    this->LocalGenerator->AppendCompileOptions(
+      sourceFlags, genexInterpreter.Evaluate(*coptions, "COMPILE_OPTIONS"));
   }
-  
-  command.push_back(source->GetFullPath());
-  
-  // Debug output before running command
-  if (this->GetMakefile()->GetCMakeInstance()->GetDebugOutput()) {
-    this->LogDebug("ScanWithCompiler for " + source->GetFullPath());
-    
-    // Show raw compileFlags vector
-    std::ostringstream flagsMsg;
-    flagsMsg << "Raw compileFlags (" << compileFlags.size() << " flags):";
-    this->LogDebug(flagsMsg.str());
-    for (size_t i = 0; i < compileFlags.size(); ++i) {
-      std::ostringstream flagMsg;
-      flagMsg << "  [" << i << "] = \"" << compileFlags[i] << "\"";
-      this->LogDebug(flagMsg.str());
-    }
-    
-    // Show raw includeFlags vector
-    flagsMsg.str("");
-    flagsMsg << "Raw includeFlags (" << includeFlags.size() << " flags):";
-    this->LogDebug(flagsMsg.str());
-    for (size_t i = 0; i < includeFlags.size(); ++i) {
-      std::ostringstream flagMsg;
-      flagMsg << "  [" << i << "] = \"" << includeFlags[i] << "\"";
-      this->LogDebug(flagMsg.str());
-    }
-    
-    // Show full command being executed
-    this->LogDebug("Full dependency scan command:");
-    std::ostringstream cmdMsg;
-    cmdMsg << "  ";
-    for (const auto& arg : command) {
-      cmdMsg << "\"" << arg << "\" ";
+  if (!sourceFlags.empty()) {
+    cmSystemTools::ParseUnixCommandLine(sourceFlags.c_str(), command);
+  }
+  std::set<std::string> defines;
+  for (std::string const& prop :
+       { std::string("COMPILE_DEFINITIONS"),
+         cmStrCat("COMPILE_DEFINITIONS_", cmSystemTools::UpperCase(config)) }) {
+    if (cmValue const defs = source->GetProperty(prop)) {
+      this->LocalGenerator->AppendDefines(
+        defines, genexInterpreter.Evaluate(*defs, "COMPILE_DEFINITIONS"));
     }
-    this->LogDebug(cmdMsg.str());
   }
-  
-  // Execute compiler to get dependencies
-  std::string output;
-  std::string error;
-  int result;
-  
-  if (cmSystemTools::RunSingleCommand(command, &output, &error, &result,
-                                     nullptr, cmSystemTools::OUTPUT_NONE)) {
-    if (result == 0) {
-      // Parse compiler output
-      dependencies = this->ParseCompilerDependencyOutput(output, source);
-    } else {
-      // Always report compiler errors, not just in debug mode
-      std::ostringstream msg;
-      msg << "Compiler dependency scan failed for " << source->GetFullPath() 
-          << " with exit code " << result;
-      if (!error.empty()) {
-        msg << ": " << error;
+  for (std::string const& define : defines) {
+    command.push_back("-D" + define);
+  }
+  for (std::string const& dir :
+       cmGlobalNixGenerator::GetSourceIncludeDirectories(
+         this->GeneratorTarget, source, lang, config)) {
+    command.push_back("-I" + dir);
+  }
+  return true;
+}
+
+std::vector<std::string> cmNixTargetGenerator::GetDependencyScanCommandPrefix(
+  std::string const& lang) const
+{
+  std::vector<std::string> command;
+  auto* globalGen = static_cast<cmGlobalNixGenerator*>(
+    this->GetLocalGenerator()->GetGlobalGenerator());
+  cmValue explicitSources = this->GetMakefile()->GetDefinition("CMAKE_NIX_EXPLICIT_SOURCES");
+  if (explicitSources && cmIsOn(*explicitSources) &&
+      !globalGen->UseIncludeScanner() &&
+      (lang == "C" || lang == "CXX" || lang == "OBJC" || lang == "OBJCXX" ||
+       lang == "CUDA" || lang == "HIP" || lang == "ISPC")) {
+    std::string compiler = this->GetCompilerCommand(lang);
+    if (!compiler.empty()) {
+      std::string config = this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
+      if (config.empty()) {
+        config = "Release";
       }
-      this->Makefile->GetCMakeInstance()->IssueMessage(
-        MessageType::WARNING, msg.str());
       
-      // Additional debug output for failed commands
-      if (this->GetMakefile()->GetCMakeInstance()->GetDebugOutput()) {
-        this->LogDebug("Dependency scan command failed!");
-        this->LogDebug("Exit code: " + std::to_string(result));
-        this->LogDebug("Error output: " + error);
-        this->LogDebug("Standard output: " + output);
+      command.push_back(compiler);
+      
+      // Add compile flags (but skip optimization flags for dependency scanning)
+      for (const std::string& flag : this->GetCompileFlags(lang, config)) {
+        if (!flag.empty() && flag.find("-O") != 0) {
+          command.push_back(flag);
+        }
+      }
+      
+      // Add include flags
+      for (const std::string& flag : this->GetIncludeFlags(lang, config)) {
+        if (!flag.empty()) {
+          command.push_back(flag);
+        }
       }
     }
-  } else {
-    // Always report command execution failures
-    std::ostringstream msg;
-    msg << "Failed to execute dependency scanning command for " 
-        << source->GetFullPath();
-    if (!error.empty()) {
-      msg << ": " << error;
-    }
-    this->Makefile->GetCMakeInstance()->IssueMessage(
-      MessageType::WARNING, msg.str());
-    
-    // Additional debug output for command execution failure
-    if (this->GetMakefile()->GetCMakeInstance()->GetDebugOutput()) {
-      this->LogDebug("Failed to execute dependency scan command!");
-      this->LogDebug("Error: " + error);
-    }
   }
   
+  return command;
+}
+
+std::vector<std::string> cmNixTargetGenerator::ScanWithCompiler(
+  cmSourceFile const* source, std::string const& /*lang*/) const
+{
+  auto* globalGen = static_cast<cmGlobalNixGenerator*>(
+    this->GetLocalGenerator()->GetGlobalGenerator());
+  std::string const& sourcePath = source->GetFullPath();
+  
+  // Sources are normally scanned in one batch before the derivations are
+  // written; scan on demand for anything that was not part of that batch
+  std::vector<std::string> headers;
+  if (!globalGen->GetScannedDependencies(this->GetTargetName(), sourcePath,
+                                         headers)) {
+    headers = globalGen->GetCacheManager()->GetTransitiveDependencies(
+      this->GetTargetName() + "|" + sourcePath,
+      [this, globalGen, source]() -> std::vector<std::string> {
+        cmNixDependencyScanner::Request request;
+        request.Source = source->GetFullPath();
+        if (!this->GetDependencyScanCommand(source, request.Command)) {
+          return {};
+        }
+        
+        if (this->GetMakefile()->GetCMakeInstance()->GetDebugOutput()) {
+          std::ostringstream cmdMsg;
+          cmdMsg << "ScanWithCompiler for " << request.Source << ":";
+          for (const auto& arg : request.Command) {
+            cmdMsg << " \"" << arg << "\"";
+          }
+          this->LogDebug(cmdMsg.str());
+        }
+        
+        cmNixDependencyScanner scanner(
+          globalGen->GetDependencyScanDirectory(), 1);
+        std::vector<cmNixDependencyScanner::Result> results =
+          scanner.Scan({ request });
+        
+        if (!results[0].Success) {
+          globalGen->ReportDependencyScanFailure(request.Source,
+                                                 results[0].Error);
+          return {};
+        }
+        return results[0].Headers;
+      });
+  }
+  
+  // Convert to relative paths from top-level source directory (for Nix generation)
+  std::vector<std::string> dependencies;
+  dependencies.reserve(headers.size());
+  std::string const& topSourceDir = this->GetMakefile()->GetHomeDirectory();
+  for (std::string const& header : headers) {
+    std::string relPath = cmSystemTools::RelativePath(topSourceDir, header);
+    dependencies.push_back(!relPath.empty() ? relPath : header);
+  }
   return dependencies;
 }
 
@@ -416,39 +409,36 @@ std::vector<std::string> cmNixTargetGenerator::GetManualDependencies(
   return dependencies;
 }
 
-std::vector<std::string> cmNixTargetGenerator::ScanWithRegex(
-  cmSourceFile const* source, std::string const& /*lang*/) const
+std::vector<std::string> cmNixTargetGenerator::ScanIncludes(
+  cmSourceFile const* source, std::string const& lang) const
 {
-  std::vector<std::string> dependencies;
-  
-  // Simple regex-based scanner (fallback for legacy compilers)
-  std::ifstream sourceFile(source->GetFullPath());
-  if (!sourceFile.is_open()) {
-    return dependencies;
+  auto* globalGen = static_cast<cmGlobalNixGenerator*>(
+    this->GetLocalGenerator()->GetGlobalGenerator());
+  std::string config =
+    this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
+  if (config.empty()) {
+    config = "Release";
   }
   
-  // Regex to match #include statements
-  std::regex includePattern(R"(^\s*#\s*include\s*[<"]([^">]+)[">])");
-  std::string line;
+  std::vector<std::string> includeDirs =
+    cmGlobalNixGenerator::GetSourceIncludeDirectories(
+      this->GeneratorTarget, source, lang, config);
+  this->LocalGenerator->GetIncludeDirectories(
+    includeDirs, this->GeneratorTarget, lang, config);
+  includeDirs.push_back(this->GetMakefile()->GetCurrentSourceDirectory());
   
-  while (std::getline(sourceFile, line)) {
-    std::smatch match;
-    if (std::regex_search(line, match, includePattern)) {
-      std::string headerName = match[1].str();
-      
-      // Try to resolve include to full path
-      std::string fullPath = this->ResolveIncludePath(headerName);
-      if (!fullPath.empty()) {
-        // Convert to relative path from top-level source directory (for Nix generation)
-        std::string topSourceDir = this->GetMakefile()->GetHomeDirectory();
-        std::string relPath = cmSystemTools::RelativePath(topSourceDir, fullPath);
-        dependencies.push_back(!relPath.empty() ? relPath : fullPath);
-      }
+  std::vector<std::string> headers =
+    globalGen->GetIncludeScanner()->Scan(source->GetFullPath(), includeDirs);
+  
+  // Convert to relative paths from top-level source directory (for Nix generation)
+  std::string const& topSourceDir = this->GetMakefile()->GetHomeDirectory();
+  for (std::string& header : headers) {
+    std::string relPath = cmSystemTools::RelativePath(topSourceDir, header);
+    if (!relPath.empty()) {
+      header = std::move(relPath);
     }
   }
-  
-  // No need to explicitly close - RAII handles it
-  return dependencies;
+  return headers;
 }
 
 std::string cmNixTargetGenerator::GetCompilerCommand(std::string const& lang) const
@@ -558,74 +548,6 @@ std::vector<std::string> cmNixTargetGenerator::GetIncludeFlags(
   return flags;
 }
 
-std::vector<std::string> cmNixTargetGenerator::ParseCompilerDependencyOutput(
-  std::string const& output, cmSourceFile const* source) const
-{
-  std::vector<std::string> dependencies;
-  
-  // Parse GCC -MM output format: "object: source header1 header2 ..."
-  std::istringstream stream(output);
-  std::string line;
-  
-  // Concatenate all lines (dependencies can be split across lines with \)
-  std::ostringstream fullOutputStream;
-  while (std::getline(stream, line)) {
-    // Remove trailing backslash and concatenate
-    if (!line.empty() && line.back() == '\\') {
-      line.pop_back();
-    }
-    fullOutputStream << line << " ";
-  }
-  std::string fullOutput = fullOutputStream.str();
-  
-  // Find the colon that separates object from dependencies
-  size_t colonPos = fullOutput.find(':');
-  if (colonPos != std::string::npos) {
-    // Extract everything after the colon
-    std::string depsStr = fullOutput.substr(colonPos + 1);
-    
-    // Split by whitespace to get individual files
-    std::istringstream depsStream(depsStr);
-    std::string depFile;
-    
-    while (depsStream >> depFile) {
-      // Skip the source file itself, only add headers
-      if (depFile != source->GetFullPath() && !depFile.empty()) {
-        // Convert to relative path from top-level source directory (for Nix generation)
-        std::string topSourceDir = this->GetMakefile()->GetHomeDirectory();
-        std::string relPath = cmSystemTools::RelativePath(topSourceDir, depFile);
-        dependencies.push_back(!relPath.empty() ? relPath : depFile);
-      }
-    }
-  }
-  
-  return dependencies;
-}
-
-std::string cmNixTargetGenerator::ResolveIncludePath(std::string const& headerName) const
-{
-  // Try to resolve include file to full path using include directories
-  std::vector<std::string> includes;
-  // Use empty strings for lang and config to get all include directories
-  this->LocalGenerator->GetIncludeDirectories(includes, this->GeneratorTarget, "", "");
-  
-  for (const auto& inc : includes) {
-    std::string fullPath = inc + "/" + headerName;
-    if (cmSystemTools::FileExists(fullPath)) {
-      return fullPath;
-    }
-  }
-  
-  // Try relative to source directory
-  std::string sourceDir = this->GetMakefile()->GetCurrentSourceDirectory();
-  std::string fullPath = sourceDir + "/" + headerName;
-  if (cmSystemTools::FileExists(fullPath)) {
-    return fullPath;
-  }
-  
-  return ""; // Not found
-}
-
 void cmNixTargetGenerator::AddIncludeFlags(std::string& flags, 
                                           std::string const& lang,
                                           std::string const& config)
@@ -840,206 +762,6 @@ bool cmNixTargetGenerator::CreateNixPackageFile(
   return true;
 }
 
-std::vector<std::string> cmNixTargetGenerator::GetTransitiveDependencies(
-  std::string const& filePath, std::set<std::string>& visited, int depth) const
-{
-  std::vector<std::string> dependencies;
-  
-  // Limit recursion depth to prevent stack overflow
-  if (depth > MAX_HEADER_RECURSION_DEPTH) {
-    this->GetMakefile()->IssueMessage(
-      MessageType::WARNING,
-      cmStrCat("Header dependency recursion depth exceeded for: ", filePath));
-    return dependencies;
-  }
-  
-  // Canonicalize the path to ensure consistent cache keys
-  std::string canonicalPath = cmSystemTools::GetRealPath(filePath);
-  
-  // Check if already visited (using canonical path)
-  if (!visited.insert(canonicalPath).second) {
-    return dependencies; // Already processed this file
-  }
-  
-  // Check if file exists
-  if (!cmSystemTools::FileExists(canonicalPath)) {
-    return dependencies;
-  }
-  
-  // Get cache manager from global generator
-  auto* globalGen = static_cast<cmGlobalNixGenerator*>(
-    this->GetLocalGenerator()->GetGlobalGenerator());
-  auto* cacheManager = globalGen->GetCacheManager();
-  
-  // Use consolidated cache manager with lambda for lazy computation
-  return cacheManager->GetTransitiveDependencies(canonicalPath, 
-    [&]() -> std::vector<std::string> {
-  
-  // Determine the language based on file extension
-  std::string ext = cmSystemTools::GetFilenameLastExtension(canonicalPath);
-  std::string lang;
-  if (ext == ".h" || ext == ".hpp" || ext == ".hxx" || ext == ".H" || 
-      ext == ".hh" || ext == ".h++" || ext == ".hp") {
-    lang = "CXX"; // Treat all headers as C++ for scanning
-  } else if (ext == ".c") {
-    lang = "C";
-  } else if (ext == ".cuh") {
-    lang = "CUDA";
-  } else {
-    return dependencies; // Unknown file type
-  }
-  
-  // Use compiler to scan this header file
-  std::vector<std::string> directDeps;
-  
-  // Get compiler command
-  std::string compiler = this->GetCompilerCommand(lang);
-  if (!compiler.empty()) {
-    // Get compile flags and include directories
-    std::string config = this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
-    if (config.empty()) {
-      config = "Release";
-    }
-    
-    std::vector<std::string> compileFlags = this->GetCompileFlags(lang, config);
-    std::vector<std::string> includeFlags = this->GetIncludeFlags(lang, config);
-    
-    // Build compiler command for dependency generation
-    std::vector<std::string> command;
-    command.push_back(compiler);
-    command.push_back("-MM"); // Generate dependencies, no system headers
-    command.push_back("-MT"); // Specify target name
-    command.push_back("dummy"); // Dummy target name
-    
-    // Add compile flags
-    for (const std::string& flag : compileFlags) {
-      if (!flag.empty()) {
-        command.push_back(flag);
-      }
-    }
-    
-    // Add include flags
-    for (const std::string& flag : includeFlags) {
-      if (!flag.empty()) {
-        command.push_back(flag);
-      }
-    }
-    
-    command.push_back(canonicalPath);
-    
-    // Execute compiler to get dependencies
-    std::string output;
-    std::string error;
-    int result;
-    
-    if (cmSystemTools::RunSingleCommand(command, &output, &error, &result,
-                                       nullptr, cmSystemTools::OUTPUT_NONE)) {
-      if (result == 0) {
-        // Parse compiler output
-        std::istringstream stream(output);
-        std::string line;
-        
-        // Concatenate all lines (dependencies can be split across lines with \)
-        std::ostringstream fullOutputStream;
-        while (std::getline(stream, line)) {
-          // Remove trailing backslash and concatenate
-          if (!line.empty() && line.back() == '\\') {
-            line.pop_back();
-          }
-          fullOutputStream << line << " ";
-        }
-        std::string fullOutput = fullOutputStream.str();
-        
-        // Find the colon that separates object from dependencies
-        size_t colonPos = fullOutput.find(':');
-        if (colonPos != std::string::npos) {
-          // Extract everything after the colon
-          std::string depsStr = fullOutput.substr(colonPos + 1);
-          
-          // Split by whitespace to get individual files
-          std::istringstream depsStream(depsStr);
-          std::string depFile;
-          
-          while (depsStream >> depFile) {
-            // Skip the header file itself, only add its dependencies
-            if (depFile != filePath && !depFile.empty()) {
-              // Convert to relative path from top-level source directory (for Nix generation)
-              std::string topSourceDir = this->GetMakefile()->GetHomeDirectory();
-              std::string relPath = cmSystemTools::RelativePath(topSourceDir, depFile);
-              directDeps.push_back(!relPath.empty() ? relPath : depFile);
-            }
-          }
-        }
-      }
-    } else {
-      // Log compiler error without failing the build
-      if (this->GetMakefile()->GetCMakeInstance()->GetDebugOutput()) {
-        this->LogDebug("Compiler header dependency scan failed for " + filePath +
-                      " with exit code " + std::to_string(result));
-        if (!error.empty()) {
-          this->LogDebug("Compiler error: " + error);
-        }
-      }
-    }
-  } else {
-    // Log command execution failure
-    this->LogDebug("Failed to execute header dependency scanning command for " + filePath);
-  }
-  
-  // Fallback to regex scanning if compiler method fails
-  if (directDeps.empty()) {
-    std::ifstream headerFile(filePath);
-    if (headerFile.is_open()) {
-      // Regex to match #include statements
-      std::regex includePattern(R"(^\s*#\s*include\s*[<"]([^">]+)[">])");
-      std::string line;
-      
-      while (std::getline(headerFile, line)) {
-        std::smatch match;
-        if (std::regex_search(line, match, includePattern)) {
-          std::string headerName = match[1].str();
-          
-          // Try to resolve include to full path
-          std::string fullPath = this->ResolveIncludePath(headerName);
-          if (!fullPath.empty()) {
-            // Convert to relative path from top-level source directory (for Nix generation)
-            std::string topSourceDir = this->GetMakefile()->GetHomeDirectory();
-            std::string relPath = cmSystemTools::RelativePath(topSourceDir, fullPath);
-            directDeps.push_back(!relPath.empty() ? relPath : fullPath);
-          }
-        }
-      }
-      // No need to explicitly close - RAII handles it
-    }
-  }
-  
-  // Process each direct dependency recursively
-  for (const std::string& dep : directDeps) {
-    // Add the direct dependency
-    dependencies.push_back(dep);
-    
-    // Get absolute path for the dependency
-    std::string absPath;
-    if (cmSystemTools::FileIsFullPath(dep)) {
-      absPath = dep;
-    } else {
-      absPath = this->GetMakefile()->GetHomeDirectory() + "/" + dep;
-    }
-    
-    // Get transitive dependencies
-    std::vector<std::string> transDeps = this->GetTransitiveDependencies(absPath, visited, depth + 1);
-    dependencies.insert(dependencies.end(), transDeps.begin(), transDeps.end());
-  }
-  
-      // Mark all dependencies as visited before returning
-      for (const auto& dep : dependencies) {
-        visited.insert(dep);
-      }
-      
-      return dependencies;
-    }); // End of lambda
-}
-
 void cmNixTargetGenerator::WritePchDerivations()
 {
   std::string config = this->GetMakefile()->GetSafeDefinition("CMAKE_BUILD_TYPE");
@@ -38,10 +38,11 @@ public:
   /// Get header dependencies for a source file
   std::vector<std::string> GetSourceDependencies(cmSourceFile const* source) const;
   
-  /// Get transitive header dependencies for a file
-  std::vector<std::string> GetTransitiveDependencies(std::string const& filePath, 
-                                                     std::set<std::string>& visited,
-                                                     int depth = 0) const;
+  /// Get the compiler and flags used to scan the header dependencies of a
+  /// source, without -MM/-MF and the source itself.  Returns false when the
+  /// source is not scanned with the compiler.
+  bool GetDependencyScanCommand(cmSourceFile const* source,
+                                std::vector<std::string>& command) const;
 
   /// Pure Nix library support - public for global generator access
   std::vector<std::string> GetTargetLibraryDependencies(std::string const& config) const;
@@ -87,14 +88,13 @@ public:
   /// Option B: Compiler-based dependency scanning methods
   std::vector<std::string> ScanWithCompiler(cmSourceFile const* source, std::string const& lang) const;
   std::vector<std::string> GetManualDependencies(cmSourceFile const* source) const;
-  std::vector<std::string> ScanWithRegex(cmSourceFile const* source, std::string const& lang) const;
+  std::vector<std::string> ScanIncludes(cmSourceFile const* source, std::string const& lang) const;
   
   /// Helper methods for dependency scanning
   std::string GetCompilerCommand(std::string const& lang) const;
   std::vector<std::string> GetCompileFlags(std::string const& lang, std::string const& config) const;
   std::vector<std::string> GetIncludeFlags(std::string const& lang, std::string const& config) const;
-  std::vector<std::string> ParseCompilerDependencyOutput(std::string const& output, cmSourceFile const* source) const;
-  std::string ResolveIncludePath(std::string const& headerName) const;
+  std::vector<std::string> GetDependencyScanCommandPrefix(std::string const& lang) const;
 
   /// Pure Nix library support methods (private implementation)
   bool CreateNixPackageFile(std::string const& libName, std::string const& filePath) const;
@@ -112,8 +112,10 @@ private:
   bool IsCompilableLanguage(const std::string& lang) const;
   
   // Constants
-  static constexpr int MAX_HEADER_RECURSION_DEPTH = 100; // Maximum depth for header dependency scanning
   static constexpr size_t MAX_DEPENDENCY_CACHE_SIZE = 10000; // Maximum entries in dependency cache
   
   cmLocalNixGenerator* LocalGenerator;
+  
+  // Scan command prefix per language, see GetDependencyScanCommand
+  mutable std::map<std::string, std::vector<std::string>> ScanCommandCache;
 }; 
\ No newline at end of file
@@ -0,0 +1,107 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#include "cmTryCompileResultCache.h"
+
+#include <iterator>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmCryptoHash.h"
+#include "cmGeneratedFileStream.h"
+#include "cmMakefile.h"
+#include "cmStringAlgorithms.h"
+#include "cmSystemTools.h"
+#include "cmValue.h"
+
+namespace {
+std::string const kCMAKE_TRY_COMPILE_RESULT_CACHE =
+  "CMAKE_TRY_COMPILE_RESULT_CACHE";
+
+std::string EntryPath(std::string const& dir, std::string const& key)
+{
+  return cmStrCat(dir, '/', key, ".result");
+}
+}
+
+cmTryCompileResultCache& cmTryCompileResultCache::Instance()
+{
+  static cmTryCompileResultCache instance;
+  return instance;
+}
+
+std::string cmTryCompileResultCache::GetDirectory(cmMakefile const* mf)
+{
+  std::string dir;
+  if (cmValue value = mf->GetDefinition(kCMAKE_TRY_COMPILE_RESULT_CACHE)) {
+    dir = *value;
+  } else {
+    cmSystemTools::GetEnv(kCMAKE_TRY_COMPILE_RESULT_CACHE, dir);
+  }
+  if (dir.empty() || cmIsOff(dir)) {
+    return std::string();
+  }
+  return cmSystemTools::CollapseFullPath(dir);
+}
+
+std::string cmTryCompileResultCache::HashCompiler(std::string const& path)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    auto it = this->CompilerHashes.find(path);
+    if (it != this->CompilerHashes.end()) {
+      return it->second;
+    }
+  }
+
+  // Wrapper scripts such as the Nix cc-wrapper pin the real compiler by
+  // store path, so hashing the file itself covers the toolchain
+  std::string hash;
+  std::string const realPath = cmSystemTools::GetRealPath(path);
+  if (cmSystemTools::FileExists(realPath, true)) {
+    cmCryptoHash sha256(cmCryptoHash::AlgoSHA256);
+    hash = sha256.HashFile(realPath);
+  }
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->CompilerHashes.emplace(path, hash);
+  return hash;
+}
+
+bool cmTryCompileResultCache::Lookup(std::string const& dir,
+                                     std::string const& key, Entry& entry)
+{
+  cmsys::ifstream fin(EntryPath(dir, key).c_str(), std::ios::in);
+  std::string exitCode;
+  long value = 0;
+  bool const found = fin && std::getline(fin, exitCode) &&
+    cmStrToLong(exitCode, &value);
+  if (found) {
+    entry.ExitCode = static_cast<int>(value);
+    entry.Output.assign(std::istreambuf_iterator<char>(fin),
+                        std::istreambuf_iterator<char>());
+  }
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  ++(found ? this->Stats.Hits : this->Stats.Misses);
+  return found;
+}
+
+void cmTryCompileResultCache::Store(std::string const& dir,
+                                    std::string const& key,
+                                    Entry const& entry)
+{
+  // An unwritable cache must not fail the configure
+  if (!cmSystemTools::MakeDirectory(dir) ||
+      !cmSystemTools::TestFileAccess(dir, cmsys::TEST_FILE_WRITE)) {
+    return;
+  }
+  cmGeneratedFileStream fout(EntryPath(dir, key));
+  fout << entry.ExitCode << '\n' << entry.Output;
+}
+
+cmTryCompileResultCache::Statistics cmTryCompileResultCache::GetStatistics()
+  const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->Stats;
+}
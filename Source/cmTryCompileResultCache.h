@@ -0,0 +1,78 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+#pragma once
+
+#include "cmConfigure.h" // IWYU pragma: keep
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+class cmMakefile;
+
+/**
+ * \class cmTryCompileResultCache
+ * \brief Persistent, user level cache of try_compile results.
+ *
+ * Results are stored as one file per key in a directory shared by all
+ * build trees of a user, so that the same feature checks do not compile
+ * again in every new build tree.  The key is computed by the caller from
+ * everything that determines the result: the probe sources, the content
+ * of the compilers and the effective flags, definitions and link
+ * libraries.  The cache is disabled unless CMAKE_TRY_COMPILE_RESULT_CACHE
+ * names its directory, as a variable or in the environment.
+ */
+class cmTryCompileResultCache
+{
+public:
+  struct Entry
+  {
+    int ExitCode = 1;
+    std::string Output;
+  };
+
+  struct Statistics
+  {
+    size_t Hits = 0;
+    size_t Misses = 0;
+  };
+
+  static cmTryCompileResultCache& Instance();
+
+  /**
+   * Return the cache directory configured for mf, or an empty string if
+   * the cache is disabled.
+   */
+  static std::string GetDirectory(cmMakefile const* mf);
+
+  /**
+   * Return the hash of the content of the compiler at path, computed once
+   * per process.  Returns an empty string if the compiler cannot be read.
+   */
+  std::string HashCompiler(std::string const& path);
+
+  /**
+   * Read the result stored for key in dir into entry.
+   */
+  bool Lookup(std::string const& dir, std::string const& key, Entry& entry);
+
+  /**
+   * Store entry for key in dir.  The file is written under a temporary
+   * name and renamed, so concurrent configures never read a partial entry.
+   */
+  void Store(std::string const& dir, std::string const& key,
+             Entry const& entry);
+
+  /**
+   * Lookups made by this process so far.
+   */
+  Statistics GetStatistics() const;
+
+private:
+  cmTryCompileResultCache() = default;
+
+  mutable std::mutex Mutex;
+  std::map<std::string, std::string> CompilerHashes;
+  Statistics Stats;
+};
@@ -75,6 +75,7 @@ public:
   TryRunCommandImpl(cmMakefile* mf)
     : cmCoreTryCompile(mf)
   {
+    this->UseResultCache = false;
   }
 
   bool TryRunCode(std::vector<std::string> const& args);
@@ -71,6 +71,7 @@
 #include "cmSystemTools.h"
 #include "cmTarget.h"
 #include "cmTargetLinkLibraryType.h"
+#include "cmTryCompileResultCache.h"
 #include "cmUVProcessChain.h"
 #include "cmUtils.hxx"
 #include "cmVersionConfig.h"
@@ -2651,6 +2652,8 @@ int cmake::ActualConfigure()
 
   // actually do the configure
   auto startTime = std::chrono::steady_clock::now();
+  cmTryCompileResultCache::Statistics const startResultCacheStats =
+    cmTryCompileResultCache::Instance().GetStatistics();
 #if !defined(CMAKE_BOOTSTRAP)
   if (this->Instrumentation->HasErrors()) {
     return 1;
@@ -2683,6 +2686,18 @@ int cmake::ActualConfigure()
       msg << "Configuring done (" << std::fixed << std::setprecision(1)
           << ms.count() / 1000.0L << "s)";
     }
+    cmTryCompileResultCache::Statistics const resultCacheStats =
+      cmTryCompileResultCache::Instance().GetStatistics();
+    size_t const hits = resultCacheStats.Hits - startResultCacheStats.Hits;
+    size_t const lookups =
+      hits + resultCacheStats.Misses - startResultCacheStats.Misses;
+    if (!this->GetIsInTryCompile() && lookups > 0) {
+      std::ostringstream cacheMsg;
+      cacheMsg << "try_compile result cache: " << hits << " of " << lookups
+               << " results reused (" << std::fixed << std::setprecision(1)
+               << 100.0 * hits / lookups << "%)";
+      this->UpdateProgress(cacheMsg.str(), -1);
+    }
     this->UpdateProgress(msg.str(), -1);
   }
 
@@ -42,6 +42,7 @@
 #if !defined(CMAKE_BOOTSTRAP)
 #  include "cmDependsFortran.h" // For -E cmake_copy_f90_mod callback.
 #  include "cmFileTime.h"
+#  include "cmNixBuildLog.h"
 
 #  include "bindexplib.h"
 #endif
@@ -1448,6 +1449,25 @@ int cmcmd::ExecuteCMakeCommand(std::vector<std::string> const& args,
     if (args[1] == "cmake_ninja_dyndep") {
       return cmcmd_cmake_ninja_dyndep(args.begin() + 2, args.end());
     }
+
+    // Internal Nix build log support.
+    if (args[1] == "cmake_nix_build_log") {
+      auto arg = args.begin() + 2;
+      bool const verbose = arg != args.end() && *arg == "--verbose";
+      if (verbose) {
+        ++arg;
+      }
+      if (arg != args.end() && *arg == "--") {
+        ++arg;
+      }
+      if (arg == args.end()) {
+        std::cerr << "cmake_nix_build_log: no command given\n";
+        return 1;
+      }
+      return cmNixBuildLog::Run({ arg, args.end() },
+                                cmSystemTools::GetLogicalWorkingDirectory(),
+                                verbose);
+    }
 #endif
 
     // Internal CMake C++ module compilation database support.
@@ -0,0 +1,138 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+// Manual benchmark of cmNixDependencyGraph against the string based
+// traversal it replaced.  Not registered with CTest; run the
+// benchNixDependencyGraph executable from the build tree.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cmNixDependencyGraph.h"
+#include "cmStateTypes.h"
+
+namespace {
+
+using NodeId = cmNixDependencyGraph::NodeId;
+
+// Synthetic project: 100 packages of 100 targets each.  Every target links
+// up to three lower targets of its own package and one target of a shared
+// core package.
+size_t const PackageCount = 100;
+size_t const PackageSize = 100;
+
+std::string NodeName(size_t package, size_t index)
+{
+  return "pkg" + std::to_string(package) + "_target" + std::to_string(index);
+}
+
+std::vector<std::pair<std::string, std::string>> MakeSyntheticEdges()
+{
+  std::vector<std::pair<std::string, std::string>> edges;
+  std::uint32_t seed = 12345;
+  auto next = [&seed](size_t bound) -> size_t {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % bound;
+  };
+  for (size_t package = 0; package < PackageCount; ++package) {
+    for (size_t index = 1; index < PackageSize; ++index) {
+      for (int i = 0; i < 3; ++i) {
+        edges.emplace_back(NodeName(package, index),
+                           NodeName(package, next(index)));
+      }
+      if (package != 0) {
+        edges.emplace_back(NodeName(package, index),
+                           NodeName(0, next(PackageSize)));
+      }
+    }
+  }
+  return edges;
+}
+
+// The string based traversal the graph used before interning
+size_t ReferenceClosureSize(
+  std::map<std::string, std::vector<std::string>> const& adjacency,
+  std::string const& target)
+{
+  std::set<std::string> visited;
+  std::vector<std::string> stack{ target };
+  while (!stack.empty()) {
+    std::string current = stack.back();
+    stack.pop_back();
+    if (!visited.insert(current).second) {
+      continue;
+    }
+    auto it = adjacency.find(current);
+    if (it != adjacency.end()) {
+      for (std::string const& dep : it->second) {
+        if (!visited.count(dep)) {
+          stack.push_back(dep);
+        }
+      }
+    }
+  }
+  return visited.size() - 1;
+}
+
+}
+
+int main()
+{
+  using Clock = std::chrono::steady_clock;
+  auto const edges = MakeSyntheticEdges();
+
+  cmNixDependencyGraph graph;
+  std::map<std::string, std::vector<std::string>> adjacency;
+  for (size_t package = 0; package < PackageCount; ++package) {
+    for (size_t index = 0; index < PackageSize; ++index) {
+      graph.AddTarget(NodeName(package, index),
+                      index % 2 ? cmStateEnums::SHARED_LIBRARY
+                                : cmStateEnums::STATIC_LIBRARY);
+    }
+  }
+  for (auto const& edge : edges) {
+    graph.AddDependency(edge.first, edge.second);
+    adjacency[edge.first].push_back(edge.second);
+  }
+
+  // Reference: one string traversal per target
+  auto start = Clock::now();
+  size_t referenceTotal = 0;
+  for (size_t id = 0; id < graph.GetNodeCount(); ++id) {
+    referenceTotal += ReferenceClosureSize(
+      adjacency, graph.GetNodeName(static_cast<NodeId>(id)));
+  }
+  auto const referenceTime = Clock::now() - start;
+
+  // Id based: link order and closure membership for every target
+  start = Clock::now();
+  size_t total = 0;
+  for (size_t id = 0; id < graph.GetNodeCount(); ++id) {
+    NodeId const target = static_cast<NodeId>(id);
+    for (NodeId dep : graph.GetLinkOrder(target)) {
+      total += graph.DependsOn(target, dep) ? 1 : 0;
+    }
+  }
+  auto const graphTime = Clock::now() - start;
+
+  auto ms = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  };
+  std::cout << graph.GetNodeCount() << " targets, " << edges.size()
+            << " edges, " << total << " transitive dependencies\n"
+            << "string traversal: " << ms(referenceTime) << " ms\n"
+            << "interned graph:   " << ms(graphTime) << " ms\n";
+  if (total != referenceTotal) {
+    std::cerr << "closure mismatch: " << total << " != " << referenceTotal
+              << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmNixBuildLog.h"
+#include "cmNixConstants.h"
+#include "cmSystemTools.h"
+
+#include "testCommon.h"
+
+namespace {
+
+std::chrono::system_clock::time_point At(int ms)
+{
+  return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+bool testBuildActivities()
+{
+  std::cout << "testBuildActivities()\n";
+  std::ostringstream out;
+  cmNixBuildLog log(out, false);
+  log.ProcessLine("@nix {\"action\":\"result\",\"id\":1,\"type\":106,"
+                  "\"fields\":[105,2]}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":\"start\",\"id\":10,\"level\":3,"
+                  "\"type\":105,\"text\":\"building\",\"fields\":"
+                  "[\"/nix/store/aaaa-main.o.drv\",\"\",1,1]}",
+                  At(100));
+  log.ProcessLine("@nix {\"action\":\"start\",\"id\":11,\"level\":3,"
+                  "\"type\":108,\"fields\":"
+                  "[\"/nix/store/bbbb-zlib-1.3\",\"https://cache.nixos.org\"]}",
+                  At(150));
+  log.ProcessLine("@nix {\"action\":\"result\",\"id\":10,\"type\":101,"
+                  "\"fields\":[\"compiling main.c\"]}",
+                  At(200));
+  log.ProcessLine("@nix {\"action\":\"stop\",\"id\":11}", At(250));
+  log.ProcessLine("@nix {\"action\":\"stop\",\"id\":10}", At(1600));
+  log.ProcessLine("@nix {\"action\":\"start\",\"id\":12,\"level\":3,"
+                  "\"type\":105,\"fields\":[\"/nix/store/cccc-app.drv\"]}",
+                  At(1600));
+  log.ProcessLine("@nix {\"action\":\"stop\",\"id\":12}", At(1700));
+  log.ProcessLine("@nix {\"action\":\"msg\",\"level\":0,\"msg\":\"error: "
+                  "builder for '/nix/store/cccc-app.drv' failed\"}",
+                  At(1700));
+  log.ProcessLine("plain text", At(1700));
+
+  auto const& derivations = log.GetDerivations();
+  ASSERT_TRUE(derivations.size() == 3);
+  ASSERT_TRUE(derivations[0].Name == "main.o");
+  ASSERT_TRUE(derivations[0].Duration.count() == 1500);
+  ASSERT_TRUE(derivations[0].Finished && !derivations[0].Failed);
+  ASSERT_TRUE(derivations[1].Name == "zlib-1.3");
+  ASSERT_TRUE(derivations[1].Substituted);
+  ASSERT_TRUE(derivations[2].Name == "app");
+  ASSERT_TRUE(derivations[2].Failed);
+
+  std::string const text = out.str();
+  ASSERT_TRUE(text.find("[1/2] main.o (1.5s)") != std::string::npos);
+  ASSERT_TRUE(text.find("Substituting zlib-1.3") != std::string::npos);
+  ASSERT_TRUE(text.find("error: builder for") != std::string::npos);
+  ASSERT_TRUE(text.find("plain text") != std::string::npos);
+  // Build log lines only show in verbose mode
+  ASSERT_TRUE(text.find("compiling main.c") == std::string::npos);
+
+  log.PrintSummary();
+  ASSERT_TRUE(out.str().find("Nix: 1 built, 1 substituted, 1 failed") !=
+              std::string::npos);
+  return true;
+}
+
+bool testVerbose()
+{
+  std::cout << "testVerbose()\n";
+  std::ostringstream out;
+  cmNixBuildLog log(out, true);
+  log.ProcessLine("@nix {\"action\":\"result\",\"id\":10,\"type\":101,"
+                  "\"fields\":[\"compiling main.c\"]}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":\"msg\",\"level\":3,"
+                  "\"msg\":\"these 2 derivations will be built:\"}",
+                  At(0));
+  ASSERT_TRUE(out.str() ==
+              "compiling main.c\nthese 2 derivations will be built:\n");
+  return true;
+}
+
+bool testUnexpectedTypes()
+{
+  std::cout << "testUnexpectedTypes()\n";
+  std::ostringstream out;
+  cmNixBuildLog log(out, false);
+  log.ProcessLine("@nix {\"action\":\"result\",\"id\":1,\"type\":106,"
+                  "\"fields\":[\"105\",2]}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":\"result\",\"id\":1,\"type\":\"106\","
+                  "\"fields\":{}}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":\"start\",\"id\":\"10\",\"type\":105,"
+                  "\"fields\":[\"/nix/store/aaaa-main.o.drv\"]}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":7,\"id\":10}", At(0));
+  log.ProcessLine("@nix {\"action\":\"msg\",\"level\":\"error\","
+                  "\"msg\":[]}",
+                  At(0));
+  ASSERT_TRUE(log.GetDerivations().empty());
+
+  // Activity ids above 2^31 are kept apart
+  log.ProcessLine("@nix {\"action\":\"start\",\"id\":4294967297,"
+                  "\"type\":105,\"fields\":[\"/nix/store/aaaa-main.o.drv\"]}",
+                  At(0));
+  log.ProcessLine("@nix {\"action\":\"stop\",\"id\":1}", At(100));
+  ASSERT_TRUE(!log.GetDerivations()[0].Finished);
+  log.ProcessLine("@nix {\"action\":\"stop\",\"id\":4294967297}", At(100));
+  ASSERT_TRUE(log.GetDerivations()[0].Finished);
+  return true;
+}
+
+bool testDerivationRoles()
+{
+  std::cout << "testDerivationRoles()\n";
+  std::string const binaryDir = "testNixBuildLog.dir";
+  cmSystemTools::MakeDirectory(binaryDir + "/CMakeFiles");
+  {
+    cmsys::ofstream fout(
+      (binaryDir + '/' + cmNix::Generator::DERIVATION_ROLES).c_str());
+    fout << "compile app_unity_cxx_0\n"
+            "compile pch.hxx.gch\n"
+            "compile app-thinlto-0.o\n"
+            "link app-thinlto-index\n"
+            "link app\n"
+            "custom gen_header\n";
+  }
+
+  auto const roles = cmNixBuildLog::ReadDerivationRoles(binaryDir);
+  ASSERT_EQUAL(roles.size(), 6u);
+  ASSERT_EQUAL(roles.at("app_unity_cxx_0"), "compile");
+  ASSERT_EQUAL(roles.at("pch.hxx.gch"), "compile");
+  ASSERT_EQUAL(roles.at("app-thinlto-0.o"), "compile");
+  ASSERT_EQUAL(roles.at("app-thinlto-index"), "link");
+  ASSERT_EQUAL(roles.at("gen_header"), "custom");
+  ASSERT_TRUE(!roles.count("composite-src-with-generated"));
+  cmSystemTools::RemoveADirectory(binaryDir);
+  return true;
+}
+
+}
+
+int testNixBuildLog(int /*unused*/, char* /*unused*/[])
+{
+  return runTests({
+    testBuildActivities,
+    testVerbose,
+    testUnexpectedTypes,
+    testDerivationRoles,
+  });
+}
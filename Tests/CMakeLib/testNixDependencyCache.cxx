@@ -0,0 +1,198 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmNixDependencyCache.h"
+#include "cmSystemTools.h"
+
+#include "testCommon.h"
+
+namespace {
+
+std::string const TestDir =
+  cmSystemTools::GetCurrentWorkingDirectory() + "/testNixDependencyCache";
+std::string const CacheFile = TestDir + "/cache.txt";
+std::string const Source = TestDir + "/main.c";
+std::string const Header = TestDir + "/main.h";
+std::vector<std::string> const Flags = { "cc", "-I", TestDir };
+
+void WriteFile(std::string const& path, std::string const& content)
+{
+  cmsys::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+  fout << content;
+}
+
+bool Setup()
+{
+  cmSystemTools::RemoveADirectory(TestDir);
+  cmSystemTools::MakeDirectory(TestDir);
+  WriteFile(Source, "#include \"main.h\"\nint main(void) { return 0; }\n");
+  WriteFile(Header, "#define VALUE 1\n");
+
+  // Record one scan result in a fresh cache file
+  std::string const fingerprint =
+    cmNixDependencyCache::ComputeFingerprint(Flags);
+  cmNixDependencyCache cache(CacheFile);
+  cache.Load();
+  std::vector<std::string> headers;
+  ASSERT_TRUE(!cache.Lookup(Source, fingerprint, headers));
+  cache.Store(Source, fingerprint, { Header });
+  ASSERT_TRUE(cache.Save());
+  return true;
+}
+
+bool LookupHeaders(std::vector<std::string> const& flags,
+                   std::vector<std::string>& headers)
+{
+  cmNixDependencyCache cache(CacheFile);
+  cache.Load();
+  bool const hit = cache.Lookup(
+    Source, cmNixDependencyCache::ComputeFingerprint(flags), headers);
+  cache.Save();
+  return hit;
+}
+
+bool testRoundTrip()
+{
+  std::cout << "testRoundTrip()\n";
+  ASSERT_TRUE(Setup());
+
+  std::vector<std::string> headers;
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  ASSERT_TRUE(headers.size() == 1 && headers[0] == Header);
+  return true;
+}
+
+bool testFlagsChange()
+{
+  std::cout << "testFlagsChange()\n";
+  ASSERT_TRUE(Setup());
+
+  std::vector<std::string> flags = Flags;
+  flags.emplace_back("-DOTHER");
+  std::vector<std::string> headers;
+  ASSERT_TRUE(!LookupHeaders(flags, headers));
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  return true;
+}
+
+bool testTouchedHeader()
+{
+  std::cout << "testTouchedHeader()\n";
+  ASSERT_TRUE(Setup());
+
+  // Same content with a newer mtime is still a hit
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  WriteFile(Header, "#define VALUE 1\n");
+  std::vector<std::string> headers;
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  return true;
+}
+
+bool testEditedHeader()
+{
+  std::cout << "testEditedHeader()\n";
+  ASSERT_TRUE(Setup());
+
+  WriteFile(Header, "#include \"other.h\"\n");
+  std::vector<std::string> headers;
+  ASSERT_TRUE(!LookupHeaders(Flags, headers));
+
+  cmSystemTools::RemoveFile(Header);
+  ASSERT_TRUE(!LookupHeaders(Flags, headers));
+  return true;
+}
+
+bool testTruncatedFile()
+{
+  std::cout << "testTruncatedFile()\n";
+  ASSERT_TRUE(Setup());
+
+  // A record cut short by an interrupted append is ignored
+  {
+    cmsys::ofstream fout(CacheFile.c_str(), std::ios::out | std::ios::app);
+    fout << "R 0123 2 " << TestDir << "/other.c\n1 2 ";
+  }
+  std::vector<std::string> headers;
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  ASSERT_TRUE(LookupHeaders(Flags, headers));
+  return true;
+}
+
+bool testUnknownVersion()
+{
+  std::cout << "testUnknownVersion()\n";
+  ASSERT_TRUE(Setup());
+
+  WriteFile(CacheFile, "# some other format\n");
+  std::vector<std::string> headers;
+  ASSERT_TRUE(!LookupHeaders(Flags, headers));
+  return true;
+}
+
+bool testEviction()
+{
+  std::cout << "testEviction()\n";
+  ASSERT_TRUE(Setup());
+
+  // Each run scans the source with new flags and leaves the entries of the
+  // older flags unused
+  for (char const* define : { "-DA", "-DB" }) {
+    std::vector<std::string> flags = Flags;
+    flags.emplace_back(define);
+    std::string const fingerprint =
+      cmNixDependencyCache::ComputeFingerprint(flags);
+    cmNixDependencyCache cache(CacheFile);
+    cache.Load();
+    std::vector<std::string> headers;
+    ASSERT_TRUE(!cache.Lookup(Source, fingerprint, headers));
+    cache.Store(Source, fingerprint, { Header });
+    ASSERT_TRUE(cache.Save());
+  }
+
+  // Two unused entries outnumber the one of the last run, so the file was
+  // rewritten with that one only
+  size_t records = 0;
+  {
+    cmsys::ifstream fin(CacheFile.c_str());
+    std::string line;
+    while (std::getline(fin, line)) {
+      if (line.compare(0, 2, "R ") == 0) {
+        ++records;
+      }
+    }
+  }
+  ASSERT_TRUE(records == 1);
+
+  std::vector<std::string> headers;
+  ASSERT_TRUE(!LookupHeaders(Flags, headers));
+  std::vector<std::string> flags = Flags;
+  flags.emplace_back("-DB");
+  ASSERT_TRUE(LookupHeaders(flags, headers));
+  return true;
+}
+
+}
+
+int testNixDependencyCache(int /*unused*/, char* /*unused*/[])
+{
+  int result = runTests({
+    testRoundTrip,
+    testFlagsChange,
+    testTouchedHeader,
+    testEditedHeader,
+    testTruncatedFile,
+    testUnknownVersion,
+    testEviction,
+  });
+  cmSystemTools::RemoveADirectory(TestDir);
+  return result;
+}
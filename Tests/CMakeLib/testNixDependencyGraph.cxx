@@ -0,0 +1,239 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cmNixDependencyGraph.h"
+#include "cmStateTypes.h"
+
+#include "testCommon.h"
+
+namespace {
+
+using NodeId = cmNixDependencyGraph::NodeId;
+
+// Position of each name in order, for checking dependency constraints
+std::map<std::string, size_t> Positions(std::vector<std::string> const& order)
+{
+  std::map<std::string, size_t> positions;
+  for (size_t i = 0; i < order.size(); ++i) {
+    positions[order[i]] = i;
+  }
+  return positions;
+}
+
+bool testDiamond()
+{
+  std::cout << "testDiamond()\n";
+  cmNixDependencyGraph graph;
+  graph.AddTarget("app", cmStateEnums::EXECUTABLE);
+  graph.AddTarget("left", cmStateEnums::STATIC_LIBRARY);
+  graph.AddTarget("right", cmStateEnums::SHARED_LIBRARY);
+  graph.AddTarget("base", cmStateEnums::SHARED_LIBRARY);
+  graph.AddTarget("unused", cmStateEnums::MODULE_LIBRARY);
+  graph.AddDependency("app", "left");
+  graph.AddDependency("app", "right");
+  graph.AddDependency("app", "left");
+  graph.AddDependency("left", "base");
+  graph.AddDependency("right", "base");
+
+  ASSERT_TRUE(!graph.HasCircularDependency());
+  ASSERT_TRUE(graph.GetDependencies("app").size() == 2);
+  ASSERT_TRUE((graph.GetAllTransitiveDependencies("app") ==
+               std::set<std::string>{ "base", "left", "right" }));
+  ASSERT_TRUE((graph.GetTransitiveSharedLibraries("app") ==
+               std::set<std::string>{ "base", "right" }));
+  ASSERT_TRUE((graph.GetTransitiveSharedLibraries("left") ==
+               std::set<std::string>{ "base" }));
+  ASSERT_TRUE(graph.GetTransitiveSharedLibraries("base").empty());
+  ASSERT_TRUE(graph.GetAllTransitiveDependencies("missing").empty());
+
+  // Dependencies come before their dependents when linking
+  std::vector<std::string> order = graph.GetTopologicalOrderForLinking("app");
+  ASSERT_TRUE(order.size() == 4);
+  auto positions = Positions(order);
+  ASSERT_TRUE(positions.count("unused") == 0);
+  ASSERT_TRUE(positions["base"] < positions["left"]);
+  ASSERT_TRUE(positions["base"] < positions["right"]);
+  ASSERT_TRUE(positions["left"] < positions["app"]);
+  ASSERT_TRUE(positions["right"] < positions["app"]);
+  ASSERT_TRUE(order == graph.GetTopologicalOrderForLinking("app"));
+
+  // The global order puts dependents first
+  positions = Positions(graph.GetTopologicalOrder());
+  ASSERT_TRUE(positions.size() == 5);
+  ASSERT_TRUE(positions["app"] < positions["left"]);
+  ASSERT_TRUE(positions["left"] < positions["base"]);
+
+  NodeId const app = graph.GetNodeId("app");
+  NodeId const base = graph.GetNodeId("base");
+  ASSERT_TRUE(graph.DependsOn(app, base));
+  ASSERT_TRUE(!graph.DependsOn(base, app));
+  ASSERT_TRUE(!graph.DependsOn(app, app));
+  ASSERT_TRUE(!graph.DependsOn(app, graph.GetNodeId("unused")));
+  return true;
+}
+
+bool testCycle()
+{
+  std::cout << "testCycle()\n";
+  cmNixDependencyGraph graph;
+  graph.AddTarget("a", cmStateEnums::SHARED_LIBRARY);
+  graph.AddTarget("b", cmStateEnums::SHARED_LIBRARY);
+  graph.AddTarget("c", cmStateEnums::STATIC_LIBRARY);
+  graph.AddDependency("a", "b");
+  graph.AddDependency("b", "a");
+  graph.AddDependency("c", "a");
+
+  ASSERT_TRUE(graph.HasCircularDependency());
+  ASSERT_TRUE(graph.GetTopologicalOrder().empty());
+  ASSERT_TRUE(graph.GetTopologicalOrderForLinking("c").empty());
+  // A target is never reported as its own dependency
+  ASSERT_TRUE((graph.GetAllTransitiveDependencies("a") ==
+               std::set<std::string>{ "b" }));
+  ASSERT_TRUE((graph.GetTransitiveSharedLibraries("c") ==
+               std::set<std::string>{ "a", "b" }));
+  return true;
+}
+
+bool testUnknownNodes()
+{
+  std::cout << "testUnknownNodes()\n";
+  cmNixDependencyGraph graph;
+  graph.AddTarget("app", cmStateEnums::EXECUTABLE);
+  graph.AddDependency("app", "imported");
+
+  // Only added targets take part in transitive queries
+  ASSERT_TRUE(graph.GetAllTransitiveDependencies("app").empty());
+  ASSERT_TRUE(graph.GetAllTransitiveDependencies("imported").empty());
+  ASSERT_TRUE((graph.GetTopologicalOrderForLinking("app") ==
+               std::vector<std::string>{ "imported", "app" }));
+  ASSERT_TRUE((graph.GetTopologicalOrderForLinking("other") ==
+               std::vector<std::string>{ "other" }));
+
+  // Changes after a query invalidate the cached results
+  graph.AddTarget("imported", cmStateEnums::SHARED_LIBRARY);
+  ASSERT_TRUE((graph.GetTransitiveSharedLibraries("app") ==
+               std::set<std::string>{ "imported" }));
+  graph.Clear();
+  ASSERT_TRUE(graph.GetNodeCount() == 0);
+  ASSERT_TRUE(graph.GetNodeId("app") == cmNixDependencyGraph::InvalidNode);
+  return true;
+}
+
+// Synthetic project: 8 packages of 16 targets each.  Every target links up
+// to three lower targets of its own package and one target of a shared core
+// package.  benchNixDependencyGraph times the same shape at full scale.
+size_t const PackageCount = 8;
+size_t const PackageSize = 16;
+
+std::string NodeName(size_t package, size_t index)
+{
+  return "pkg" + std::to_string(package) + "_target" + std::to_string(index);
+}
+
+std::vector<std::pair<std::string, std::string>> MakeSyntheticEdges()
+{
+  std::vector<std::pair<std::string, std::string>> edges;
+  std::uint32_t seed = 12345;
+  auto next = [&seed](size_t bound) -> size_t {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % bound;
+  };
+  for (size_t package = 0; package < PackageCount; ++package) {
+    for (size_t index = 1; index < PackageSize; ++index) {
+      for (int i = 0; i < 3; ++i) {
+        edges.emplace_back(NodeName(package, index),
+                           NodeName(package, next(index)));
+      }
+      if (package != 0) {
+        edges.emplace_back(NodeName(package, index),
+                           NodeName(0, next(PackageSize)));
+      }
+    }
+  }
+  return edges;
+}
+
+// The string based traversal the graph used before interning, for
+// comparison
+std::set<std::string> ReferenceClosure(
+  std::map<std::string, std::vector<std::string>> const& adjacency,
+  std::string const& target)
+{
+  std::set<std::string> visited;
+  std::set<std::string> result;
+  std::vector<std::string> stack{ target };
+  while (!stack.empty()) {
+    std::string current = stack.back();
+    stack.pop_back();
+    if (!visited.insert(current).second) {
+      continue;
+    }
+    if (current != target) {
+      result.insert(current);
+    }
+    auto it = adjacency.find(current);
+    if (it != adjacency.end()) {
+      for (std::string const& dep : it->second) {
+        if (!visited.count(dep)) {
+          stack.push_back(dep);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+bool testSyntheticClosure()
+{
+  std::cout << "testSyntheticClosure()\n";
+  auto const edges = MakeSyntheticEdges();
+
+  cmNixDependencyGraph graph;
+  std::map<std::string, std::vector<std::string>> adjacency;
+  for (size_t package = 0; package < PackageCount; ++package) {
+    for (size_t index = 0; index < PackageSize; ++index) {
+      graph.AddTarget(NodeName(package, index),
+                      index % 2 ? cmStateEnums::SHARED_LIBRARY
+                                : cmStateEnums::STATIC_LIBRARY);
+    }
+  }
+  for (auto const& edge : edges) {
+    graph.AddDependency(edge.first, edge.second);
+    adjacency[edge.first].push_back(edge.second);
+  }
+  ASSERT_TRUE(graph.GetNodeCount() == PackageCount * PackageSize);
+
+  // Link order and closure membership agree with a string traversal
+  for (size_t id = 0; id < graph.GetNodeCount(); ++id) {
+    NodeId const target = static_cast<NodeId>(id);
+    std::string const& name = graph.GetNodeName(target);
+    std::set<std::string> const reference = ReferenceClosure(adjacency, name);
+    ASSERT_TRUE(graph.GetAllTransitiveDependencies(name) == reference);
+    size_t members = 0;
+    for (NodeId dep : graph.GetLinkOrder(target)) {
+      members += graph.DependsOn(target, dep) ? 1 : 0;
+    }
+    ASSERT_TRUE(members == reference.size());
+  }
+  return true;
+}
+
+}
+
+int testNixDependencyGraph(int /*unused*/, char* /*unused*/[])
+{
+  return runTests({
+    testDiamond,
+    testCycle,
+    testUnknownNodes,
+    testSyntheticClosure,
+  });
+}
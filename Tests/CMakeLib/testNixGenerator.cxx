@@ -28,6 +28,7 @@ public:
   using cmGlobalNixGenerator::GetCompilerPackage;
   using cmGlobalNixGenerator::IsSystemPath;
   using cmGlobalNixGenerator::GetDerivationName;
+  using cmGlobalNixGenerator::GetThinLTOBackendFlags;
 };
 
 // Test fixture class
@@ -210,6 +211,31 @@ static bool testGetDerivationName()
   return true;
 }
 
+static bool testThinLTOBackendFlags()
+{
+  std::cout << "testThinLTOBackendFlags()\n";
+  
+  // Only code generation flags reach the backends; -flto would make them
+  // emit bitcode, and flags for the front end or diagnostics do not apply
+  // to IR input
+  std::vector<std::string> const compileFlags = {
+    "-O2", "-flto=thin", "-g", "-DNDEBUG", "-fPIC", "-march=native", "-Wall",
+    "-std=c++17", "-fvisibility=hidden", "-fdiagnostics-color",
+    "-ffunction-sections", "-fprofile-instr-use=default.profdata",
+    "-mcmodel=large", "-gdwarf-4", "-fno-exceptions", "-Iinclude"
+  };
+  std::vector<std::string> const expected = {
+    "-O2", "-g", "-fPIC", "-march=native", "-ffunction-sections",
+    "-mcmodel=large", "-gdwarf-4"
+  };
+  ASSERT_TRUE(TestableNixGenerator::GetThinLTOBackendFlags(compileFlags) ==
+              expected);
+  
+  ASSERT_TRUE(TestableNixGenerator::GetThinLTOBackendFlags({}).empty());
+  
+  return true;
+}
+
 int testNixGenerator(int /*unused*/, char* /*unused*/[])
 {
   int failed = 0;
@@ -269,5 +295,10 @@ int testNixGenerator(int /*unused*/, char* /*unused*/[])
     failed = 1;
   }
   
+  if (!testThinLTOBackendFlags()) {
+    std::cerr << "testThinLTOBackendFlags failed\n";
+    failed = 1;
+  }
+  
   return failed;
 }
\ No newline at end of file
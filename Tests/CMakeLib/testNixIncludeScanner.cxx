@@ -0,0 +1,134 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmNixIncludeScanner.h"
+#include "cmSystemTools.h"
+
+#include "testCommon.h"
+
+namespace {
+
+std::string const TestDir =
+  cmSystemTools::GetCurrentWorkingDirectory() + "/testNixIncludeScanner";
+
+void WriteFile(std::string const& path, std::string const& content)
+{
+  cmSystemTools::MakeDirectory(cmSystemTools::GetFilenamePath(path));
+  cmsys::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+  fout << content;
+}
+
+std::vector<std::string> Names(std::string const& content)
+{
+  std::vector<std::string> names;
+  for (cmNixIncludeScanner::Include const& include :
+       cmNixIncludeScanner::ParseIncludes(content.data(),
+                                          content.data() + content.size())) {
+    names.push_back(include.Name);
+  }
+  return names;
+}
+
+bool Contains(std::vector<std::string> const& list, std::string const& item)
+{
+  return std::find(list.begin(), list.end(), item) != list.end();
+}
+
+bool testParseIncludes()
+{
+  std::cout << "testParseIncludes()\n";
+  std::vector<std::string> const names = Names(
+    "#include <a.h>\n"
+    "  #  include \"b.h\" // trailing comment\n"
+    "#include_next <c.h>\n"
+    "/* #include \"commented.h\"\n"
+    "#include \"commented2.h\" */\n"
+    "// #include \"line_comment.h\"\n"
+    "char const* s = \"/*\";\n"
+    "#include /* inline */ \"d.h\"\n"
+    "#define X 1 // #include \"not_a_directive.h\"\n"
+    "#\\\n"
+    "include \"continued.h\"\n"
+    "#if defined(X) && __has_include(<e.h>)\n"
+    "#elif __has_include_next(\"f.h\")\n"
+    "#endif\n"
+    "#include MACRO_HEADER\n"
+    "int x = 1; #include \"mid_line.h\"\n"
+    "#include <last.h>");
+  ASSERT_TRUE(names.size() == 8);
+  ASSERT_TRUE(names[0] == "a.h");
+  ASSERT_TRUE(names[1] == "b.h");
+  ASSERT_TRUE(names[2] == "c.h");
+  ASSERT_TRUE(names[3] == "d.h");
+  ASSERT_TRUE(names[4] == "continued.h");
+  ASSERT_TRUE(names[5] == "e.h");
+  ASSERT_TRUE(names[6] == "f.h");
+  ASSERT_TRUE(names[7] == "last.h");
+
+  std::string const hasInclude = "#if __has_include(<opt.h>)\n";
+  std::vector<cmNixIncludeScanner::Include> const includes =
+    cmNixIncludeScanner::ParseIncludes(
+      hasInclude.data(), hasInclude.data() + hasInclude.size());
+  ASSERT_TRUE(includes.size() == 1);
+  ASSERT_TRUE(includes[0].Angled);
+  ASSERT_TRUE(includes[0].Optional);
+  return true;
+}
+
+bool testScan()
+{
+  std::cout << "testScan()\n";
+  cmSystemTools::RemoveADirectory(TestDir);
+  std::string const src = TestDir + "/src";
+  std::string const inc = TestDir + "/include";
+  WriteFile(src + "/main.c",
+            "#include \"local.h\"\n"
+            "#include <lib/api.h>\n"
+            "#include <stdio.h>\n"
+            "#if __has_include(<missing.h>)\n"
+            "#endif\n");
+  WriteFile(src + "/local.h", "#include <lib/api.h>\n");
+  WriteFile(inc + "/lib/api.h", "#include \"detail.h\"\n");
+  WriteFile(inc + "/lib/detail.h", "#pragma once\n");
+  // Only found next to the including file for quoted includes
+  WriteFile(src + "/other.c", "#include <local.h>\n");
+
+  cmNixIncludeScanner scanner;
+  std::vector<std::string> const headers =
+    scanner.Scan(src + "/main.c", { inc });
+  ASSERT_TRUE(headers.size() == 3);
+  ASSERT_TRUE(Contains(headers, src + "/local.h"));
+  ASSERT_TRUE(Contains(headers, inc + "/lib/api.h"));
+  ASSERT_TRUE(Contains(headers, inc + "/lib/detail.h"));
+
+  ASSERT_TRUE(scanner.Scan(src + "/other.c", { inc }).empty());
+
+  // Headers parsed for main.c are reused for the next source
+  WriteFile(src + "/second.c", "#include \"local.h\"\n");
+  cmNixIncludeScanner::Statistics const before = scanner.GetStatistics();
+  ASSERT_TRUE(scanner.Scan(src + "/second.c", { inc }).size() == 3);
+  cmNixIncludeScanner::Statistics const after = scanner.GetStatistics();
+  ASSERT_TRUE(after.FilesParsed == before.FilesParsed + 1);
+  ASSERT_TRUE(after.ParseHits >= before.ParseHits + 3);
+  ASSERT_TRUE(after.DirectoriesListed == before.DirectoriesListed);
+  return true;
+}
+
+}
+
+int testNixIncludeScanner(int /*unused*/, char* /*unused*/[])
+{
+  int result = runTests({
+    testParseIncludes,
+    testScan,
+  });
+  cmSystemTools::RemoveADirectory(TestDir);
+  return result;
+}
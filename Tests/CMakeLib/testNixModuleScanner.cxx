@@ -0,0 +1,254 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmNixModuleScanner.h"
+#include "cmScanDepFormat.h"
+#include "cmSystemTools.h"
+
+#include "testCommon.h"
+
+namespace {
+
+std::string const TestDir =
+  cmSystemTools::GetCurrentWorkingDirectory() + "/testNixModuleScanner";
+std::string const Source = TestDir + "/src/a.cxx";
+std::string const Header = TestDir + "/src/a.h";
+std::string const DynDepFile = TestDir + "/scan/a.ddi";
+std::string const DepFile = TestDir + "/scan/a.d";
+std::string const RunLog = TestDir + "/runs";
+
+void WriteFile(std::string const& path, std::string const& content)
+{
+  cmSystemTools::MakeDirectory(cmSystemTools::GetFilenamePath(path));
+  cmsys::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+  fout << content;
+}
+
+// File times are coarse, so files written in a row may share one; wait
+// for the next file to be strictly newer
+void Wait()
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+// A scanner that logs its run and writes a P1689 file providing module
+// and a depfile naming the source and its header
+cmNixModuleScanner::Request Request(std::string const& module)
+{
+  cmNixModuleScanner::Request request;
+  request.Source = Source;
+  request.WorkingDirectory = TestDir;
+  request.DynDepFile = DynDepFile;
+  request.DepFile = DepFile;
+  request.Command = "echo run >> runs && "
+                    "printf '%s' '{\"version\":1,\"revision\":0,\"rules\":[{"
+                    "\"primary-output\":\"a.o\",\"provides\":[{"
+                    "\"logical-name\":\"" +
+    module +
+    "\",\"is-interface\":true}]}]}' > scan/a.ddi && "
+    "printf 'scan/a.ddi: src/a.cxx src/a.h\\n' > scan/a.d";
+  return request;
+}
+
+size_t Runs()
+{
+  cmsys::ifstream fin(RunLog.c_str());
+  std::string line;
+  size_t runs = 0;
+  while (std::getline(fin, line)) {
+    ++runs;
+  }
+  return runs;
+}
+
+bool Scan(cmNixModuleScanner::Request const& request,
+          std::string const& module)
+{
+  cmNixModuleScanner scanner(2);
+  std::vector<cmNixModuleScanner::Result> const results =
+    scanner.Scan({ request });
+  ASSERT_TRUE(results.size() == 1);
+  ASSERT_TRUE(results[0].Success);
+  ASSERT_TRUE(results[0].Info.Provides.size() == 1);
+  ASSERT_EQUAL(results[0].Info.Provides[0].LogicalName, module);
+  return true;
+}
+
+bool Setup()
+{
+  cmSystemTools::RemoveADirectory(TestDir);
+  WriteFile(Source, "export module a;\n");
+  WriteFile(Header, "#pragma once\n");
+  Wait();
+  return true;
+}
+
+bool testReuse()
+{
+  std::cout << "testReuse()\n";
+  ASSERT_TRUE(Setup());
+
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 1);
+  ASSERT_TRUE(cmSystemTools::FileExists(DynDepFile + ".cmd"));
+
+  // Same command and no input newer than the P1689 file
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 1);
+
+  // An input from the depfile newer than the P1689 file
+  Wait();
+  WriteFile(Header, "#pragma once\n");
+  Wait();
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 2);
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 2);
+  return true;
+}
+
+bool testChangedCommand()
+{
+  std::cout << "testChangedCommand()\n";
+  ASSERT_TRUE(Setup());
+
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 1);
+  ASSERT_TRUE(Scan(Request("b"), "b"));
+  ASSERT_TRUE(Runs() == 2);
+
+  // A missing command file is a changed command
+  cmSystemTools::RemoveFile(DynDepFile + ".cmd");
+  ASSERT_TRUE(Scan(Request("b"), "b"));
+  ASSERT_TRUE(Runs() == 3);
+  return true;
+}
+
+bool testFailedScan()
+{
+  std::cout << "testFailedScan()\n";
+  ASSERT_TRUE(Setup());
+
+  cmNixModuleScanner::Request failing = Request("a");
+  failing.Command = "echo 'a.cxx:1: no such module' && exit 3";
+  cmNixModuleScanner::Request silent = Request("a");
+  silent.Command = "true";
+  silent.DynDepFile = TestDir + "/scan/silent.ddi";
+  silent.DepFile = TestDir + "/scan/silent.d";
+
+  cmNixModuleScanner scanner(1);
+  std::vector<cmNixModuleScanner::Result> const results =
+    scanner.Scan({ failing, silent });
+  ASSERT_TRUE(results.size() == 2);
+  ASSERT_TRUE(!results[0].Success);
+  ASSERT_TRUE(results[0].Error.find("exited with code 3") !=
+              std::string::npos);
+  ASSERT_TRUE(results[0].Error.find("no such module") != std::string::npos);
+  // Exiting successfully without a P1689 file fails too
+  ASSERT_TRUE(!results[1].Success);
+  ASSERT_TRUE(results[1].Error.find("could not read module dependency") !=
+              std::string::npos);
+  ASSERT_TRUE(scanner.GetStatistics().Failed == 2);
+
+  // Failed scans are not reused
+  ASSERT_TRUE(!cmSystemTools::FileExists(DynDepFile + ".cmd"));
+  ASSERT_TRUE(Scan(Request("a"), "a"));
+  ASSERT_TRUE(Runs() == 1);
+  return true;
+}
+
+cmSourceReqInfo Module(std::string const& name,
+                       LookupMethod method = LookupMethod::ByName)
+{
+  cmSourceReqInfo info;
+  info.LogicalName = name;
+  info.Method = method;
+  return info;
+}
+
+bool testModuleUsage()
+{
+  std::cout << "testModuleUsage()\n";
+  cmScanDepInfo info;
+  info.Provides = { Module("a") };
+  info.Requires = { Module("b"), Module("<vector>", LookupMethod::IncludeAngle),
+                    Module("c") };
+  std::vector<std::string> errors;
+  cmNixModuleScanner::ModuleUsage const usage =
+    cmNixModuleScanner::GetModuleUsage("a.cxx", info, errors);
+  ASSERT_EQUAL(usage.Provides, "a");
+  ASSERT_TRUE(usage.Requires == std::vector<std::string>({ "b", "c" }));
+  ASSERT_TRUE(errors.size() == 1);
+  ASSERT_EQUAL(errors[0],
+               "Source a.cxx imports the header unit <vector>, which the Nix "
+               "generator does not support");
+
+  info.Provides = { Module("a"), Module("a2") };
+  info.Requires.clear();
+  errors.clear();
+  ASSERT_EQUAL(
+    cmNixModuleScanner::GetModuleUsage("a.cxx", info, errors).Provides, "a");
+  ASSERT_TRUE(errors.size() == 1);
+  ASSERT_EQUAL(errors[0], "Source a.cxx provides more than one C++ module");
+  return true;
+}
+
+bool testResolveImports()
+{
+  std::cout << "testResolveImports()\n";
+  // main imports a, a imports b; b is provided by lib and by app itself
+  std::unordered_map<std::string, cmNixModuleScanner::ModuleUsage> usages;
+  usages["app_main"] = { "", { "a", "missing" } };
+  usages["lib_a"] = { "a", { "b" } };
+  usages["lib_b"] = { "b", {} };
+  usages["app_b"] = { "b", {} };
+  cmNixModuleScanner::ModuleProviders providers;
+  providers["a"] = { { "lib", "lib_a" } };
+  providers["b"] = { { "lib", "lib_b" }, { "app", "app_b" } };
+
+  std::vector<std::string> errors;
+  std::map<std::string, std::string> const imports =
+    cmNixModuleScanner::ResolveImports("app", "app_main", usages, providers,
+                                       errors);
+  ASSERT_TRUE(imports.size() == 2);
+  ASSERT_EQUAL(imports.at("a"), "lib_a");
+  ASSERT_EQUAL(imports.at("b"), "app_b");
+  ASSERT_TRUE(errors.size() == 1);
+  ASSERT_EQUAL(errors[0],
+               "C++ module missing imported by target app is not provided by "
+               "any target");
+
+  // A module does not import itself
+  errors.clear();
+  usages["lib_a"].Requires.push_back("a");
+  ASSERT_TRUE(cmNixModuleScanner::ResolveImports("lib", "lib_a", usages,
+                                                 providers, errors)
+                .size() == 1);
+  ASSERT_TRUE(errors.empty());
+  return true;
+}
+
+}
+
+int testNixModuleScanner(int /*unused*/, char* /*unused*/[])
+{
+  int result = runTests({
+    testReuse,
+    testChangedCommand,
+    testFailedScan,
+    testModuleUsage,
+    testResolveImports,
+  });
+  cmSystemTools::RemoveADirectory(TestDir);
+  return result;
+}
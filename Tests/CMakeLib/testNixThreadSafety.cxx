@@ -128,6 +128,71 @@ static bool testCacheEviction()
   return true;
 }
 
+static bool testCacheLruEviction()
+{
+  std::cout << "Testing LRU eviction and counters..." << std::endl;
+  
+  cmNixCacheManager::Limits limits;
+  limits.TransitiveDependencyEntries = 64; // Four entries per shard
+  cmNixCacheManager cache(limits);
+  
+  int computeCount = 0;
+  auto compute = [&computeCount]() {
+    ++computeCount;
+    return std::vector<std::string>{ "header.h" };
+  };
+  
+  // Touch the first source after every insertion so it stays the most
+  // recently used entry of its shard
+  for (int i = 0; i < 200; ++i) {
+    cache.GetTransitiveDependencies("first.cpp", compute);
+    cache.GetTransitiveDependencies("source" + std::to_string(i) + ".cpp",
+                                    compute);
+  }
+  int const computed = computeCount;
+  cache.GetTransitiveDependencies("first.cpp", compute);
+  if (computeCount != computed) {
+    std::cerr << "Recently used entry was evicted!" << std::endl;
+    return false;
+  }
+  
+  auto stats = cache.GetStats();
+  std::cout << "  " << stats.TransitiveDependencies.Entries << " entries, "
+            << stats.TransitiveDependencies.Bytes << " bytes, "
+            << stats.TransitiveDependencies.Hits << " hits, "
+            << stats.TransitiveDependencies.Misses << " misses, "
+            << stats.TransitiveDependencies.Evictions << " evictions"
+            << std::endl;
+  if (stats.TransitiveDependencyCacheSize > 64 ||
+      stats.TransitiveDependencies.Hits != 200 ||
+      stats.TransitiveDependencies.Misses != 201 ||
+      stats.TransitiveDependencies.Evictions !=
+        201 - stats.TransitiveDependencies.Entries) {
+    std::cerr << "Unexpected cache counters!" << std::endl;
+    return false;
+  }
+  
+  // A byte budget alone also bounds the cache
+  cmNixCacheManager::Limits byteLimits;
+  byteLimits.DerivationNameEntries = 0;
+  byteLimits.DerivationNameBytes = 64 * 1024;
+  cmNixCacheManager byteCache(byteLimits);
+  for (int i = 0; i < 5000; ++i) {
+    std::string const name = "target" + std::to_string(i);
+    byteCache.GetDerivationName(name, "source.cpp",
+                                [&name]() { return name + "_source_cpp_o"; });
+  }
+  stats = byteCache.GetStats();
+  if (stats.DerivationNames.Bytes > 64 * 1024 ||
+      stats.DerivationNames.Evictions == 0) {
+    std::cerr << "Byte budget exceeded: " << stats.DerivationNames.Bytes
+              << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
 static bool testCompilerResolverThreadSafety()
 {
   std::cout << "Testing compiler resolver thread safety..." << std::endl;
@@ -255,6 +320,11 @@ int testNixThreadSafety(int /*unused*/, char* /*unused*/[])
     result = 1;
   }
   
+  if (!testCacheLruEviction()) {
+    std::cerr << "FAILED: Cache LRU eviction test" << std::endl;
+    result = 1;
+  }
+  
   if (!testCompilerResolverThreadSafety()) {
     std::cerr << "FAILED: Compiler resolver thread safety test" << std::endl;
     result = 1;
@@ -0,0 +1,78 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file LICENSE.rst or https://cmake.org/licensing for details.  */
+
+#include <iostream>
+#include <string>
+
+#include "cmsys/FStream.hxx"
+
+#include "cmSystemTools.h"
+#include "cmTryCompileResultCache.h"
+
+#include "testCommon.h"
+
+namespace {
+
+std::string const TestDir =
+  cmSystemTools::GetCurrentWorkingDirectory() + "/testTryCompileResultCache";
+
+bool testStoreAndLookup()
+{
+  std::cout << "testStoreAndLookup()\n";
+  cmSystemTools::RemoveADirectory(TestDir);
+  cmTryCompileResultCache& cache = cmTryCompileResultCache::Instance();
+  cmTryCompileResultCache::Statistics const before = cache.GetStatistics();
+
+  cmTryCompileResultCache::Entry entry;
+  ASSERT_TRUE(!cache.Lookup(TestDir, "key", entry));
+
+  entry.ExitCode = 2;
+  entry.Output = "first line\nsecond line\n";
+  cache.Store(TestDir, "key", entry);
+
+  cmTryCompileResultCache::Entry found;
+  ASSERT_TRUE(cache.Lookup(TestDir, "key", found));
+  ASSERT_TRUE(found.ExitCode == 2);
+  ASSERT_TRUE(found.Output == entry.Output);
+  ASSERT_TRUE(!cache.Lookup(TestDir, "other", found));
+
+  cmTryCompileResultCache::Statistics const after = cache.GetStatistics();
+  ASSERT_TRUE(after.Hits - before.Hits == 1);
+  ASSERT_TRUE(after.Misses - before.Misses == 2);
+  return true;
+}
+
+bool testHashCompiler()
+{
+  std::cout << "testHashCompiler()\n";
+  cmTryCompileResultCache& cache = cmTryCompileResultCache::Instance();
+  ASSERT_TRUE(cache.HashCompiler(TestDir + "/missing-cc").empty());
+
+  std::string const compiler = TestDir + "/cc";
+  {
+    cmsys::ofstream fout(compiler.c_str());
+    fout << "compiler v1";
+  }
+  std::string const hash = cache.HashCompiler(compiler);
+  ASSERT_TRUE(hash.size() == 64);
+
+  // The hash is computed once per process
+  {
+    cmsys::ofstream fout(compiler.c_str());
+    fout << "compiler v2";
+  }
+  ASSERT_TRUE(cache.HashCompiler(compiler) == hash);
+  return true;
+}
+
+}
+
+int testTryCompileResultCache(int /*unused*/, char* /*unused*/[])
+{
+  int result = runTests({
+    testStoreAndLookup,
+    testHashCompiler,
+  });
+  cmSystemTools::RemoveADirectory(TestDir);
+  return result;
+}
@@ -0,0 +1,3 @@
+file(READ ${CMAKE_CURRENT_LIST_DIR}/../data/version.txt V)
+string(STRIP "${V}" V)
+file(WRITE ${OUT} "#define VERSION \"${V}\"\n")
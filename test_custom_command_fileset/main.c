@@ -0,0 +1,4 @@
+#include <stdio.h>
+#include "version.h"
+int table_value(void);
+int main(void){printf("%s %d\n", VERSION, table_value());return 0;}
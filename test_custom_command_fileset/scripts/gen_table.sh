@@ -0,0 +1,3 @@
+#!/bin/sh
+v=$(cat "${1#--input=}")
+echo "int table_value(void) { return $v; }" > "$2"
@@ -0,0 +1,8 @@
+export module geometry;
+
+import math;
+
+export int perimeter(int width, int height)
+{
+  return add(add(width, height), add(width, height));
+}
@@ -0,0 +1,6 @@
+export module math;
+
+export int add(int a, int b)
+{
+  return a + b;
+}
@@ -0,0 +1,9 @@
+#include <cstdio>
+
+import geometry;
+
+int main()
+{
+  std::printf("perimeter %d\n", perimeter(2, 3));
+  return perimeter(2, 3) == 10 ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#ifndef GREETING_H
+#define GREETING_H
+
+char const* greeting(void);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef UNUSED_H
+#define UNUSED_H
+
+/* Included by no source */
+#define UNUSED_VALUE 1
+
+#endif
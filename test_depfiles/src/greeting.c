@@ -0,0 +1,6 @@
+#include "greeting.h"
+
+char const* greeting(void)
+{
+  return "depfiles ok";
+}
@@ -0,0 +1,7 @@
+#ifndef EXTRA_H
+#define EXTRA_H
+
+/* Only included once the test edits main.c */
+#define EXTRA_GREETING "new include ok"
+
+#endif
@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+#include "greeting.h"
+
+int main(void)
+{
+#ifdef EXTRA_GREETING
+  printf("%s\n", EXTRA_GREETING);
+#else
+  printf("%s\n", greeting());
+#endif
+  return 0;
+}
@@ -0,0 +1,8 @@
+const char* greeting(void)
+{
+#if FLAG_SETS
+  return "flag sets ok";
+#else
+  return "flag sets missing";
+#endif
+}
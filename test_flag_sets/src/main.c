@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+const char* greeting(void);
+const char* punctuation(void);
+
+int main(void)
+{
+  printf("%s%s\n", greeting(), punctuation());
+  return 0;
+}
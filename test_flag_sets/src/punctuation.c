@@ -0,0 +1,8 @@
+const char* punctuation(void)
+{
+#if FLAG_SETS
+  return PUNCTUATION;
+#else
+  return "?";
+#endif
+}
@@ -0,0 +1,10 @@
+#include "greet.h"
+
+const char* greeting(void)
+{
+#ifdef GREET_LOUD
+  return "fragments ok!";
+#else
+  return "fragments ok";
+#endif
+}
@@ -0,0 +1,4 @@
+int greet_version(void)
+{
+  return GREET_VERSION;
+}
@@ -0,0 +1,9 @@
+#include <stdio.h>
+
+const char* shared_message(void);
+
+int main(void)
+{
+  printf("%s\n", shared_message());
+  return 0;
+}
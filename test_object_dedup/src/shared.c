@@ -0,0 +1,8 @@
+#ifndef SHARED_SUFFIX
+#define SHARED_SUFFIX ""
+#endif
+
+const char* shared_message(void)
+{
+  return "object dedup ok" SHARED_SUFFIX;
+}
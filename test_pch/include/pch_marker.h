@@ -0,0 +1,31 @@
+#ifndef PCH_MARKER_H
+#define PCH_MARKER_H
+
+// Only the precompiled header includes this file, so it is parsed as text
+// only while the precompiled header is created.  A source that reads it
+// instead of using the precompiled header fails the assertion below.
+
+#include <cstddef>
+
+namespace pch_marker {
+constexpr std::size_t length(const char* s)
+{
+    return *s ? 1 + length(s + 1) : 0;
+}
+
+constexpr bool ends_with(const char* s, std::size_t n, const char* suffix,
+                         std::size_t m)
+{
+    return m == 0 ||
+        (n != 0 && s[n - 1] == suffix[m - 1] &&
+         ends_with(s, n - 1, suffix, m - 1));
+}
+}
+
+static_assert(pch_marker::ends_with(__BASE_FILE__,
+                                    pch_marker::length(__BASE_FILE__),
+                                    "cmake_pch.hxx.cxx",
+                                    pch_marker::length("cmake_pch.hxx.cxx")),
+              "the precompiled header was not used");
+
+#endif // PCH_MARKER_H
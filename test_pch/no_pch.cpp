@@ -0,0 +1,6 @@
+// Compiled without the precompiled header, so it includes what it uses
+#include <string>
+
+std::string no_pch_message() {
+    return "compiled without PCH";
+}
@@ -0,0 +1,4 @@
+const char* first(void)
+{
+  return GREETING;
+}
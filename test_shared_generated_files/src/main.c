@@ -0,0 +1,14 @@
+#include <stdio.h>
+#include <string.h>
+
+const char* first(void);
+int second(void);
+
+int main(void)
+{
+  if (strcmp(first(), GREETING) != 0 || second() != (int)strlen(GREETING)) {
+    return 1;
+  }
+  printf("%s\n", first());
+  return 0;
+}
@@ -0,0 +1,6 @@
+#include <string.h>
+
+int second(void)
+{
+  return (int)strlen(GREETING);
+}
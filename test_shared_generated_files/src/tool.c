@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+int main(void)
+{
+  printf("%s %s\n", GREETING, VERSION);
+  return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef SPECIAL_H
+#define SPECIAL_H
+
+/* Found through the INCLUDE_DIRECTORIES of special.c */
+#define SPECIAL_OFFSET 1
+
+#endif
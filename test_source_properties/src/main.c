@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+#if defined(SPECIAL_FLAG) || defined(SPECIAL_OPTION) || defined(SPECIAL_VALUE)
+#error "source properties of special.c leaked into main.c"
+#endif
+
+int special_value(void);
+
+int main(void)
+{
+  printf("special %d\n", special_value());
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include "special.h"
+
+#if !defined(SPECIAL_FLAG) || !defined(SPECIAL_OPTION)
+#error "COMPILE_FLAGS or COMPILE_OPTIONS of special.c are missing"
+#endif
+
+int special_value(void)
+{
+  return SPECIAL_VALUE + SPECIAL_OFFSET;
+}
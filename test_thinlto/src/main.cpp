@@ -0,0 +1,7 @@
+void report(int side);
+
+int main()
+{
+  report(3);
+  return 0;
+}
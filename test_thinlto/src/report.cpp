@@ -0,0 +1,8 @@
+#include <cstdio>
+
+int square_area(int side);
+
+void report(int side)
+{
+  std::printf("area %d\n", square_area(side));
+}